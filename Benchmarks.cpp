@@ -0,0 +1,652 @@
+﻿#define PICO_ECS_IMPLEMENTATION
+
+// the update benchmarks register up to 50 systems
+#define ECS_MAX_SYSTEMS 64
+
+#include "src/PicoEcsCpp.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <typeindex>
+#include <unordered_map>
+#include <vector>
+
+using namespace pico_ecs_cpp;
+
+/*
+* usage: pico_ecs_cpp_bench [output.json]
+* prints a table of results, and writes them as JSON when a path is given
+*/
+
+// helpers -----------------------------------------------
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int sampleCount = 5;
+
+struct Result
+{
+	std::string group;
+	std::string name;
+	long long entities = 0;
+	double nsPerOp = 0.0;
+	double minNsPerOp = 0.0;
+};
+
+std::vector<Result> results;
+
+struct MemoryResult
+{
+	std::string group;
+	std::string name;
+	long long entities = 0;
+	std::size_t bytes = 0;
+};
+
+std::vector<MemoryResult> memoryResults;
+
+/*
+* runs setup and func sampleCount times, timing only func,
+* records the median and minimum time per operation
+*/
+template<typename Setup, typename Func>
+void Measure(const std::string& group, const std::string& name, long long entities, long long ops, Setup&& setup, Func&& func)
+{
+	std::vector<double> samples;
+	for (int i = 0; i < sampleCount; ++i)
+	{
+		setup();
+		auto start = Clock::now();
+		func();
+		auto end = Clock::now();
+		samples.push_back(std::chrono::duration<double, std::nano>(end - start).count() / static_cast<double>(ops));
+	}
+	std::sort(samples.begin(), samples.end());
+
+	Result result{ group, name, entities, samples[samples.size() / 2], samples.front() };
+	std::printf("%-14s %-40s %9lld %12.2f ns/op\n", group.c_str(), name.c_str(), entities, result.nsPerOp);
+	results.push_back(result);
+}
+
+template<typename Func>
+void Measure(const std::string& group, const std::string& name, long long entities, long long ops, Func&& func)
+{
+	Measure(group, name, entities, ops, []() {}, std::forward<Func>(func));
+}
+
+// records the bytes an instance took for something
+void MeasureMemory(const std::string& group, const std::string& name, long long entities, std::size_t bytes)
+{
+	std::printf("%-14s %-40s %9lld %12.1f KiB\n", group.c_str(), name.c_str(), entities, static_cast<double>(bytes) / 1024.0);
+	memoryResults.push_back(MemoryResult{ group, name, entities, bytes });
+}
+
+std::string JsonEscape(const std::string& str)
+{
+	std::string out;
+	for (char c : str)
+	{
+		if (c == '"' || c == '\\') out += '\\';
+		out += c;
+	}
+	return out;
+}
+
+void WriteJson(const std::string& path)
+{
+	std::ofstream file(path);
+	file << "{\n";
+	file << "  \"library\": \"pico_ecs_cpp\",\n";
+#if defined(NDEBUG)
+	file << "  \"optimized\": true,\n";
+#else
+	file << "  \"optimized\": false,\n";
+#endif
+	file << "  \"samples\": " << sampleCount << ",\n";
+	file << "  \"results\": [\n";
+	for (std::size_t i = 0; i < results.size(); ++i)
+	{
+		const Result& result = results[i];
+		file << "    { \"group\": \"" << JsonEscape(result.group)
+			<< "\", \"name\": \"" << JsonEscape(result.name)
+			<< "\", \"entities\": " << result.entities
+			<< ", \"ns_per_op\": " << result.nsPerOp
+			<< ", \"min_ns_per_op\": " << result.minNsPerOp
+			<< " }" << (i + 1 < results.size() ? "," : "") << '\n';
+	}
+	file << "  ],\n";
+	file << "  \"memory\": [\n";
+	for (std::size_t i = 0; i < memoryResults.size(); ++i)
+	{
+		const MemoryResult& result = memoryResults[i];
+		file << "    { \"group\": \"" << JsonEscape(result.group)
+			<< "\", \"name\": \"" << JsonEscape(result.name)
+			<< "\", \"entities\": " << result.entities
+			<< ", \"bytes\": " << result.bytes
+			<< " }" << (i + 1 < memoryResults.size() ? "," : "") << '\n';
+	}
+	file << "  ]\n}\n";
+}
+
+// prevents the optimizer from dropping benchmarked work
+volatile float sink = 0.0f;
+
+// components -----------------------------------------
+
+struct Transform
+{
+	float x, y;
+};
+
+struct Velocity
+{
+	float x, y;
+};
+
+// debug data only a few entities carry
+struct DebugInfo
+{
+	char text[64];
+};
+
+// fills an instance with entities holding Transform and Velocity
+std::vector<EntityId> Populate(EcsInstance& ecs, int entityCount)
+{
+	std::vector<EntityId> ids(entityCount);
+	std::vector<Transform> transforms(entityCount, Transform{ 0.0f, 0.0f });
+	std::vector<Velocity> velocities(entityCount, Velocity{ 1.0f, 1.0f });
+	ecs.EntityCreateBatch(entityCount, ids);
+	ecs.EntityAddComponentBatch<Transform>(ids, transforms);
+	ecs.EntityAddComponentBatch<Velocity>(ids, velocities);
+	return ids;
+}
+
+// benchmarks --------------------------------------------
+
+void BenchEntities(int entityCount)
+{
+	EcsInstance ecs(entityCount);
+	std::vector<EntityId> ids(entityCount);
+
+	Measure("entity", "create", entityCount, entityCount,
+		[&]() { ecs.Reset(); },
+		[&]()
+		{
+			for (int i = 0; i < entityCount; ++i)
+				ids[i] = ecs.EntityCreate();
+		});
+
+	Measure("entity", "create batch", entityCount, entityCount,
+		[&]() { ecs.Reset(); },
+		[&]() { ecs.EntityCreateBatch(entityCount, ids); });
+
+	Measure("entity", "destroy", entityCount, entityCount,
+		[&]()
+		{
+			ecs.Reset();
+			ecs.EntityCreateBatch(entityCount, ids);
+		},
+		[&]()
+		{
+			for (EntityId id : ids)
+				ecs.EntityDestroy(id);
+		});
+}
+
+void BenchComponents(int entityCount)
+{
+	EcsInstance ecs(entityCount);
+	ecs.ComponentRegister<Transform>();
+	ecs.ComponentRegister<Velocity>();
+	std::vector<EntityId> ids(entityCount);
+	std::vector<Transform> transforms(entityCount, Transform{ 1.0f, 2.0f });
+
+	auto fresh = [&]()
+		{
+			ecs.Reset();
+			ecs.EntityCreateBatch(entityCount, ids);
+		};
+
+	Measure("component", "add", entityCount, entityCount, fresh, [&]()
+		{
+			for (int i = 0; i < entityCount; ++i)
+				ecs.EntityAddComponent<Transform>(ids[i], &transforms[i]);
+		});
+
+	Measure("component", "add batch", entityCount, entityCount, fresh, [&]()
+		{
+			ecs.EntityAddComponentBatch<Transform>(ids, transforms);
+		});
+
+	auto filled = [&]()
+		{
+			fresh();
+			ecs.EntityAddComponentBatch<Transform>(ids, transforms);
+		};
+
+	Measure("component", "get", entityCount, entityCount, filled, [&]()
+		{
+			float acc = 0.0f;
+			for (EntityId id : ids)
+				acc += ecs.EntityGetComponent<Transform>(id)->x;
+			sink = acc;
+		});
+
+	Measure("component", "has", entityCount, entityCount, filled, [&]()
+		{
+			int count = 0;
+			for (EntityId id : ids)
+				count += ecs.EntityHasComponent<Transform>(id) ? 1 : 0;
+			sink = static_cast<float>(count);
+		});
+
+	Measure("component", "remove", entityCount, entityCount, filled, [&]()
+		{
+			for (EntityId id : ids)
+				ecs.EntityRemoveComponent<Transform>(id);
+		});
+
+	// the std::type_index map lookup the wrapper used before type slots
+	std::unordered_map<std::type_index, ComponentId> componentMap;
+	componentMap[typeid(Transform)] = 0;
+	Measure("component", "get (type_index map)", entityCount, entityCount, filled, [&]()
+		{
+			float acc = 0.0f;
+			for (EntityId id : ids)
+			{
+				if (componentMap.find(typeid(Transform)) == componentMap.end()) continue;
+				acc += static_cast<Transform*>(ecs_get(ecs.GetInstance(), id, componentMap.at(typeid(Transform))))->x;
+			}
+			sink = acc;
+		});
+}
+
+void BenchPrefab(int entityCount)
+{
+	EcsInstance ecs(entityCount);
+	ecs.ComponentRegister<Transform>();
+	ecs.ComponentRegister<Velocity>();
+
+	Prefab prefab;
+	prefab.Set(Transform{ 1.0f, 2.0f }).Set(Velocity{ 3.0f, 4.0f });
+
+	Measure("prefab", "instantiate", entityCount, entityCount,
+		[&]() { ecs.Reset(); },
+		[&]() { ecs.PrefabInstantiate(prefab, entityCount); });
+}
+
+void BenchUpdate(int entityCount, int systemCount)
+{
+	EcsInstance ecs(entityCount);
+	ecs.ComponentRegister<Transform>();
+	ecs.ComponentRegister<Velocity>();
+
+	for (int i = 0; i < systemCount; ++i)
+	{
+		ecs.SystemRegister<Require<Transform, Velocity>>("Move" + std::to_string(i),
+			[](View<Transform, Velocity> view, EcsDt dt)
+			{
+				for (auto [tr, vel] : view)
+				{
+					tr.x += vel.x * static_cast<float>(dt);
+					tr.y += vel.y * static_cast<float>(dt);
+				}
+			});
+	}
+	Populate(ecs, entityCount);
+
+	Measure("update", std::to_string(systemCount) + " systems", entityCount, 1, [&]()
+		{
+			ecs.Update(0.016);
+		});
+}
+
+void BenchIteration(int entityCount)
+{
+	EcsInstance ecs(entityCount);
+	ecs.ComponentRegister<Transform>();
+	ecs.ComponentRegister<Velocity>();
+	std::vector<EntityId> ids = Populate(ecs, entityCount);
+
+	Measure("iteration", "EntityGetComponent", entityCount, entityCount, [&]()
+		{
+			for (EntityId id : ids)
+			{
+				Transform* tr = ecs.EntityGetComponent<Transform>(id);
+				Velocity* vel = ecs.EntityGetComponent<Velocity>(id);
+				tr->x += vel->x;
+				tr->y += vel->y;
+			}
+		});
+
+	Measure("iteration", "View", entityCount, entityCount, [&]()
+		{
+			for (auto [tr, vel] : View<Transform, Velocity>(ecs, ids.data(), entityCount))
+			{
+				tr.x += vel.x;
+				tr.y += vel.y;
+			}
+		});
+}
+
+// Transform += Velocity * dt, per entity as in MoveSystem and through component columns
+void BenchSimd(int entityCount)
+{
+	EcsInstance ecs(entityCount);
+	ecs.ComponentRegister<Transform>();
+	ecs.ComponentRegister<Velocity>();
+	std::vector<EntityId> ids = Populate(ecs, entityCount);
+	std::vector<Transform> transforms(entityCount);
+	std::vector<Velocity> velocities(entityCount);
+	const float dt = 0.016f;
+
+	Measure("simd", "per entity", entityCount, entityCount, [&]()
+		{
+			for (EntityId id : ids)
+			{
+				Transform* tr = ecs.EntityGetComponent<Transform>(id);
+				Velocity* vel = ecs.EntityGetComponent<Velocity>(id);
+				tr->x += vel->x * dt;
+				tr->y += vel->y * dt;
+			}
+		});
+
+	Measure("simd", std::string("gather/scatter ") + simd::GetInstructionSet(), entityCount, entityCount, [&]()
+		{
+			ecs.ComponentGather<Transform>(ids, transforms);
+			ecs.ComponentGather<Velocity>(ids, velocities);
+			simd::AddScaled(Span<Transform>(transforms), Span<const Velocity>(velocities), dt);
+			ecs.ComponentScatter<Transform>(ids, transforms);
+		});
+
+	// batch-created entities have consecutive ids, so the columns can be processed in place
+	Measure("simd", std::string("column ") + simd::GetInstructionSet(), entityCount, entityCount, [&]()
+		{
+			Span<Transform> trColumn = ecs.ComponentColumn<Transform>(ids);
+			Span<Velocity> velColumn = ecs.ComponentColumn<Velocity>(ids);
+			simd::AddScaled(trColumn, Span<const Velocity>(velColumn), dt);
+		});
+
+	Measure("simd", "column scalar", entityCount, entityCount, [&]()
+		{
+			Span<Transform> trColumn = ecs.ComponentColumn<Transform>(ids);
+			Span<Velocity> velColumn = ecs.ComponentColumn<Velocity>(ids);
+			simd::AddScaledScalar(reinterpret_cast<float*>(trColumn.Data()),
+				reinterpret_cast<const float*>(velColumn.Data()), dt, trColumn.Size() * 2);
+		});
+}
+
+void BenchClone(int entityCount)
+{
+	EcsInstance ecs(entityCount);
+	ecs.ComponentRegister<Transform>();
+	ecs.ComponentRegister<Velocity>();
+	Populate(ecs, entityCount);
+
+	EcsInstance fork(entityCount);
+	ecs.CloneInto(fork);
+
+	// a fork one frame behind only differs in component values
+	Measure("clone", "CloneInto", entityCount, entityCount, [&]()
+		{
+			ecs.CloneInto(fork);
+		});
+
+	// every sample fills an empty frame, the worst case for a push
+	FrameHistory history(8, entityCount);
+	Measure("clone", "FrameHistory::Push", entityCount, entityCount, [&]()
+		{
+			history.Push(ecs);
+		});
+}
+
+// DebugInfo on one entity in a thousand, kept in dense and in sparse storage
+void BenchSparse(int entityCount)
+{
+	for (ComponentStorage storage : { ComponentStorage::Dense, ComponentStorage::Sparse })
+	{
+		const std::string label = storage == ComponentStorage::Dense ? "dense" : "sparse";
+
+		EcsInstance ecs(entityCount);
+		ecs.ComponentRegister<Transform>();
+		std::vector<EntityId> ids(entityCount);
+		std::vector<Transform> transforms(entityCount, Transform{ 0.0f, 0.0f });
+		ecs.EntityCreateBatch(entityCount, ids);
+		ecs.EntityAddComponentBatch<Transform>(ids, transforms);
+
+		const std::size_t before = ecs.GetMemoryStats().bytesInUse;
+		ecs.ComponentRegister<DebugInfo>(storage);
+		std::vector<EntityId> holders;
+		for (int i = 0; i < entityCount; i += 1000)
+		{
+			DebugInfo info{ "debug" };
+			ecs.EntityAddComponent<DebugInfo>(ids[i], &info);
+			holders.push_back(ids[i]);
+		}
+		MeasureMemory("sparse", "DebugInfo on 0.1% " + label, entityCount, ecs.GetMemoryStats().bytesInUse - before);
+
+		Measure("sparse", "EntityGetComponent " + label, entityCount, static_cast<long long>(holders.size()), [&]()
+			{
+				for (EntityId id : holders)
+					sink = sink + static_cast<float>(ecs.EntityGetComponent<DebugInfo>(id)->text[0]);
+			});
+
+		Measure("sparse", "EntityHasComponent all " + label, entityCount, entityCount, [&]()
+			{
+				int count = 0;
+				for (EntityId id : ids)
+					count += ecs.EntityHasComponent<DebugInfo>(id) ? 1 : 0;
+				sink = sink + static_cast<float>(count);
+			});
+	}
+}
+
+// the same move system and component churn on both storage backends
+void BenchBackend(int entityCount)
+{
+	for (StorageBackend backend : { StorageBackend::ComponentArrays, StorageBackend::Archetypes })
+	{
+		const std::string label = backend == StorageBackend::ComponentArrays ? "component arrays" : "archetypes";
+
+		EcsInstance ecs(entityCount, nullptr, backend);
+		ecs.ComponentRegister<Transform>();
+		ecs.ComponentRegister<Velocity>();
+		ecs.ComponentRegister<DebugInfo>();
+		ecs.SystemRegister<Require<Transform, const Velocity>>("Move",
+			[](View<Transform, const Velocity> view, EcsDt dt)
+			{
+				for (auto [tr, vel] : view)
+				{
+					tr.x += vel.x * static_cast<float>(dt);
+					tr.y += vel.y * static_cast<float>(dt);
+				}
+			});
+		std::vector<EntityId> ids = Populate(ecs, entityCount);
+
+		Measure("backend", "update " + label, entityCount, entityCount, [&]()
+			{
+				ecs.Update(0.016);
+			});
+
+		// every entity changes archetype twice
+		DebugInfo info{ "debug" };
+		Measure("backend", "add/remove churn " + label, entityCount, entityCount, [&]()
+			{
+				for (EntityId id : ids)
+					ecs.EntityAddComponent<DebugInfo>(id, &info);
+				for (EntityId id : ids)
+					ecs.EntityRemoveComponent<DebugInfo>(id);
+			});
+	}
+}
+
+// destroys half of the entities at random and creates as many again, so recycled ids end up scattered
+void Churn(EcsInstance& ecs, std::vector<EntityId>& ids)
+{
+	std::mt19937 random(42);
+	std::shuffle(ids.begin(), ids.end(), random);
+	const std::size_t half = ids.size() / 2;
+	for (std::size_t i = 0; i < half; ++i)
+		ecs.EntityDestroy(ids[i]);
+
+	Transform tr{ 0.0f, 0.0f };
+	Velocity vel{ 1.0f, 1.0f };
+	for (std::size_t i = 0; i < half; ++i)
+	{
+		ids[i] = ecs.EntityCreate();
+		ecs.EntityAddComponent<Transform>(ids[i], &tr);
+		ecs.EntityAddComponent<Velocity>(ids[i], &vel);
+	}
+}
+
+// the move system over churned entities, sorted by id, and after compaction
+void BenchLocality(int entityCount)
+{
+	EcsInstance ecs(entityCount);
+	ecs.ComponentRegister<Transform>();
+	ecs.ComponentRegister<Velocity>();
+	ecs.SystemRegister<Require<Transform, const Velocity>>("Move",
+		[](View<Transform, const Velocity> view, EcsDt dt)
+		{
+			for (auto [tr, vel] : view)
+			{
+				tr.x += vel.x * static_cast<float>(dt);
+				tr.y += vel.y * static_cast<float>(dt);
+			}
+		});
+	std::vector<EntityId> ids = Populate(ecs, entityCount);
+	Churn(ecs, ids);
+
+	Measure("locality", "update churned", entityCount, entityCount, [&]()
+		{
+			ecs.Update(0.016);
+		});
+
+	ecs.SystemSortBy("Move", [](EcsInstance& ecs, EntityId id) { return static_cast<std::uint64_t>(id); });
+	Measure("locality", "update sorted by id", entityCount, entityCount, [&]()
+		{
+			ecs.Update(0.016);
+		});
+	ecs.SystemSortBy("Move", nullptr);
+
+	std::vector<EntityId> translation;
+	ecs.Compact(translation);
+	Measure("locality", "update compacted", entityCount, entityCount, [&]()
+		{
+			ecs.Update(0.016);
+		});
+
+	EcsInstance holes(entityCount);
+	holes.ComponentRegister<Transform>();
+	holes.ComponentRegister<Velocity>();
+	Measure("locality", "Compact half destroyed", entityCount, entityCount,
+		[&]()
+		{
+			holes.Reset();
+			std::vector<EntityId> live = Populate(holes, entityCount);
+			for (std::size_t i = 0; i < live.size(); i += 2)
+				holes.EntityDestroy(live[i]);
+		},
+		[&]()
+		{
+			holes.Compact(translation);
+		});
+}
+
+// a query matching 1% of the entities against checking every entity, and the cost of keeping queries up to date
+void BenchQuery(int entityCount)
+{
+	const long long matches = (entityCount + 99) / 100;
+	Velocity vel{ 1.0f, 1.0f };
+
+	for (bool queried : { false, true })
+	{
+		EcsInstance ecs(entityCount);
+		ecs.ComponentRegister<Transform>();
+		ecs.ComponentRegister<Velocity>();
+		ecs.ComponentRegister<DebugInfo>();
+
+		// like systems, queries are best created before the entities
+		if (queried)
+		{
+			ecs.Query<With<const Transform, const DebugInfo>>();
+			ecs.Query<With<Velocity>, Without<DebugInfo>>();
+		}
+
+		std::vector<EntityId> ids = Populate(ecs, entityCount);
+		for (int i = 0; i < entityCount; i += 100)
+			ecs.EntityAddComponent<DebugInfo>(ids[i]);
+
+		if (queried)
+		{
+			Measure("query", "Query 1%", entityCount, matches, [&]()
+				{
+					float sum = 0.0f;
+					for (auto [tr, info] : ecs.Query<With<const Transform, const DebugInfo>>())
+						sum += tr.x;
+					sink = sink + sum;
+				});
+		}
+		else
+		{
+			Measure("query", "EntityHasComponent all", entityCount, matches, [&]()
+				{
+					float sum = 0.0f;
+					for (EntityId id : ids)
+					{
+						if (ecs.EntityHasComponent<DebugInfo>(id))
+							sum += ecs.EntityReadComponent<Transform>(id)->x;
+					}
+					sink = sink + sum;
+				});
+		}
+
+		Measure("query", queried ? "remove and add Velocity, 2 queries" : "remove and add Velocity, no queries", entityCount, entityCount, [&]()
+			{
+				for (EntityId id : ids)
+					ecs.EntityRemoveComponent<Velocity>(id);
+				for (EntityId id : ids)
+					ecs.EntityAddComponent<Velocity>(id, &vel);
+			});
+	}
+}
+
+int main(int argc, char** argv)
+{
+#if !defined(NDEBUG)
+	std::cout << "Build with optimizations enabled for meaningful numbers.\n\n";
+#endif
+
+	BenchEntities(100000);
+	BenchComponents(100000);
+	BenchPrefab(100000);
+
+	for (int systemCount : { 1, 10, 50 })
+		BenchUpdate(10000, systemCount);
+
+	for (int entityCount : { 1000, 10000, 100000, 1000000 })
+		BenchIteration(entityCount);
+
+	for (int entityCount : { 10000, 1000000 })
+		BenchSimd(entityCount);
+
+	BenchClone(100000);
+	BenchSparse(1000000);
+
+	for (int entityCount : { 10000, 100000 })
+		BenchBackend(entityCount);
+
+	BenchLocality(1000000);
+	BenchQuery(1000000);
+
+	if (argc > 1)
+	{
+		WriteJson(argv[1]);
+		std::cout << "\nResults written to " << argv[1] << '\n';
+	}
+}
@@ -0,0 +1,134 @@
+﻿#define PICO_ECS_IMPLEMENTATION
+
+#define PICO_ECS_CPP_ERROR_USE_CALLBACK
+#define PICO_ECS_CPP_SHORTHAND_MACROS
+#define PICO_ECS_CPP_PROFILING
+
+#include "src/PicoEcsCpp.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdio>
+
+/*
+* profiling changes how Update runs systems,
+* so it is tested apart from the default configuration in Tests.cpp
+*/
+
+void Test(const std::string& title)
+{
+	std::cout << "\n>>> " << title << " -------------\n";
+}
+
+void Instance(int i)
+{
+	std::cout << "> EcsInstance #" << i << '\n';
+}
+
+using namespace pico_ecs_cpp;
+
+// components -----------------------------------------
+
+struct Transform
+{
+	float x, y;
+};
+PICO_ECS_CPP_COMPONENT_CONSTRUCTOR_COPY(Transform);
+
+struct Velocity
+{
+	float x, y;
+};
+PICO_ECS_CPP_COMPONENT_CONSTRUCTOR_COPY(Velocity);
+
+// tests --------------------------------------
+
+int main()
+{
+	PicoEcsCppErrorHandler = [](StatusCode code, const std::string& msg)
+		{
+			if (code != StatusCode::Success)
+				std::cerr << '[' << GetStatusMessage(code) << "] " << msg << '\n';
+		};
+
+	std::cout << "Starting profiling tests.\nError output is expected as long as it's not an assert failure.\n\n";
+
+	/*
+	* should be silent
+	* stats are computed over the most recent 128 samples
+	*/
+	Test("Profile stats");
+	{
+		detail::ProfileWindow window;
+		assert(window.GetStats().sampleCount == 0);
+
+		// 200 samples, the window keeps the last 128: 128 down to 101, then 1 to 100
+		for (int ms = 200; ms > 100; --ms)
+			window.Add(static_cast<double>(ms));
+		for (int ms = 1; ms <= 100; ++ms)
+			window.Add(static_cast<double>(ms));
+
+		ProfileStats stats = window.GetStats();
+		assert(stats.sampleCount == 128);
+		assert(stats.lastMs == 100.0);
+		assert(stats.minMs == 1.0);
+		assert(stats.meanMs == 64.5);
+		assert(stats.p99Ms == 127.0);
+
+		// a single slow frame lifts the mean, but not the 99th percentile of 128 samples
+		window.Clear();
+		for (int i = 0; i < 127; ++i)
+			window.Add(1.0);
+		window.Add(1000.0);
+		stats = window.GetStats();
+		assert(stats.minMs == 1.0 && stats.p99Ms == 1.0 && stats.meanMs > stats.p99Ms);
+		assert(stats.lastMs == 1000.0);
+	}
+
+	/*
+	* should output 1 error when writing the trace to an invalid path
+	*/
+	Test("Profiling");
+	Instance(1);
+	{
+		EcsInstance ecs(64);
+		ecs.ComponentRegister<Transform>(TransformConstructor);
+		ecs.ComponentRegister<Velocity>(VelocityConstructor);
+
+		SystemHandle move;
+		ecs.SystemRegister<Require<Transform, Velocity>>("Move", [](View<Transform, Velocity> view, EcsDt dt)
+			{
+				for (auto [tr, vel] : view)
+					tr.x += vel.x;
+			}, &move);
+		ecs.SystemRegister<Require<Transform>>("Count", [](EcsInstance& ecs, EntityId* entities, int entityCount, EcsDt dt) {});
+
+		Prefab moving;
+		moving.Set(Transform{ 0.0f, 0.0f }).Set(Velocity{ 1.0f, 0.0f });
+		ecs.PrefabInstantiate(moving, 10);
+
+		for (int frame = 0; frame < 200; ++frame)
+			assert(ecs.Update() == StatusCode::Success);
+
+		// timings depend on the machine, the stats themselves are checked above
+		std::vector<SystemProfile> profiles = ecs.ProfileGetSystems();
+		assert(profiles.size() == 2);
+		assert(profiles[0].name == "Move" && profiles[0].handle == move);
+		assert(profiles[0].entityCount == 10);
+		assert(profiles[0].time.sampleCount == 128);
+		assert(profiles[1].queueTime.sampleCount == 128);
+		assert(ecs.ProfileGetUpdate().sampleCount == 128);
+		assert(ecs.ProfileGetFlush().sampleCount == 128);
+
+		ecs.SystemDisable(move);
+		ecs.ProfileClear();
+		assert(ecs.Update() == StatusCode::Success);
+		assert(ecs.ProfileGetSystems()[0].time.sampleCount == 0);
+		assert(ecs.ProfileGetSystems()[1].time.sampleCount == 1);
+
+		assert(ecs.ProfileWriteTrace("pico_ecs_cpp_trace.json") == StatusCode::Success);
+		std::remove("pico_ecs_cpp_trace.json");
+		assert(ecs.ProfileWriteTrace("missing_dir/trace.json") == StatusCode::FileFail);
+	}
+}
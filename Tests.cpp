@@ -10,6 +10,14 @@
 #include <string>
 #include <vector>
 #include <sstream>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <optional>
+#include <algorithm>
+#include <memory>
+#include <cmath>
+#include <stdexcept>
 
 void Test(const std::string& title)
 {
@@ -37,14 +45,87 @@ struct Velocity
 };
 PICO_ECS_CPP_COMPONENT_CONSTRUCTOR_COPY(Velocity);
 
+// gets generated constructor and destructor
 struct Name
 {
 	std::string name;
 };
-PICO_ECS_CPP_COMPONENT_CONSTRUCTOR_COPY(Name);
+
+// counts live instances to check construction and destruction
+struct Tracked
+{
+	static inline int alive = 0;
+
+	Tracked(int value, std::string label) : value(value), label(std::move(label)) { ++alive; }
+	Tracked(const Tracked& other) : value(other.value), label(other.label) { ++alive; }
+	Tracked(Tracked&& other) noexcept : value(other.value), label(std::move(other.label)) { ++alive; }
+	~Tracked() { --alive; }
+
+	int value;
+	std::string label;
+};
+
+// constructed from a HealthSpawn, not copied from another Health
+struct HealthSpawn
+{
+	int max;
+};
+
+struct Health
+{
+	int current, max;
+};
+PICO_ECS_CPP_COMPONENT_CONSTRUCTOR(Health)
+{
+	const HealthSpawn* spawn = static_cast<const HealthSpawn*>(args);
+	new (ptr) Health{ spawn->max, spawn->max };
+};
+
+// constructed from a string literal, not copied from another Label
+struct Label
+{
+	std::string text;
+};
+PICO_ECS_CPP_COMPONENT_CONSTRUCTOR(Label)
+{
+	new (ptr) Label{ static_cast<const char*>(args) };
+};
+PICO_ECS_CPP_COMPONENT_DESTRUCTOR(Label)
+{
+	static_cast<Label*>(ptr)->~Label();
+};
+
+// aligned beyond what sparse and chunked storage provide
+struct alignas(64) Lanes
+{
+	float values[16];
+};
+
+// registered as tags, kept as bits without storage
+struct Frozen { };
+struct Visible { };
 
 struct UnregisteredComp { };
 
+// resources ------------------------------------------------
+
+struct GameTime
+{
+	double elapsed;
+	int frame;
+};
+
+struct Config
+{
+	std::string title;
+	int difficulty = 1;
+};
+
+struct BrokenConfig
+{
+	BrokenConfig() { throw std::runtime_error("broken config"); }
+};
+
 // systems ------------------------------------------------
 
 // requires all components, excludes none
@@ -99,6 +180,38 @@ PICO_ECS_CPP_SYSTEM_FUNCTION(MoveSystem)
 	return 1;
 }
 
+// same as MoveSystem, iterates through a view
+const std::string viewMoveSystemName("ViewMoveSystem");
+PICO_ECS_CPP_SYSTEM_FUNCTION(ViewMoveSystem)
+{
+	EcsInstance* instance = static_cast<EcsInstance*>(udata);
+	if (instance)
+	{
+		View<Transform, Velocity> view(*instance, entities, entity_count);
+		assert(view.Size() == entity_count);
+
+		for (auto it = view.begin(); it != view.end(); ++it)
+		{
+			auto [tr, vel] = *it;
+			assert(&tr == instance->EntityGetComponent<Transform>(it.GetEntity()));
+			assert(&vel == instance->EntityGetComponent<Velocity>(it.GetEntity()));
+		}
+
+		for (auto [tr, vel] : view)
+		{
+			tr.x += vel.x;
+			tr.y += vel.y;
+		}
+
+		view.Each([](EntityId id, Transform& tr, Velocity& vel)
+			{
+				std::cout << "- Entity " << id << ": " << tr.x << " - " << tr.y << '\n';
+			});
+		return 0;
+	}
+	return 1;
+}
+
 const std::string unregisteredSystemName("UnregisteredSystem");
 PICO_ECS_CPP_SYSTEM_FUNCTION(UnregisteredSystem)
 {
@@ -141,10 +254,10 @@ int main()
 	assert(ecs1.ComponentRegister<Transform>(TransformConstructor) == StatusCode::Success);
 	assert(ecs1.ComponentRegister<Transform>(TransformConstructor) == StatusCode::CompExists);
 	assert(ecs1.ComponentRegister<Velocity>(VelocityConstructor) == StatusCode::Success);
-	assert(ecs1.ComponentRegister<Name>(NameConstructor) == StatusCode::Success);
+	assert(ecs1.ComponentRegister<Name>() == StatusCode::Success);
 
 	Instance(2);
-	assert(ecs2.ComponentRegister<Name>(NameConstructor) == StatusCode::Success);
+	assert(ecs2.ComponentRegister<Name>() == StatusCode::Success);
 	assert(ecs2.ComponentRegister<Transform>(TransformConstructor) == StatusCode::Success);
 	assert(ecs2.ComponentRegister<Velocity>(VelocityConstructor) == StatusCode::Success);
 
@@ -159,6 +272,39 @@ int main()
 
 	Instance(2);
 	assert(ecs2.SystemRegister(moveSystemName, MoveSystem) == StatusCode::Success);
+	assert(ecs2.SystemRegister(viewMoveSystemName, ViewMoveSystem) == StatusCode::Success);
+
+	/*
+	* should output 2 errors: when trying to register a callable system
+	* with an unregistered component, and under a name that is already taken
+	*/
+	Test("Callable system registration");
+	Instance(2);
+	int lambdaViewVisited = 0;
+	int lambdaRawVisited = 0;
+	assert((ecs2.SystemRegister<Require<Transform, Velocity>, Exclude<Name>>("LambdaViewSystem",
+		[&lambdaViewVisited](View<Transform, Velocity> view, EcsDt dt)
+		{
+			for (auto [tr, vel] : view)
+			{
+				assert(tr.x == tr.x && vel.x == vel.x);
+				++lambdaViewVisited;
+			}
+		}) == StatusCode::Success));
+	assert((ecs2.SystemRegister<Require<Name>>("LambdaRawSystem",
+		[&lambdaRawVisited](EcsInstance& ecs, EntityId* entities, int entityCount, EcsDt dt) -> ReturnCode
+		{
+			for (int i = 0; i < entityCount; ++i)
+			{
+				assert(ecs.EntityGetComponent<Name>(entities[i]));
+				++lambdaRawVisited;
+			}
+			return 0;
+		}) == StatusCode::Success));
+	assert((ecs2.SystemRegister<Require<UnregisteredComp>>("LambdaUnregSystem",
+		[](EcsInstance&, EntityId*, int, EcsDt) {}) == StatusCode::CompNotReg));
+	assert((ecs2.SystemRegister<Require<Name>>(moveSystemName,
+		[](EcsInstance&, EntityId*, int, EcsDt) {}) == StatusCode::SysExists));
 
 	/*
 	* should output 4 errors: when trying to require/exclude unregistered component
@@ -179,6 +325,10 @@ int main()
 
 	assert(ecs2.SystemExclude<Name>(moveSystemName) == StatusCode::Success);
 
+	assert(ecs2.SystemRequire<Transform>(viewMoveSystemName) == StatusCode::Success);
+	assert(ecs2.SystemRequire<Velocity>(viewMoveSystemName) == StatusCode::Success);
+	assert(ecs2.SystemExclude<Name>(viewMoveSystemName) == StatusCode::Success);
+
 	assert(ecs2.SystemExclude<Name>(unregisteredSystemName) == StatusCode::SysNotReg);
 	assert(ecs2.SystemExclude<UnregisteredComp>(moveSystemName) == StatusCode::CompNotReg);
 
@@ -198,6 +348,26 @@ int main()
 
 	assert(ecs2.SystemDisable(unregisteredSystemName) == StatusCode::SysNotReg);
 
+	/*
+	* should print 1 error when trying to enable a system through an invalid handle
+	*/
+	Test("System handles");
+	Instance(2);
+	SystemHandle moveHandle = ecs2.SystemGetHandle(moveSystemName);
+	assert(moveHandle.IsValid());
+	assert(moveHandle != ecs2.SystemGetHandle(viewMoveSystemName));
+	assert(!ecs2.SystemGetHandle(unregisteredSystemName).IsValid());
+
+	assert(ecs2.SystemDisable(moveHandle) == StatusCode::Success);
+	assert(ecs2.SystemEnable(moveHandle) == StatusCode::Success);
+	assert(ecs2.SystemEnable(SystemHandle()) == StatusCode::SysNotReg);
+
+	SystemHandle handleSystem;
+	assert(ecs2.SystemRegister("HandleSystem", UnregisteredSystem, nullptr, nullptr, &handleSystem) == StatusCode::Success);
+	assert(handleSystem.IsValid() && handleSystem == ecs2.SystemGetHandle("HandleSystem"));
+	assert(ecs2.SystemRequire<Transform>(handleSystem) == StatusCode::Success);
+	assert(ecs2.SystemExclude<Velocity>(handleSystem) == StatusCode::Success);
+
 	/*
 	* should be silent
 	*/
@@ -270,15 +440,1638 @@ int main()
 	/*
 	* should print what systems are outputting
 	* entity components for the first
-	* transform changes for the second
+	* transform changes for the second,
+	* followed by the positions after the view system moved them again.
+	* a system returning non-zero fails Update, however the systems are run
 	*/
 	Test("System update");
 	Instance(1);
-	ecs1.Update();
-	ecs1.Update();
+	assert(ecs1.Update() == StatusCode::Success);
+	assert(ecs1.Update() == StatusCode::Success);
 
 	Instance(2);
-	ecs2.Update();
+	assert(ecs2.Update() == StatusCode::Success);
+	assert(lambdaViewVisited == 5);
+	assert(lambdaRawVisited == 5);
+	{
+		EcsInstance failing(16);
+		failing.ComponentRegister<Transform>();
+		assert(failing.SystemRegister<Require<Transform>>("Fail",
+			[](EcsInstance& ecs, EntityId* entities, int entityCount, EcsDt dt) -> ReturnCode { return 1; }) == StatusCode::Success);
+		assert(failing.Update() == StatusCode::SysUpdateFail);
+
+		// phases make the wrapper run the systems in order
+		assert(failing.SystemSetPhase("Fail", SystemPhase::PostUpdate) == StatusCode::Success);
+		assert(failing.Update() == StatusCode::SysUpdateFail);
+
+		assert(failing.SystemRegister<Require<Transform>>("Pass",
+			[](EcsInstance& ecs, EntityId* entities, int entityCount, EcsDt dt) -> ReturnCode { return 0; }) == StatusCode::Success);
+		assert(failing.SetThreadCount(2) == StatusCode::Success);
+		assert(failing.Update() == StatusCode::SysUpdateFail);
+	}
+
+	/*
+	* should be silent
+	* conflicting systems keep registration order, others may run concurrently.
+	* queued destroys and removals wait until concurrent systems returned
+	*/
+	Test("Parallel update");
+	Instance(3);
+	{
+		EcsInstance ecs3(100);
+		assert(ecs3.SetThreadCount(4) == StatusCode::Success);
+		assert(ecs3.ComponentRegister<Transform>(TransformConstructor) == StatusCode::Success);
+		assert(ecs3.ComponentRegister<Velocity>(VelocityConstructor) == StatusCode::Success);
+
+		std::atomic<int> sequence{ 0 };
+		int integrateSeq = -1, readTransformSeq = -1, readVelocitySeq = -1, exclusiveSeq = -1;
+
+		assert((ecs3.SystemRegister<Require<Transform, Velocity>, Read<Velocity>, Write<Transform>>("Integrate",
+			[&](View<Transform, Velocity> view, EcsDt dt)
+			{
+				for (auto [tr, vel] : view)
+				{
+					tr.x += vel.x;
+					tr.y += vel.y;
+				}
+				integrateSeq = sequence++;
+			}) == StatusCode::Success));
+
+		assert((ecs3.SystemRegister<Require<Velocity>, Read<Velocity>>("ReadVelocity",
+			[&](View<Velocity> view, EcsDt dt) { readVelocitySeq = sequence++; }) == StatusCode::Success));
+
+		assert((ecs3.SystemRegister<Require<Transform>, Read<Transform>>("ReadTransform",
+			[&](View<Transform> view, EcsDt dt)
+			{
+				for (auto [tr] : view)
+					assert(tr.x == 1.0f && tr.y == 2.0f);
+				readTransformSeq = sequence++;
+			}) == StatusCode::Success));
+
+		// no declared access, runs after everything registered before it
+		assert((ecs3.SystemRegister<Require<Transform>>("Exclusive",
+			[&](EcsInstance&, EntityId*, int, EcsDt) { exclusiveSeq = sequence++; }) == StatusCode::Success));
+
+		for (int i = 0; i < 50; ++i)
+		{
+			EntityId id = ecs3.EntityCreate();
+			Transform tr{ 0.0f, 0.0f };
+			Velocity vel{ 1.0f, 2.0f };
+			ecs3.EntityAddComponent<Transform>(id, &tr);
+			ecs3.EntityAddComponent<Velocity>(id, &vel);
+		}
+
+		assert(ecs3.Update() == StatusCode::Success);
+		assert(sequence == 4);
+		assert(integrateSeq < readTransformSeq);
+		assert(readTransformSeq < exclusiveSeq && readVelocitySeq < exclusiveSeq);
+
+		EcsInstance queued(100);
+		assert(queued.SetThreadCount(4) == StatusCode::Success);
+		assert(queued.ComponentRegister<Transform>(TransformConstructor) == StatusCode::Success);
+		assert(queued.ComponentRegister<Velocity>(VelocityConstructor) == StatusCode::Success);
+
+		// both only read, so they run concurrently and must see all entities
+		assert((queued.SystemRegister<Require<Transform>, Read<Transform>>("DestroyOdd",
+			[](EcsInstance& ecs, EntityId* entities, int entityCount, EcsDt dt)
+			{
+				assert(entityCount == 50);
+				for (int i = 0; i < entityCount; ++i)
+				{
+					if (entities[i] % 2 == 1)
+						ecs.EntityQueueDestroy(entities[i]);
+				}
+			}) == StatusCode::Success));
+		assert((queued.SystemRegister<Require<Velocity>, Read<Velocity>>("StripEven",
+			[](EcsInstance& ecs, EntityId* entities, int entityCount, EcsDt dt)
+			{
+				assert(entityCount == 50);
+				for (int i = 0; i < entityCount; ++i)
+				{
+					if (entities[i] % 2 == 0)
+						ecs.EntityQueueRemoveComponent<Velocity>(entities[i]);
+				}
+			}) == StatusCode::Success));
+
+		for (int i = 0; i < 50; ++i)
+		{
+			EntityId id = queued.EntityCreate();
+			Transform tr{ 0.0f, 0.0f };
+			Velocity vel{ 1.0f, 2.0f };
+			queued.EntityAddComponent<Transform>(id, &tr);
+			queued.EntityAddComponent<Velocity>(id, &vel);
+		}
+
+		assert(queued.Update() == StatusCode::Success);
+		for (EntityId id = 0; id < 50; ++id)
+		{
+			assert(queued.EntityIsReady(id) == (id % 2 == 0));
+			if (id % 2 == 0)
+				assert(queued.EntityHasComponent<Transform>(id) && !queued.EntityHasComponent<Velocity>(id));
+		}
+
+		// disjoint systems run concurrently on every Update, pico_ecs must not be entered from the pool
+		EcsInstance disjoint(100);
+		assert(disjoint.SetThreadCount(4) == StatusCode::Success);
+		assert(disjoint.ComponentRegister<Transform>(TransformConstructor) == StatusCode::Success);
+		assert(disjoint.ComponentRegister<Velocity>(VelocityConstructor) == StatusCode::Success);
+
+		assert((disjoint.SystemRegister<Require<Transform>, Write<Transform>>("MoveX",
+			[](View<Transform> view, EcsDt dt)
+			{
+				for (auto [tr] : view)
+					tr.x += 1.0f;
+			}) == StatusCode::Success));
+		assert((disjoint.SystemRegister<Require<Velocity>, Write<Velocity>>("Accelerate",
+			[](View<Velocity> view, EcsDt dt)
+			{
+				for (auto [vel] : view)
+					vel.y += 1.0f;
+			}) == StatusCode::Success));
+
+		for (int i = 0; i < 50; ++i)
+		{
+			EntityId id = disjoint.EntityCreate();
+			Transform tr{ 0.0f, 0.0f };
+			Velocity vel{ 0.0f, 0.0f };
+			disjoint.EntityAddComponent<Transform>(id, &tr);
+			disjoint.EntityAddComponent<Velocity>(id, &vel);
+		}
+
+		for (int i = 0; i < 200; ++i)
+			assert(disjoint.Update() == StatusCode::Success);
+		for (EntityId id = 0; id < 50; ++id)
+		{
+			assert(disjoint.EntityGetComponent<Transform>(id)->x == 200.0f);
+			assert(disjoint.EntityGetComponent<Velocity>(id)->y == 200.0f);
+		}
+	}
+
+	/*
+	* should be silent
+	* chunked systems must visit every entity exactly once,
+	* deterministic reductions must not depend on the thread count
+	*/
+	Test("Parallel for");
+	Instance(4);
+	{
+		EcsInstance ecs4(1000);
+		assert(ecs4.SetThreadCount(4) == StatusCode::Success);
+		assert(ecs4.ComponentRegister<Transform>(TransformConstructor) == StatusCode::Success);
+		assert(ecs4.ComponentRegister<Velocity>(VelocityConstructor) == StatusCode::Success);
+
+		ParallelOptions options;
+		options.minChunkSize = 100;
+		options.deterministicMerge = true;
+
+		std::atomic<int> chunks{ 0 };
+		assert((ecs4.SystemRegister<Require<Transform, Velocity>>("ChunkedMove",
+			[&](View<Transform, Velocity> view, EcsDt dt)
+			{
+				assert(view.Size() <= 112);
+				for (auto [tr, vel] : view)
+				{
+					tr.x += vel.x;
+					tr.y += 1.0f;
+				}
+				++chunks;
+			}, options) == StatusCode::Success));
+
+		std::vector<EntityId> ids;
+		for (int i = 0; i < 5000; ++i)
+		{
+			EntityId id = ecs4.EntityCreate();
+			Transform tr{ 0.0f, 0.0f };
+			Velocity vel{ 1.0f / static_cast<float>(i + 1), 0.0f };
+			ecs4.EntityAddComponent<Transform>(id, &tr);
+			ecs4.EntityAddComponent<Velocity>(id, &vel);
+			ids.push_back(id);
+		}
+
+		assert(ecs4.Update() == StatusCode::Success);
+		assert(chunks == (5000 + 111) / 112);
+		for (EntityId id : ids)
+			assert(ecs4.EntityGetComponent<Transform>(id)->y == 1.0f);
+
+		auto sumVelocity = [&](EntityId* chunk, int count)
+			{
+				float sum = 0.0f;
+				for (int i = 0; i < count; ++i)
+					sum += ecs4.EntityGetComponent<Velocity>(chunk[i])->x;
+				return sum;
+			};
+		auto add = [](float a, float b) { return a + b; };
+
+		float parallelSum = ecs4.ParallelReduce(ids.data(), static_cast<int>(ids.size()), options, 0.0f, sumVelocity, add);
+		assert(ecs4.SetThreadCount(1) == StatusCode::Success);
+		float serialSum = ecs4.ParallelReduce(ids.data(), static_cast<int>(ids.size()), options, 0.0f, sumVelocity, add);
+		assert(parallelSum == serialSum);
+
+		std::atomic<int> visited{ 0 };
+		ecs4.ParallelFor(ids.data(), static_cast<int>(ids.size()), options, [&](EntityId*, int count) { visited += count; });
+		assert(visited == 5000);
+	}
+
+	/*
+	* should be silent
+	* commands recorded by parallel chunks must be played back
+	* in the same order regardless of the thread count
+	*/
+	Test("Command buffers");
+	Instance(5);
+	{
+		auto run = [](unsigned threads)
+			{
+				EcsInstance ecs5(64);
+				ecs5.SetThreadCount(threads);
+				ecs5.ComponentRegister<Transform>(TransformConstructor);
+				ecs5.ComponentRegister<Velocity>(VelocityConstructor);
+
+				ParallelOptions options;
+				options.minChunkSize = 16;
+				ecs5.SystemRegister<Require<Transform, Velocity>>("Spawner",
+					[](EcsInstance& ecs, EntityId* entities, int entityCount, EcsDt dt)
+					{
+						CommandBuffer& commands = ecs.GetCommandBuffer();
+						for (int i = 0; i < entityCount; ++i)
+						{
+							EntityId id = entities[i];
+							if (id % 3 == 0)
+							{
+								commands.EntityDestroy(id);
+							}
+							else if (id % 3 == 1)
+							{
+								commands.EntityRemoveComponent<Velocity>(id);
+							}
+							else
+							{
+								DeferredEntity spawned = commands.EntityCreate();
+								commands.EntityAddComponent(spawned, Transform{ static_cast<float>(id), -1.0f });
+							}
+						}
+					}, options);
+
+				std::vector<EntityId> ids;
+				for (int i = 0; i < 200; ++i)
+				{
+					EntityId id = ecs5.EntityCreate();
+					Transform tr{ 0.0f, 0.0f };
+					Velocity vel{ 1.0f, 1.0f };
+					ecs5.EntityAddComponent<Transform>(id, &tr);
+					ecs5.EntityAddComponent<Velocity>(id, &vel);
+					ids.push_back(id);
+				}
+
+				assert(ecs5.Update() == StatusCode::Success);
+				assert(ecs5.GetCommandBuffer().IsEmpty());
+
+				std::vector<std::pair<EntityId, float>> spawned;
+				for (EntityId id : ids)
+				{
+					if (id % 3 == 0)
+						assert(!ecs5.EntityIsReady(id) || ecs5.EntityGetComponent<Transform>(id)->y == -1.0f);
+					else if (id % 3 == 1)
+						assert(!ecs5.EntityHasComponent<Velocity>(id));
+				}
+				for (EntityId id = 0; id < 400; ++id)
+				{
+					if (ecs5.EntityIsReady(id) && ecs5.EntityGetComponent<Transform>(id)->y == -1.0f)
+						spawned.emplace_back(id, ecs5.EntityGetComponent<Transform>(id)->x);
+				}
+				return spawned;
+			};
+
+		std::vector<std::pair<EntityId, float>> serial = run(1);
+		std::vector<std::pair<EntityId, float>> parallel = run(4);
+		assert(serial.size() == 66);
+		assert(serial == parallel);
+	}
+
+	/*
+	* should output 2 errors: when the output span is too small
+	* and when the number of values doesn't match the number of entities
+	*/
+	Test("Batch creation");
+	Instance(6);
+	{
+		EcsInstance ecs6(16);
+		ecs6.ComponentRegister<Transform>();
+		ecs6.ComponentRegister<Velocity>(VelocityConstructor);
+		ecs6.SystemRegister<Require<Transform, Velocity>>("Counter", [](View<Transform, Velocity> view, EcsDt dt)
+			{
+				assert(view.Size() == 100);
+			});
+
+		std::vector<EntityId> ids(100);
+		assert(ecs6.EntityCreateBatch(100, ids) == StatusCode::Success);
+		assert(ecs6.EntityCreateBatch(101, ids) == StatusCode::InvalidArg);
+
+		std::vector<Transform> transforms;
+		std::vector<Velocity> velocities;
+		for (int i = 0; i < 100; ++i)
+		{
+			transforms.push_back(Transform{ static_cast<float>(i), 0.0f });
+			velocities.push_back(Velocity{ 0.0f, static_cast<float>(i) });
+		}
+
+		assert(ecs6.EntityAddComponentBatch<Transform>(ids, transforms) == StatusCode::Success);
+		assert(ecs6.EntityAddComponentBatch<Velocity>(ids, velocities) == StatusCode::Success);
+		assert(ecs6.EntityAddComponentBatch<Velocity>(ids, Span<const Velocity>(velocities.data(), 1)) == StatusCode::InvalidArg);
+
+		for (int i = 0; i < 100; ++i)
+		{
+			assert(ecs6.EntityGetComponent<Transform>(ids[i])->x == static_cast<float>(i));
+			assert(ecs6.EntityGetComponent<Velocity>(ids[i])->y == static_cast<float>(i));
+		}
+		assert(ecs6.Update() == StatusCode::Success);
+	}
+
+	/*
+	* should output 1 error when instantiating a prefab with an unregistered component
+	*/
+	Test("Prefabs");
+	Instance(7);
+	{
+		EcsInstance ecs7(16);
+		ecs7.ComponentRegister<Transform>();
+		ecs7.ComponentRegister<Velocity>(VelocityConstructor);
+
+		Prefab projectile;
+		projectile.Set(Transform{ 1.0f, 2.0f }).Set(Velocity{ 3.0f, 4.0f }).Set(Transform{ 5.0f, 6.0f });
+		assert(projectile.Size() == 2);
+
+		std::vector<EntityId> ids(40);
+		assert(ecs7.PrefabInstantiate(projectile, 40, ids) == StatusCode::Success);
+		assert(ecs7.PrefabInstantiate(projectile, 10) == StatusCode::Success);
+		for (EntityId id : ids)
+		{
+			assert(ecs7.EntityGetComponent<Transform>(id)->x == 5.0f);
+			assert(ecs7.EntityGetComponent<Velocity>(id)->y == 4.0f);
+		}
+
+		Prefab invalid;
+		invalid.Set(UnregisteredComp{});
+		assert(ecs7.PrefabInstantiate(invalid, 1) == StatusCode::CompNotReg);
+	}
+
+	/*
+	* should be silent
+	*/
+	Test("Allocators");
+	Instance(9);
+	{
+		std::vector<char> buffer(1 << 16);
+		MonotonicArena arena(buffer.data(), buffer.size(), 1 << 12);
+		{
+			EcsInstance ecs9(1024, &arena);
+			ecs9.ComponentRegister<Transform>(TransformConstructor);
+			ecs9.SystemRegister<Require<Transform>>("Noop", [](EcsInstance& ecs, EntityId* entities, int entityCount, EcsDt dt) {});
+
+			Prefab positioned;
+			positioned.Set(Transform{ 1.0f, 2.0f });
+			assert(ecs9.PrefabInstantiate(positioned, 1000) == StatusCode::Success);
+			assert(ecs9.Update() == StatusCode::Success);
+
+			MemoryStats stats = ecs9.GetMemoryStats();
+			assert(stats.allocationCount > 0);
+			assert(stats.bytesInUse > 1000 * sizeof(Transform));
+			assert(stats.peakBytesInUse >= stats.bytesInUse);
+			assert(arena.GetUsedSize() >= stats.bytesInUse);
+
+			assert(ecs9.Destroy() == StatusCode::Success);
+			assert(ecs9.GetMemoryStats().bytesInUse == 0);
+			assert(ecs9.GetMemoryStats().freeCount == ecs9.GetMemoryStats().allocationCount);
+		}
+		arena.Release();
+		assert(arena.GetUsedSize() == 0);
+
+		// instances without an allocator are counted as well
+		EcsInstance heap(16);
+		heap.ComponentRegister<Transform>(TransformConstructor);
+		heap.EntityAddComponent<Transform>(heap.EntityCreate());
+		assert(heap.GetMemoryStats().allocationCount > 0);
+	}
+
+	/*
+	* should output 1 error when adding a component that can't be default constructed without args
+	*/
+	Test("Component lifetime");
+	Instance(10);
+	{
+		EcsInstance ecs10(64);
+		ecs10.ComponentRegister<Tracked>();
+		ecs10.ComponentRegister<Name>();
+
+		EntityId first = ecs10.EntityCreate();
+		EntityId second = ecs10.EntityCreate();
+		EntityId third = ecs10.EntityCreate();
+
+		Tracked* tracked = ecs10.EntityEmplaceComponent<Tracked>(first, 1, "first");
+		assert(tracked && tracked->value == 1 && tracked->label == "first");
+		assert(Tracked::alive == 1);
+
+		Tracked source(2, std::string(64, 'x'));
+		assert(ecs10.EntityAddComponent<Tracked>(second, &source)->label == source.label);
+		assert(Tracked::alive == 3);
+
+		// replacing destroys the previous value
+		ecs10.EntityEmplaceComponent<Tracked>(second, 3, "replaced");
+		assert(Tracked::alive == 3);
+		assert(ecs10.EntityGetComponent<Tracked>(second)->value == 3);
+
+		assert(!ecs10.EntityAddComponent<Tracked>(third));
+
+		ecs10.EntityEmplaceComponent<Name>(third, Name{ "third" });
+		assert(ecs10.EntityGetComponent<Name>(third)->name == "third");
+
+		ecs10.EntityRemoveComponent<Tracked>(first);
+		assert(Tracked::alive == 2);
+
+		CommandBuffer& commands = ecs10.GetCommandBuffer();
+		commands.EntityAddComponent(first, Tracked(4, "deferred"));
+		ecs10.FlushCommandBuffers();
+		assert(ecs10.EntityGetComponent<Tracked>(first)->label == "deferred");
+		assert(Tracked::alive == 3);
+
+		ecs10.EntityDestroy(second);
+		assert(Tracked::alive == 2);
+
+		ecs10.Reset();
+		assert(Tracked::alive == 1);
+
+		Prefab labelled;
+		labelled.Set(Tracked(5, "prefab"));
+		ecs10.PrefabInstantiate(labelled, 20);
+		assert(Tracked::alive == 22);
+	}
+	assert(Tracked::alive == 0);
+
+	/*
+	* should output 1 error when gathering into a span of the wrong size
+	*/
+	Test("Component columns");
+	Instance(11);
+	{
+		EcsInstance ecs11(64);
+		ecs11.ComponentRegister<Transform>();
+		ecs11.ComponentRegister<Velocity>();
+
+		std::vector<EntityId> ids(37);
+		ecs11.EntityCreateBatch(37, ids);
+		for (EntityId id : ids)
+		{
+			Transform tr{ static_cast<float>(id), 0.0f };
+			Velocity vel{ 1.0f, static_cast<float>(id) };
+			ecs11.EntityAddComponent<Transform>(id, &tr);
+			ecs11.EntityAddComponent<Velocity>(id, &vel);
+		}
+
+		Span<Transform> column = ecs11.ComponentColumn<Transform>(ids);
+		assert(column.Size() == 37);
+		assert(&column[ids[5]] == ecs11.EntityGetComponent<Transform>(ids[5]));
+
+		std::vector<Transform> transforms(ids.size());
+		std::vector<Velocity> velocities(ids.size());
+		assert(ecs11.ComponentGather<Transform>(ids, transforms) == StatusCode::Success);
+		assert(ecs11.ComponentGather<Velocity>(ids, velocities) == StatusCode::Success);
+		assert(ecs11.ComponentGather<Velocity>(ids, Span<Velocity>(velocities.data(), 2)) == StatusCode::InvalidArg);
+
+		simd::AddScaled(Span<Transform>(transforms), Span<const Velocity>(velocities), 0.5f);
+		assert(ecs11.ComponentScatter<Transform>(ids, transforms) == StatusCode::Success);
+		for (EntityId id : ids)
+		{
+			Transform* tr = ecs11.EntityGetComponent<Transform>(id);
+			assert(tr->x == static_cast<float>(id) + 0.5f);
+			assert(tr->y == static_cast<float>(id) * 0.5f);
+		}
+
+		// odd counts exercise the scalar tail
+		std::vector<float> dst(19, 1.0f), reference(19, 1.0f), src(19);
+		for (std::size_t i = 0; i < src.size(); ++i)
+			src[i] = static_cast<float>(i);
+		simd::AddScaled(dst.data(), src.data(), 2.0f, dst.size());
+		simd::AddScaledScalar(reference.data(), src.data(), 2.0f, reference.size());
+		assert(dst == reference);
+	}
+
+	/*
+	* should output 4 errors: setting up Name without serializers, loading a missing file,
+	* a file that isn't a snapshot, and a snapshot with a component the instance doesn't know
+	*/
+	Test("Snapshots");
+	Instance(12);
+	{
+		auto setup = [](EcsInstance& ecs)
+			{
+				ecs.ComponentRegister<Transform>();
+				ecs.ComponentRegister<Velocity>();
+				ecs.ComponentRegister<Name>();
+				ecs.ComponentRegister<Health>(HealthConstructor);
+				ecs.ComponentSetSerialization<Transform>("Transform");
+				ecs.ComponentSetSerialization<Health>("Health");
+				ecs.ComponentSetSerialization<Name>("Name",
+					[](const Name& name, std::string& out) { out = name.name; },
+					[](std::string_view data) { return std::optional<Name>(Name{ std::string(data) }); });
+			};
+
+		// sized so storage of Name never grows, see ComponentRegister
+		EcsInstance source(128);
+		setup(source);
+		assert(source.ComponentSetSerialization<Name>("Name") == StatusCode::InvalidArg);
+
+		std::vector<EntityId> ids(100);
+		source.EntityCreateBatch(100, ids);
+		for (EntityId id : ids)
+		{
+			Transform tr{ static_cast<float>(id), -static_cast<float>(id) };
+			source.EntityAddComponent<Transform>(id, &tr);
+			source.EntityAddComponent<Velocity>(id);
+			if (id % 3 == 0)
+				source.EntityEmplaceComponent<Name>(id, Name{ "entity " + std::to_string(id) });
+
+			// loading must restore the value without calling the constructor, which needs a spawn
+			HealthSpawn spawn{ 100 };
+			if (id % 2 == 0)
+				source.EntityAddComponent<Health>(id, &spawn)->current = static_cast<int>(id);
+		}
+		for (EntityId id : ids)
+		{
+			if (id % 7 == 0)
+				source.EntityDestroy(id);
+		}
+		assert(source.SaveSnapshot("pico_ecs_cpp_snapshot.bin") == StatusCode::Success);
+
+		EcsInstance restored(128);
+		setup(restored);
+		int matched = 0;
+		restored.SystemRegister<Require<Transform, Name>>("CountNamed",
+			[&matched](EcsInstance& ecs, EntityId* entities, int entityCount, EcsDt dt) { matched = entityCount; });
+		restored.EntityCreate();
+
+		assert(restored.LoadSnapshot("pico_ecs_cpp_snapshot.bin") == StatusCode::Success);
+		for (EntityId id : ids)
+		{
+			assert(restored.EntityIsReady(id) == (id % 7 != 0));
+			if (id % 7 == 0)
+				continue;
+
+			assert(restored.EntityGetComponent<Transform>(id)->y == -static_cast<float>(id));
+			assert(!restored.EntityHasComponent<Velocity>(id));
+			assert(restored.EntityHasComponent<Name>(id) == (id % 3 == 0));
+			if (id % 3 == 0)
+				assert(restored.EntityGetComponent<Name>(id)->name == "entity " + std::to_string(id));
+			assert(restored.EntityHasComponent<Health>(id) == (id % 2 == 0));
+			if (id % 2 == 0)
+				assert(restored.EntityGetComponent<Health>(id)->current == static_cast<int>(id) && restored.EntityGetComponent<Health>(id)->max == 100);
+		}
+		restored.Update();
+		assert(matched == 29);
+
+		assert(restored.LoadSnapshot("missing_snapshot.bin") == StatusCode::FileFail);
+		{
+			std::ofstream garbage("pico_ecs_cpp_garbage.bin", std::ios::binary);
+			garbage << "definitely not a snapshot, but long enough to hold a header";
+		}
+		assert(restored.LoadSnapshot("pico_ecs_cpp_garbage.bin") == StatusCode::SnapshotInvalid);
+		assert(restored.EntityIsReady(ids[1]));
+
+		EcsInstance unnamed(16);
+		unnamed.ComponentRegister<Transform>();
+		assert(unnamed.LoadSnapshot("pico_ecs_cpp_snapshot.bin") == StatusCode::CompNotReg);
+
+		std::remove("pico_ecs_cpp_snapshot.bin");
+		std::remove("pico_ecs_cpp_garbage.bin");
+	}
+
+	/*
+	* should output 1 error when cloning into an instance with a different layout
+	*/
+	Test("Cloning");
+	Instance(13);
+	{
+		EcsInstance world(128);
+		world.ComponentRegister<Transform>();
+		world.ComponentRegister<Velocity>(VelocityConstructor);
+		world.ComponentRegister<Name>();
+		world.ComponentRegister<Label>(LabelConstructor, LabelDestructor);
+
+		std::vector<EntityId> ids(50);
+		world.EntityCreateBatch(50, ids);
+		for (EntityId id : ids)
+		{
+			Transform tr{ static_cast<float>(id), 0.0f };
+			world.EntityAddComponent<Transform>(id, &tr);
+			if (id % 2 == 0)
+				world.EntityEmplaceComponent<Name>(id, Name{ "even " + std::to_string(id) });
+			if (id % 3 == 0)
+				world.EntityAddComponent<Label>(id, const_cast<char*>("label"));
+		}
+		world.EntityDestroy(ids[7]);
+
+		// registrations are copied into an empty instance
+		EcsInstance fork(128);
+		assert(world.CloneInto(fork) == StatusCode::Success);
+		assert(!fork.EntityIsReady(ids[7]));
+		assert(fork.EntityGetComponent<Transform>(ids[9])->x == 9.0f);
+		assert(fork.EntityGetComponent<Name>(ids[10])->name == "even 10");
+		assert(!fork.EntityHasComponent<Name>(ids[11]));
+		assert(fork.EntityGetComponent<Label>(ids[9])->text == "label");
+		assert(!fork.EntityHasComponent<Label>(ids[10]));
+
+		// the fork is independent, and cloning again only applies the differences
+		fork.EntityGetComponent<Name>(ids[10])->name = "changed";
+		fork.EntityGetComponent<Label>(ids[12])->text = "changed";
+		world.EntityGetComponent<Transform>(ids[9])->x = -1.0f;
+		world.EntityRemoveComponent<Name>(ids[12]);
+		Velocity vel{ 1.0f, 2.0f };
+		world.EntityAddComponent<Velocity>(ids[13], &vel);
+		world.EntityCreate();
+
+		// pico_ecs destroys queued entities once a system ran
+		world.SystemRegister<Require<Transform>>("Flush", [](EcsInstance& ecs, EntityId* entities, int entityCount, EcsDt dt) {});
+		world.EntityQueueDestroy(ids[15]);
+		world.Update();
+
+		int moving = 0;
+		fork.SystemRegister<Require<Velocity>>("CountMoving",
+			[&moving](EcsInstance& ecs, EntityId* entities, int entityCount, EcsDt dt) { moving = entityCount; });
+
+		assert(world.CloneInto(fork) == StatusCode::Success);
+		assert(fork.EntityGetComponent<Transform>(ids[9])->x == -1.0f);
+		assert(fork.EntityGetComponent<Name>(ids[10])->name == "even 10");
+		assert(!fork.EntityHasComponent<Name>(ids[12]));
+		assert(fork.EntityGetComponent<Velocity>(ids[13])->y == 2.0f);
+		assert(fork.EntityGetComponent<Label>(ids[12])->text == "label");
+		assert(!world.EntityIsReady(ids[15]) && !fork.EntityIsReady(ids[15]));
+		assert(fork.EntityIsReady(ids[7]) == world.EntityIsReady(ids[7]));
+		fork.Update();
+		assert(moving == 1);
+
+		EcsInstance other(16);
+		other.ComponentRegister<Name>();
+		assert(world.CloneInto(other) == StatusCode::InvalidArg);
+
+		// rollback through a frame history
+		FrameHistory history(4, 128);
+		for (int frame = 0; frame < 6; ++frame)
+		{
+			world.EntityGetComponent<Transform>(ids[0])->y = static_cast<float>(frame);
+			assert(history.Push(world) == StatusCode::Success);
+		}
+		assert(history.Size() == 4);
+		assert(history.Get(0)->GetInstance() && !history.Get(4));
+
+		assert(history.Restore(2, world) == StatusCode::Success);
+		assert(world.EntityGetComponent<Transform>(ids[0])->y == 3.0f);
+		history.Pop(2);
+		assert(history.Size() == 2);
+		assert(history.Push(world) == StatusCode::Success);
+		assert(history.Size() == 3);
+		assert(history.Restore(1, world) == StatusCode::Success);
+		assert(world.EntityGetComponent<Transform>(ids[0])->y == 3.0f);
+		assert(world.EntityGetComponent<Name>(ids[10])->name == "even 10");
+	}
+
+	/*
+	* should be silent
+	*/
+	Test("Change detection");
+	Instance(14);
+	{
+		EcsInstance world(64);
+		world.ComponentRegister<Transform>();
+		world.ComponentRegister<Velocity>(VelocityConstructor);
+
+		std::vector<EntityId> seen;
+		world.SystemRegister<Changed<Transform>>("Replicate",
+			[&seen](EcsInstance& ecs, EntityId* entities, int entityCount, EcsDt dt) { seen.assign(entities, entities + entityCount); });
+
+		// views only mark components they don't view as const
+		int moved = 0;
+		world.SystemRegister<Require<Transform, const Velocity>, Changed<Velocity>>("Move",
+			[&moved](View<Transform, const Velocity> view, EcsDt dt)
+			{
+				for (auto [tr, vel] : view)
+				{
+					tr.x += vel.x;
+					++moved;
+				}
+			});
+
+		std::vector<EntityId> ids(10);
+		world.EntityCreateBatch(10, ids);
+		for (EntityId id : ids)
+		{
+			Transform tr{ 0.0f, 0.0f };
+			world.EntityAddComponent<Transform>(id, &tr);
+			Velocity vel{ 1.0f, 0.0f };
+			world.EntityAddComponent<Velocity>(id, &vel);
+		}
+
+		// added components count as changed, writes of a system are seen by the others on their next run
+		world.Update();
+		assert(seen.size() == 10 && moved == 10);
+		world.Update();
+		assert(seen.size() == 10 && moved == 10);
+		world.Update();
+		assert(seen.empty());
+
+		// reads don't mark components, writes do
+		assert(world.EntityReadComponent<Transform>(ids[1])->x == 1.0f);
+		world.EntityGetComponent<Transform>(ids[3])->x = 5.0f;
+		world.Update();
+		assert(seen.size() == 1 && seen[0] == ids[3] && moved == 10);
+
+		world.EntityMarkChanged<Velocity>(ids[5]);
+		world.Update();
+		assert(seen.empty() && moved == 11);
+		world.Update();
+		assert(seen.size() == 1 && seen[0] == ids[5]);
+		assert(world.EntityReadComponent<Transform>(ids[5])->x == 2.0f);
+
+		EntityId spawned = world.EntityCreate();
+		world.EntityEmplaceComponent<Transform>(spawned, 2.0f, 0.0f);
+		world.Update();
+		assert(seen.size() == 1 && seen[0] == spawned);
+
+		// ids created past the previous ones count as changed too
+		std::vector<EntityId> batch(20);
+		world.EntityCreateBatch(20, batch);
+		std::vector<Transform> values(20, Transform{ 1.0f, 1.0f });
+		world.EntityAddComponentBatch<Transform>(batch, values);
+		world.Update();
+		assert(seen.size() == 20);
+	}
+
+	/*
+	* should be silent
+	*/
+	Test("Observers");
+	Instance(15);
+	{
+		EcsInstance world(64);
+		world.ComponentRegister<Transform>();
+		world.ComponentRegister<Velocity>(VelocityConstructor);
+
+		int moved = 0;
+		world.SystemRegister<Require<Transform>, Write<Transform>>("Move",
+			[&moved](View<Transform> view, EcsDt dt) { moved += view.Size(); });
+
+		std::string order;
+		std::vector<EntityId> added, removed;
+		world.ObserverRegister<OnAdd<Transform>>([&](EcsInstance& ecs, Span<const EntityId> entities)
+			{
+				added.assign(entities.begin(), entities.end());
+				order += 'a';
+			});
+		world.ObserverRegister<OnRemove<Transform>>([&](EcsInstance& ecs, Span<const EntityId> entities)
+			{
+				removed.assign(entities.begin(), entities.end());
+				order += 'r';
+			});
+
+		// events raised by observers are delivered in the same flush
+		world.ObserverRegister<OnAdd<Velocity>>([](EcsInstance& ecs, Span<const EntityId> entities)
+			{
+				for (EntityId id : entities)
+					ecs.EntityEmplaceComponent<Transform>(id, 0.0f, 0.0f);
+			});
+
+		world.SystemRegister<Require<Velocity>, Read<Velocity>>("Count",
+			[](View<Velocity> view, EcsDt dt) {});
+
+		std::vector<EntityId> ids(5);
+		world.EntityCreateBatch(5, ids);
+		for (EntityId id : ids)
+			world.EntityEmplaceComponent<Transform>(id, 1.0f, 1.0f);
+		assert(order.empty());
+
+		world.Update();
+		assert(order == "a" && added.size() == 5 && moved == 5);
+		world.Update();
+		assert(order == "a");
+
+		// additions removed before the flush are dropped, removals come first
+		world.EntityRemoveComponent<Transform>(ids[0]);
+		world.EntityDestroy(ids[1]);
+		world.EntityRemoveComponent<Transform>(ids[2]);
+		world.EntityEmplaceComponent<Transform>(ids[2], 2.0f, 2.0f);
+		world.EntityEmplaceComponent<Transform>(ids[3], 3.0f, 3.0f);
+		EntityId temporary = world.EntityCreate();
+		world.EntityEmplaceComponent<Transform>(temporary, 0.0f, 0.0f);
+		world.EntityDestroy(temporary);
+		world.ObserverFlush();
+		assert(order == "ara");
+		assert(removed.size() == 3 && removed[0] == ids[0] && removed[1] == ids[1] && removed[2] == ids[2]);
+		assert(added.size() == 1 && added[0] == ids[2]);
+
+		// command buffers are played back before events are delivered
+		world.SetThreadCount(2);
+		EntityId spawned = world.EntityCreate();
+		world.GetCommandBuffer().EntityAddComponent(spawned, Velocity{ 1.0f, 1.0f });
+		world.Update();
+		assert(order == "araa" && added.size() == 1 && added[0] == spawned);
+		assert(world.EntityHasComponent<Transform>(spawned));
+
+		// queued removals and destructions are reported as well
+		world.EntityQueueRemoveComponent<Transform>(ids[3]);
+		world.EntityQueueDestroy(ids[4]);
+		world.Update();
+		assert(order == "araar" && removed.size() == 2 && removed[0] == ids[3] && removed[1] == ids[4]);
+	}
+	{
+		// observers take no pico_ecs system, all of them are left to systems
+		EcsInstance world(16);
+		world.ComponentRegister<Transform>();
+		world.ComponentRegister<Velocity>(VelocityConstructor);
+		int events = 0;
+		world.ObserverRegister<OnAdd<Transform>>([&events](EcsInstance& ecs, Span<const EntityId> entities) { events += entities.Size(); });
+		world.ObserverRegister<OnRemove<Velocity>>([&events](EcsInstance& ecs, Span<const EntityId> entities) { events += entities.Size(); });
+		for (int i = 0; i < 16; ++i)
+		{
+			assert(world.SystemRegister<Require<Transform>>("Filler" + std::to_string(i),
+				[](EcsInstance& ecs, EntityId* entities, int entityCount, EcsDt dt) {}) == StatusCode::Success);
+		}
+
+		EntityId id = world.EntityCreate();
+		world.EntityEmplaceComponent<Transform>(id, 0.0f, 0.0f);
+		Velocity vel{ 1.0f, 1.0f };
+		world.EntityAddComponent<Velocity>(id, &vel);
+		world.Update();
+		world.EntityRemoveComponent<Velocity>(id);
+		world.Update();
+		assert(events == 2);
+	}
+	{
+		// observers registered by a running observer must not move it, they get the next events
+		EcsInstance world(16);
+		world.ComponentRegister<Transform>();
+		int events = 0;
+		int* counter = &events;
+		world.ObserverRegister<OnAdd<Transform>>([counter](EcsInstance& ecs, Span<const EntityId> entities)
+			{
+				for (int i = 0; i < 4; ++i)
+				{
+					ecs.ObserverRegister<OnAdd<Transform>>([counter](EcsInstance& ecs, Span<const EntityId> entities)
+						{
+							*counter += 10;
+						});
+				}
+				*counter += 1;
+			});
+
+		world.EntityEmplaceComponent<Transform>(world.EntityCreate(), 0.0f, 0.0f);
+		world.ObserverFlush();
+		assert(events == 1);
+		world.EntityEmplaceComponent<Transform>(world.EntityCreate(), 0.0f, 0.0f);
+		world.ObserverFlush();
+		assert(events == 42);
+	}
+
+	/*
+	* should output 2 errors when getting a missing tag and viewing a tag
+	*/
+	Test("Tags");
+	Instance(16);
+	{
+		EcsInstance world(64);
+		world.ComponentRegister<Transform>();
+
+		// no storage is allocated for tags
+		const std::size_t bytesInUse = world.GetMemoryStats().bytesInUse;
+		assert(world.ComponentRegister<Frozen>() == StatusCode::Success);
+		assert(world.ComponentRegister<Visible>() == StatusCode::Success);
+		assert(world.GetMemoryStats().bytesInUse == bytesInUse);
+
+		std::vector<EntityId> moved;
+		world.SystemRegister<Require<Transform, Visible>, Exclude<Frozen>>("Move",
+			[&moved](View<Transform> view, EcsDt dt)
+			{
+				moved.clear();
+				for (auto it = view.begin(); it != view.end(); ++it)
+					moved.push_back(it.GetEntity());
+			});
+
+		// systems requiring only tags get every entity that has them
+		int frozen = 0;
+		world.SystemRegister<Require<Frozen>>("Thaw",
+			[&frozen](EcsInstance& ecs, EntityId* entities, int entityCount, EcsDt dt)
+			{
+				frozen = entityCount;
+				for (int i = 0; i < entityCount; ++i)
+					ecs.EntityQueueRemoveComponent<Frozen>(entities[i]);
+			});
+
+		int frozenAdded = 0;
+		world.ObserverRegister<OnAdd<Frozen>>([&frozenAdded](EcsInstance& ecs, Span<const EntityId> entities)
+			{
+				frozenAdded += static_cast<int>(entities.Size());
+			});
+
+		std::vector<EntityId> ids(6);
+		world.EntityCreateBatch(6, ids);
+		for (EntityId id : ids)
+		{
+			Transform tr{ 0.0f, 0.0f };
+			world.EntityAddComponent<Transform>(id, &tr);
+			if (id % 2 == 0)
+				world.EntityAddComponent<Visible>(id);
+		}
+		world.EntityAddComponent<Frozen>(ids[0]);
+		EntityId marker = world.EntityCreate();
+		world.EntityAddComponent<Frozen>(marker);
+
+		assert(world.EntityHasComponent<Frozen>(marker) && !world.EntityHasComponent<Visible>(marker));
+		assert(world.EntityGetComponent<Visible>(ids[2]) != nullptr);
+		assert(world.EntityGetComponent<Visible>(ids[1]) == nullptr);
+		world.ObserverFlush();
+		assert(frozenAdded == 2);
+
+		world.Update();
+		assert(moved.size() == 2 && moved[0] == ids[2] && moved[1] == ids[4]);
+		assert(frozen == 2);
+		assert(!world.EntityHasComponent<Frozen>(ids[0]) && !world.EntityHasComponent<Frozen>(marker));
+
+		world.Update();
+		assert(moved.size() == 3 && frozen == 0);
+
+		// reused ids don't inherit tags
+		world.EntityDestroy(ids[2]);
+		EntityId reused = world.EntityCreate();
+		assert(reused == ids[2] && !world.EntityHasComponent<Visible>(reused));
+
+		Prefab frozenPrefab;
+		frozenPrefab.Set(Transform{ 1.0f, 1.0f }).Set(Frozen{});
+		std::vector<EntityId> spawned(3);
+		assert(world.PrefabInstantiate(frozenPrefab, 3, spawned) == StatusCode::Success);
+		assert(world.EntityHasComponent<Frozen>(spawned[2]));
+
+		// tags are copied by clones and saved as presence
+		EcsInstance fork(64);
+		assert(world.CloneInto(fork) == StatusCode::Success);
+		assert(fork.EntityHasComponent<Frozen>(spawned[1]) && fork.EntityHasComponent<Visible>(ids[4]));
+		assert(!fork.EntityHasComponent<Visible>(reused));
+
+		world.ComponentSetSerialization<Transform>("Transform");
+		world.ComponentSetSerialization<Visible>("Visible");
+		assert(world.SaveSnapshot("pico_ecs_cpp_tags.bin") == StatusCode::Success);
+		world.EntityRemoveComponent<Visible>(ids[4]);
+		assert(world.LoadSnapshot("pico_ecs_cpp_tags.bin") == StatusCode::Success);
+		assert(world.EntityHasComponent<Visible>(ids[4]) && !world.EntityHasComponent<Visible>(ids[1]));
+		std::remove("pico_ecs_cpp_tags.bin");
+
+		assert(View<Visible>(world, ids.data(), 1).Size() == 0);
+	}
+
+	/*
+	* should output 3 errors when getting the column and tracking changes of a sparse component
+	* and registering an over-aligned sparse component
+	*/
+	Test("Sparse storage");
+	Instance(17);
+	{
+		EcsInstance world(100000);
+		world.ComponentRegister<Transform>();
+
+		// sparse components take no memory until entities get them
+		const std::size_t bytesInUse = world.GetMemoryStats().bytesInUse;
+		assert(world.ComponentRegister<Name>(ComponentStorage::Sparse) == StatusCode::Success);
+		assert(world.ComponentRegister<Lanes>(ComponentStorage::Sparse) == StatusCode::InvalidArg);
+		assert(world.ComponentRegister<Velocity>(ComponentStorage::Sparse) == StatusCode::Success);
+		assert(world.ComponentRegister<Tracked>(ComponentStorage::Sparse) == StatusCode::Success);
+		assert(world.GetMemoryStats().bytesInUse == bytesInUse);
+
+		std::vector<std::string> named;
+		world.SystemRegister<Require<const Transform, const Name>>("Named",
+			[&named](View<const Transform, const Name> view, EcsDt dt)
+			{
+				named.clear();
+				for (auto [tr, name] : view)
+					named.push_back(name.name);
+			});
+
+		int moving = 0;
+		world.SystemRegister<Require<Velocity>>("Stop",
+			[&moving](EcsInstance& ecs, EntityId* entities, int entityCount, EcsDt dt)
+			{
+				moving = entityCount;
+				for (int i = 0; i < entityCount; ++i)
+					ecs.EntityQueueRemoveComponent<Velocity>(entities[i]);
+			});
+
+		std::vector<EntityId> ids(90000);
+		world.EntityCreateBatch(90000, ids);
+		std::vector<Transform> transforms(ids.size(), Transform{ 0.0f, 0.0f });
+		world.EntityAddComponentBatch<Transform>(ids, transforms);
+
+		// short names live inside the string, so they break if moved bitwise
+		const std::size_t denseBytes = world.GetMemoryStats().bytesInUse;
+		world.EntityEmplaceComponent<Name>(ids[10], "a");
+		world.EntityEmplaceComponent<Name>(ids[50000], "b");
+		world.EntityEmplaceComponent<Name>(ids[89999], "c");
+		Velocity velocity{ 1.0f, 2.0f };
+		world.EntityAddComponent<Velocity>(ids[7], &velocity);
+		world.EntityAddComponent<Velocity>(ids[60000], &velocity);
+
+		const std::size_t sparseBytes = world.GetMemoryStats().bytesInUse - denseBytes;
+		assert(sparseBytes < ids.size() * sizeof(Name) / 10);
+
+		assert(world.EntityHasComponent<Name>(ids[50000]) && !world.EntityHasComponent<Name>(ids[11]));
+		assert(world.EntityGetComponent<Velocity>(ids[60000])->y == 2.0f);
+		assert(world.EntityReadComponent<Name>(ids[89999])->name == "c");
+
+		// the last name is moved into the slot of the removed one
+		world.EntityRemoveComponent<Name>(ids[10]);
+		assert(!world.EntityHasComponent<Name>(ids[10]));
+		assert(world.EntityGetComponent<Name>(ids[89999])->name == "c");
+
+		world.Update();
+		assert(named.size() == 2 && named[0] == "b" && named[1] == "c");
+		assert(moving == 2);
+		assert(!world.EntityHasComponent<Velocity>(ids[7]));
+		world.Update();
+		assert(moving == 0);
+
+		// sparse components are destroyed with their entities, and when the instance is reset
+		world.EntityEmplaceComponent<Tracked>(ids[3], 1, "first");
+		world.EntityEmplaceComponent<Tracked>(ids[4], 2, "second");
+		world.EntityEmplaceComponent<Tracked>(ids[5], 3, "third");
+		assert(Tracked::alive == 3);
+		world.EntityDestroy(ids[3]);
+		assert(Tracked::alive == 2 && world.EntityGetComponent<Tracked>(ids[5])->label == "third");
+		EntityId reused = world.EntityCreate();
+		assert(reused == ids[3] && !world.EntityHasComponent<Tracked>(reused));
+
+		// clones and snapshots keep sparse components
+		world.EntityAddComponent<Velocity>(ids[8], &velocity);
+		EcsInstance fork(16);
+		assert(world.CloneInto(fork) == StatusCode::Success);
+		assert(fork.EntityGetComponent<Name>(ids[50000])->name == "b");
+		assert(fork.EntityGetComponent<Velocity>(ids[8])->x == 1.0f && Tracked::alive == 4);
+
+		world.ComponentSetSerialization<Velocity>("Velocity");
+		assert(world.SaveSnapshot("pico_ecs_cpp_sparse.bin") == StatusCode::Success);
+		world.EntityRemoveComponent<Velocity>(ids[8]);
+		assert(world.LoadSnapshot("pico_ecs_cpp_sparse.bin") == StatusCode::Success);
+		assert(world.EntityGetComponent<Velocity>(ids[8])->y == 2.0f && !world.EntityHasComponent<Velocity>(ids[7]));
+		assert(!world.EntityHasComponent<Name>(ids[50000]));
+		std::remove("pico_ecs_cpp_sparse.bin");
+
+		assert(fork.Reset() == StatusCode::Success);
+		assert(Tracked::alive == 0);
+
+		assert(world.ComponentColumn<Velocity>(Span<const EntityId>(&ids[8], 1)).IsEmpty());
+		assert(world.SystemChanged<Velocity>("Stop") == StatusCode::InvalidArg);
+	}
+
+	/*
+	* should output 3 errors when getting the column and tracking changes of a chunked component
+	* and registering an over-aligned chunked component
+	*/
+	Test("Archetype storage");
+	Instance(18);
+	{
+		EcsInstance world(10000, nullptr, StorageBackend::Archetypes);
+		assert(world.ComponentRegister<Transform>() == StatusCode::Success);
+		assert(world.ComponentRegister<Velocity>() == StatusCode::Success);
+		assert(world.ComponentRegister<Name>() == StatusCode::Success);
+		assert(world.ComponentRegister<Tracked>() == StatusCode::Success);
+		assert(world.ComponentRegister<Lanes>() == StatusCode::InvalidArg);
+
+		world.SystemRegister<Require<Transform, const Velocity>>("Move",
+			[](View<Transform, const Velocity> view, EcsDt dt)
+			{
+				for (auto [tr, vel] : view)
+				{
+					tr.x += vel.x;
+					tr.y += vel.y;
+				}
+			});
+
+		int still = 0;
+		world.SystemRegister<Require<const Transform>, Exclude<Velocity>>("Still",
+			[&still](EcsInstance& ecs, EntityId* entities, int entityCount, EcsDt dt)
+			{
+				still = entityCount;
+			});
+
+		// enough entities to fill several chunks of each archetype
+		std::vector<EntityId> ids(3000);
+		world.EntityCreateBatch(3000, ids);
+		std::vector<Transform> transforms(ids.size(), Transform{ 0.0f, 0.0f });
+		world.EntityAddComponentBatch<Transform>(ids, transforms);
+		for (std::size_t i = 0; i < ids.size(); i += 2)
+		{
+			Velocity velocity{ static_cast<float>(i), 1.0f };
+			world.EntityAddComponent<Velocity>(ids[i], &velocity);
+		}
+
+		world.Update();
+		assert(still == 1500);
+		assert(world.EntityGetComponent<Transform>(ids[10])->x == 10.0f && world.EntityGetComponent<Transform>(ids[11])->x == 0.0f);
+
+		// the last entity of an archetype fills the rows left by others
+		for (std::size_t i = 0; i < 1000; i += 2)
+			world.EntityRemoveComponent<Velocity>(ids[i]);
+		world.Update();
+		assert(still == 2000);
+		assert(world.EntityGetComponent<Transform>(ids[0])->x == 0.0f && world.EntityGetComponent<Transform>(ids[2998])->x == 2.0f * 2998.0f);
+		assert(world.EntityGetComponent<Transform>(ids[998])->y == 1.0f && !world.EntityHasComponent<Velocity>(ids[998]));
+
+		// short names live inside the string, so they break if moved bitwise
+		world.EntityEmplaceComponent<Name>(ids[5], "a");
+		world.EntityEmplaceComponent<Tracked>(ids[5], 1, "first");
+		world.EntityEmplaceComponent<Tracked>(ids[6], 2, "second");
+		world.EntityRemoveComponent<Transform>(ids[5]);
+		assert(world.EntityGetComponent<Name>(ids[5])->name == "a" && world.EntityGetComponent<Tracked>(ids[5])->label == "first");
+		assert(Tracked::alive == 2);
+		world.EntityDestroy(ids[6]);
+		assert(Tracked::alive == 1);
+		EntityId reused = world.EntityCreate();
+		assert(reused == ids[6] && !world.EntityHasComponent<Transform>(reused));
+
+		// queued removals wait for the running system to return
+		world.SystemRegister<Require<const Name>>("Unname",
+			[](EcsInstance& ecs, EntityId* entities, int entityCount, EcsDt dt)
+			{
+				for (int i = 0; i < entityCount; ++i)
+					ecs.EntityQueueRemoveComponent<Name>(entities[i]);
+			});
+		world.Update();
+		assert(!world.EntityHasComponent<Name>(ids[5]) && world.EntityGetComponent<Tracked>(ids[5])->value == 1);
+
+		// clones and snapshots keep chunked components
+		EcsInstance fork(16);
+		assert(world.CloneInto(fork) == StatusCode::Success);
+		assert(fork.EntityGetComponent<Velocity>(ids[1000])->x == 1000.0f && Tracked::alive == 2);
+
+		world.ComponentSetSerialization<Velocity>("Velocity");
+		world.ComponentSetSerialization<Transform>("Transform");
+		assert(world.SaveSnapshot("pico_ecs_cpp_archetypes.bin") == StatusCode::Success);
+		world.EntityRemoveComponent<Velocity>(ids[1000]);
+		assert(world.LoadSnapshot("pico_ecs_cpp_archetypes.bin") == StatusCode::Success);
+		assert(world.EntityGetComponent<Velocity>(ids[1000])->x == 1000.0f && world.EntityGetComponent<Transform>(ids[1000])->y == 3.0f);
+		assert(!world.EntityHasComponent<Velocity>(ids[0]) && Tracked::alive == 1);
+		std::remove("pico_ecs_cpp_archetypes.bin");
+
+		assert(fork.Reset() == StatusCode::Success);
+		assert(Tracked::alive == 0);
+
+		assert(world.ComponentColumn<Velocity>(Span<const EntityId>(&ids[1000], 1)).IsEmpty());
+		assert(world.SystemChanged<Velocity>("Move") == StatusCode::InvalidArg);
+	}
+
+	/*
+	* should output 1 error when sorting an unregistered system
+	*/
+	Test("Compaction");
+	Instance(19);
+	{
+		EcsInstance world(256);
+		world.ComponentRegister<Transform>();
+		world.ComponentRegister<Name>();
+		world.ComponentRegister<Frozen>();
+		world.ComponentRegister<Tracked>(ComponentStorage::Sparse);
+		world.ComponentRegister<Health>(HealthConstructor);
+		world.ComponentRegister<Label>(LabelConstructor, LabelDestructor);
+
+		std::vector<float> order;
+		world.SystemRegister<Require<const Transform>>("Order",
+			[&order](View<const Transform> view, EcsDt dt)
+			{
+				order.clear();
+				for (auto [tr] : view)
+					order.push_back(tr.x);
+			});
+
+		int transformEvents = 0;
+		world.ObserverRegister<OnAdd<Transform>>([&transformEvents](EcsInstance& ecs, Span<const EntityId> entities)
+			{
+				transformEvents += static_cast<int>(entities.Size());
+			});
+		world.ObserverRegister<OnRemove<Transform>>([&transformEvents](EcsInstance& ecs, Span<const EntityId> entities)
+			{
+				transformEvents += static_cast<int>(entities.Size());
+			});
+
+		// every other entity is destroyed, leaving holes all over the ids
+		std::vector<EntityId> ids(100);
+		world.EntityCreateBatch(100, ids);
+		for (EntityId id : ids)
+		{
+			Transform tr{ static_cast<float>(id), 0.0f };
+			world.EntityAddComponent<Transform>(id, &tr);
+		}
+		world.EntityEmplaceComponent<Name>(ids[99], "last");
+		world.EntityAddComponent<Frozen>(ids[97]);
+		world.EntityEmplaceComponent<Tracked>(ids[95], 5, "sparse");
+
+		// constructors take other args than the component, so they are moved without them
+		HealthSpawn spawn{ 30 };
+		world.EntityAddComponent<Health>(ids[93], &spawn);
+		world.EntityAddComponent<Label>(ids[91], const_cast<char*>("moved"));
+		for (std::size_t i = 0; i < ids.size(); i += 2)
+			world.EntityDestroy(ids[i]);
+		world.ObserverFlush();
+		transformEvents = 0;
+
+		std::vector<EntityId> translation;
+		assert(world.Compact(translation) == StatusCode::Success);
+		assert(translation.size() == 100 && translation[ids[0]] == EcsInstance::invalidEntity);
+		assert(translation[ids[1]] == 0 && translation[ids[99]] == 49);
+		assert(world.EntityIsReady(49) && !world.EntityIsReady(50));
+
+		// components, tags and sparse components follow their entities, without raising events
+		assert(world.EntityGetComponent<Transform>(49)->x == 99.0f && world.EntityGetComponent<Name>(49)->name == "last");
+		assert(world.EntityHasComponent<Frozen>(translation[ids[97]]) && !world.EntityHasComponent<Frozen>(ids[97]));
+		assert(world.EntityGetComponent<Tracked>(translation[ids[95]])->label == "sparse" && Tracked::alive == 1);
+		assert(world.EntityGetComponent<Health>(translation[ids[93]])->current == 30);
+		assert(world.EntityGetComponent<Label>(translation[ids[91]])->text == "moved");
+		world.ObserverFlush();
+		assert(transformEvents == 0);
+
+		// new entities fill up the ids after the live ones
+		assert(world.EntityCreate() == 50);
+
+		world.Update();
+		assert(order.size() == 50);
+
+		// sorted by descending x
+		assert(world.SystemSortBy("Order", [](EcsInstance& ecs, EntityId id)
+			{
+				return static_cast<std::uint64_t>(1000.0f - ecs.EntityReadComponent<Transform>(id)->x);
+			}) == StatusCode::Success);
+		world.Update();
+		assert(order.size() == 50 && order.front() == 99.0f && order.back() == 1.0f);
+		assert(std::is_sorted(order.rbegin(), order.rend()));
+
+		assert(world.SystemSortBy("Order", nullptr) == StatusCode::Success);
+		assert(world.SystemSortBy("Missing", nullptr) == StatusCode::SysNotReg);
+
+		// chunked components move along with their entities as well
+		EcsInstance chunked(64, nullptr, StorageBackend::Archetypes);
+		chunked.ComponentRegister<Transform>();
+		std::vector<EntityId> chunkedIds(10);
+		chunked.EntityCreateBatch(10, chunkedIds);
+		for (EntityId id : chunkedIds)
+		{
+			Transform tr{ static_cast<float>(id), 0.0f };
+			chunked.EntityAddComponent<Transform>(id, &tr);
+		}
+		chunked.EntityDestroy(chunkedIds[0]);
+		chunked.EntityDestroy(chunkedIds[4]);
+		assert(chunked.Compact(translation) == StatusCode::Success);
+		assert(chunked.EntityGetComponent<Transform>(translation[chunkedIds[9]])->x == static_cast<float>(chunkedIds[9]));
+		assert(translation[chunkedIds[9]] == 7);
+	}
+
+	/*
+	* should output 6 errors when setting invalid rates
+	*/
+	Test("Phases and rates");
+	Instance(20);
+	{
+		EcsInstance world(64);
+		world.ComponentRegister<Transform>();
+
+
+		// registered out of phase order
+		std::string order;
+		world.SystemRegister<Require<const Transform>>("Late",
+			[&order](View<const Transform> view, EcsDt dt) { order += 'L'; });
+		world.SystemRegister<Require<const Transform>>("Early",
+			[&order](View<const Transform> view, EcsDt dt) { order += 'E'; });
+		world.SystemRegister<Require<const Transform>>("Middle",
+			[&order](View<const Transform> view, EcsDt dt) { order += 'M'; });
+		assert(world.SystemSetPhase("Late", SystemPhase::PostUpdate) == StatusCode::Success);
+		assert(world.SystemSetPhase("Early", SystemPhase::PreUpdate) == StatusCode::Success);
+
+		int fixedRuns = 0;
+		EcsDt fixedTime = 0;
+		world.SystemRegister<Require<const Transform>>("Fixed",
+			[&fixedRuns, &fixedTime](View<const Transform> view, EcsDt dt) { ++fixedRuns; fixedTime += dt; });
+		assert(world.SystemSetRate("Fixed", SystemRate::FixedStep(0.125, 4)) == StatusCode::Success);
+
+		int everyRuns = 0;
+		EcsDt everyTime = 0;
+		world.SystemRegister<Require<const Transform>>("Every",
+			[&everyRuns, &everyTime](View<const Transform> view, EcsDt dt) { ++everyRuns; everyTime = dt; });
+		assert(world.SystemSetRate("Every", SystemRate::EveryNFrames(3)) == StatusCode::Success);
+
+		std::vector<int> visits(64, 0);
+		std::vector<int> sliceSizes;
+		EcsDt sliceTime = 0;
+		world.SystemRegister<Require<Transform>>("Sliced",
+			[&visits, &sliceSizes, &sliceTime](View<Transform> view, EcsDt dt)
+			{
+				sliceSizes.push_back(view.Size());
+				view.Each([&visits](EntityId id, Transform& tr) { ++visits[id]; });
+				sliceTime = dt;
+			});
+		assert(world.SystemSetRate("Sliced", SystemRate::TimeSliced(4)) == StatusCode::Success);
+
+		std::vector<EntityId> ids(10);
+		world.EntityCreateBatch(10, ids);
+		for (EntityId id : ids)
+			world.EntityAddComponent<Transform>(id);
+
+		world.Update(0.25);
+		assert(order == "EML");
+		assert(fixedRuns == 2 && fixedTime == 0.25);
+		assert(everyRuns == 1 && everyTime == 0.25);
+
+		world.Update(0.0625);
+		assert(fixedRuns == 2);
+		world.Update(0.0625);
+		assert(fixedRuns == 3 && everyRuns == 1);
+
+		// the fourth frame runs the every n frames system with the time of the last three
+		world.Update(0.25);
+		assert(everyRuns == 2 && everyTime == 0.375);
+
+		// every entity is visited once over the four slices
+		assert((sliceSizes == std::vector<int>{ 3, 3, 3, 1 }));
+		assert(std::all_of(ids.begin(), ids.end(), [&visits](EntityId id) { return visits[id] == 1; }));
+		assert(sliceTime == 0.625);
+
+		// fixed step catches up by at most maxSteps steps and drops the rest
+		fixedRuns = 0;
+		world.Update(10.0);
+		assert(fixedRuns == 4);
+		world.Update(0.0);
+		assert(fixedRuns == 4);
+
+		// phases hold when systems run in parallel
+		assert(world.SetThreadCount(4) == StatusCode::Success);
+		order.clear();
+		world.Update(0.25);
+		assert(order == "EML");
+
+		// non-positive steps and frame counts are rejected and keep the previous rate
+		assert(world.SystemSetRate("Fixed", SystemRate::FixedStep(0.0)) == StatusCode::InvalidArg);
+		assert(world.SystemSetRate("Fixed", SystemRate::FixedStep(-0.125)) == StatusCode::InvalidArg);
+		assert(world.SystemSetRate("Fixed", SystemRate::FixedStep(std::nan(""))) == StatusCode::InvalidArg);
+		assert(world.SystemSetRate("Fixed", SystemRate::FixedStep(0.125, 0)) == StatusCode::InvalidArg);
+		assert(world.SystemSetRate("Every", SystemRate::EveryNFrames(0)) == StatusCode::InvalidArg);
+		assert(world.SystemSetRate("Sliced", SystemRate::TimeSliced(-1)) == StatusCode::InvalidArg);
+		fixedRuns = 0;
+		everyRuns = 0;
+		sliceSizes.clear();
+		world.Update(0.25);
+		assert(fixedRuns == 2 && everyRuns == 0 && sliceSizes.size() == 1);
+
+		assert(world.SystemSetRate("Fixed", SystemRate::EveryFrame()) == StatusCode::Success);
+		fixedRuns = 0;
+		world.Update(0.25);
+		assert(fixedRuns == 1);
+	}
+
+	/*
+	* should output 2 errors when querying an unregistered component and registering more systems than pico_ecs holds
+	*/
+	Test("Queries");
+	Instance(21);
+	{
+		EcsInstance world(128);
+		world.ComponentRegister<Transform>();
+		world.ComponentRegister<Velocity>();
+		world.ComponentRegister<Name>();
+		world.ComponentRegister<Visible>();
+		world.ComponentRegister<Tracked>(ComponentStorage::Sparse);
+
+		// destroys entities with velocity through the queue of pico_ecs
+		world.SystemRegister<Require<const Velocity>>("Despawn", [&world](View<const Velocity> view, EcsDt dt)
+			{
+				for (auto it = view.begin(); it != view.end(); ++it)
+					world.EntityQueueDestroy(it.GetEntity());
+			});
+
+		// entities that match before the first query
+		std::vector<EntityId> ids(10);
+		world.EntityCreateBatch(10, ids);
+		for (std::size_t i = 0; i < ids.size(); ++i)
+		{
+			Transform tr{ static_cast<float>(i), 0.0f };
+			world.EntityAddComponent<Transform>(ids[i], &tr);
+			if (i < 5)
+				world.EntityEmplaceComponent<Name>(ids[i], "named");
+		}
+
+		auto unnamed = [&world]() { return world.Query<With<Transform>, Without<Name>>(); };
+		assert(unnamed().Size() == 5);
+
+		for (auto [tr] : unnamed())
+			tr.y = 1.0f;
+		assert(world.EntityReadComponent<Transform>(ids[5])->y == 1.0f && world.EntityReadComponent<Transform>(ids[0])->y == 0.0f);
+
+		// changes of entities that matched before the query, and of the others
+		world.EntityRemoveComponent<Name>(ids[0]);
+		assert(unnamed().Size() == 6);
+		world.EntityRemoveComponent<Transform>(ids[9]);
+		world.EntityEmplaceComponent<Name>(ids[8], "named");
+		world.EntityDestroy(ids[7]);
+		assert(unnamed().Size() == 3);
+
+		// the id of the destroyed entity comes up again
+		const EntityId reused = world.EntityCreate();
+		world.EntityAddComponent<Name>(reused);
+		world.EntityAddComponent<Transform>(reused);
+		assert(unnamed().Size() == 3);
+		world.EntityRemoveComponent<Name>(reused);
+		assert(unnamed().Size() == 4);
+
+		// tags and sparse components are matched as well
+		assert(world.Query<With<Visible>>().Size() == 0);
+		world.EntityAddComponent<Visible>(ids[1]);
+		world.EntityAddComponent<Visible>(ids[5]);
+		world.EntityEmplaceComponent<Tracked>(ids[5], 3, "sparse");
+		assert(world.Query<With<Visible>>().Size() == 2);
+		assert((world.Query<With<Transform, Visible>, Without<Name>>().Size() == 1));
+		world.EntityRemoveComponent<Name>(ids[1]);
+		assert((world.Query<With<Transform, Visible>, Without<Name>>().Size() == 2));
+
+		int trackedSum = 0;
+		world.Query<With<Tracked, Transform>>().Each([&trackedSum](EntityId id, Tracked& tracked, Transform& tr) { trackedSum += tracked.value; });
+		assert(trackedSum == 3);
+
+		world.EntityAddComponent<Velocity>(ids[1]);
+		world.Update();
+		assert(world.Query<With<Visible>>().Size() == 1 && unnamed().Size() == 4);
+
+		// matches follow the entities when they are compacted
+		std::vector<EntityId> translation;
+		assert(world.Compact(translation) == StatusCode::Success);
+		assert(world.Query<With<Visible>>().Size() == 1 && unnamed().Size() == 4);
+		auto compacted = unnamed();
+		for (auto it = compacted.begin(); it != compacted.end(); ++it)
+			assert(!world.EntityHasComponent<Name>(it.GetEntity()));
+		auto tracked = world.Query<With<Tracked>>();
+		assert(tracked.begin().GetEntity() == translation[ids[5]]);
+
+		// matches are the same as found by checking every entity
+		unsigned seed = 7;
+		for (int step = 0; step < 2000; ++step)
+		{
+			seed = seed * 1103515245u + 12345u;
+			const EntityId id = static_cast<EntityId>((seed >> 8) % 64);
+			if (!world.EntityIsReady(id))
+			{
+				world.EntityCreate();
+				continue;
+			}
+			auto toggle = [&world, id](auto* comp)
+				{
+					using CompType = std::remove_pointer_t<decltype(comp)>;
+					if (world.EntityHasComponent<CompType>(id))
+						world.EntityRemoveComponent<CompType>(id);
+					else
+						world.EntityAddComponent<CompType>(id);
+				};
+			switch ((seed >> 16) % 5)
+			{
+			case 0: toggle(static_cast<Transform*>(nullptr)); break;
+			case 1: toggle(static_cast<Name*>(nullptr)); break;
+			case 2: toggle(static_cast<Visible*>(nullptr)); break;
+			case 3: world.EntityDestroy(id); break;
+			default: world.EntityAddComponent<Velocity>(id); world.Update(); break;
+			}
+
+			int expected = 0;
+			for (EntityId other = 0; other < 128; ++other)
+			{
+				if (world.EntityIsReady(other) && world.EntityHasComponent<Transform>(other)
+					&& world.EntityHasComponent<Visible>(other) && !world.EntityHasComponent<Name>(other))
+					++expected;
+			}
+			assert((world.Query<With<Transform, Visible>, Without<Name>>().Size() == expected));
+		}
+
+		assert(world.Reset() == StatusCode::Success);
+		assert(unnamed().Size() == 0 && world.Query<With<Visible>>().Size() == 0);
+
+		// queued removals are applied once pico_ecs carried them out
+		const EntityId queued = world.EntityCreate();
+		world.EntityAddComponent<Transform>(queued);
+		world.EntityAddComponent<Name>(queued);
+		world.EntityQueueRemoveComponent<Name>(queued);
+		assert(unnamed().Size() == 0);
+		world.Update();
+		assert(unnamed().Size() == 1 && !world.EntityHasComponent<Name>(queued));
+
+		assert(world.Query<With<UnregisteredComp>>().Size() == 0);
+	}
+	{
+		// queries take no pico_ecs system, so they don't count against its limit
+		EcsInstance world(16);
+		world.ComponentRegister<Transform>();
+		world.ComponentRegister<Name>();
+		assert(world.Query<With<Transform>>().Size() == 0);
+		assert((world.Query<With<Transform>, Without<Name>>().Size() == 0));
+		for (int i = 0; i < 16; ++i)
+		{
+			assert(world.SystemRegister<Require<Transform>>("Filler" + std::to_string(i),
+				[](EcsInstance& ecs, EntityId* entities, int entityCount, EcsDt dt) {}) == StatusCode::Success);
+		}
+		assert(world.SystemRegister<Require<Transform>>("Overflow",
+			[](EcsInstance& ecs, EntityId* entities, int entityCount, EcsDt dt) {}) == StatusCode::SysRegFail);
+
+		const EntityId id = world.EntityCreate();
+		world.EntityAddComponent<Transform>(id);
+		assert(world.Query<With<Transform>>().Size() == 1);
+		assert((world.Query<With<Transform>, Without<Name>>().Size() == 1));
+	}
+
+	/*
+	* should output 4 errors when getting an unset resource, cloning a resource that can't be copied,
+	* setting up serialization without a serializer and loading a resource that isn't set up
+	*/
+	Test("Resources");
+	Instance(22);
+	{
+		EcsInstance world(64);
+		world.ComponentRegister<Transform>();
+		assert(!world.HasResource<GameTime>());
+		assert(world.GetResource<GameTime>() == nullptr);
+
+		GameTime* time = world.SetResource<GameTime>(GameTime{ 0.0, 0 });
+		assert(time && world.HasResource<GameTime>() && world.GetResource<GameTime>() == time);
+		world.SetResource<Config>(Config{ "pico", 2 });
+
+		// the new value may be made from the previous one
+		world.SetResource<Config>(Config{ world.GetResource<Config>()->title + " ecs", 3 });
+		assert(world.GetResource<Config>()->title == "pico ecs" && world.GetResource<Config>()->difficulty == 3);
+
+		// systems get resources through the instance
+		world.SystemRegister<Require<Transform>>("Clock", [&world](View<Transform> view, EcsDt dt)
+			{
+				GameTime& time = *world.GetResource<GameTime>();
+				time.elapsed += dt;
+				++time.frame;
+			});
+		world.EntityAddComponent<Transform>(world.EntityCreate());
+		world.Update(0.5);
+		world.Update(0.25);
+		assert(world.GetResource<GameTime>()->elapsed == 0.75 && world.GetResource<GameTime>()->frame == 2);
+
+		// kept by Reset
+		assert(world.Reset() == StatusCode::Success);
+		assert(world.GetResource<GameTime>()->frame == 2);
+
+		// clones get copies, and lose the resources the source doesn't have
+		EcsInstance fork(64);
+		fork.SetResource<int>(7);
+		assert(world.CloneInto(fork) == StatusCode::Success);
+		assert(!fork.HasResource<int>() && fork.GetResource<Config>()->title == "pico ecs");
+		assert(fork.GetResource<GameTime>() != world.GetResource<GameTime>());
+		fork.GetResource<GameTime>()->frame = 10;
+		assert(world.GetResource<GameTime>()->frame == 2);
+
+		world.SetResource<std::unique_ptr<int>>(std::make_unique<int>(3));
+		assert(world.CloneInto(fork) == StatusCode::InvalidArg);
+		assert(world.RemoveResource<std::unique_ptr<int>>() == StatusCode::Success);
+		assert(!world.HasResource<std::unique_ptr<int>>());
+
+		// a throwing constructor leaves no resource and no memory behind
+		const std::size_t bytesInUse = world.GetMemoryStats().bytesInUse;
+		bool thrown = false;
+		try
+		{
+			world.SetResource<BrokenConfig>();
+		}
+		catch (const std::runtime_error&)
+		{
+			thrown = true;
+		}
+		assert(thrown && !world.HasResource<BrokenConfig>());
+		assert(world.GetMemoryStats().bytesInUse == bytesInUse);
+
+		// raw and serialized resources are saved in snapshots
+		assert(world.SetResourceSerialization<Config>("Config") == StatusCode::InvalidArg);
+		auto setup = [](EcsInstance& ecs)
+			{
+				ecs.SetResourceSerialization<GameTime>("GameTime");
+				ecs.SetResourceSerialization<Config>("Config",
+					[](const Config& config, std::string& out) { out = std::to_string(config.difficulty) + config.title; },
+					[](std::string_view data) { return std::optional<Config>(Config{ std::string(data.substr(1)), data[0] - '0' }); });
+			};
+		setup(world);
+		assert(world.SaveSnapshot("pico_ecs_cpp_resources.bin") == StatusCode::Success);
+
+		EcsInstance restored(64);
+		restored.ComponentRegister<Transform>();
+		setup(restored);
+		restored.SetResource<int>(5);
+		assert(restored.LoadSnapshot("pico_ecs_cpp_resources.bin") == StatusCode::Success);
+		assert(restored.GetResource<GameTime>()->elapsed == 0.75 && restored.GetResource<GameTime>()->frame == 2);
+		assert(restored.GetResource<Config>()->title == "pico ecs" && restored.GetResource<Config>()->difficulty == 3);
+		assert(*restored.GetResource<int>() == 5);
+
+		EcsInstance unprepared(64);
+		unprepared.ComponentRegister<Transform>();
+		assert(unprepared.LoadSnapshot("pico_ecs_cpp_resources.bin") == StatusCode::ResNotSet);
+		std::remove("pico_ecs_cpp_resources.bin");
+	}
 
 	/*
 	* should be silent
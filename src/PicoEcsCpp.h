@@ -1,14 +1,91 @@
 #pragma once
 
+#include <cstddef>
+
+// memory hooks -----------------------------------------------------
+
+/*
+* routes pico_ecs allocations through the memory context of EcsInstance,
+* unless the user defined their own hooks.
+* takes effect in the translation unit that defines PICO_ECS_IMPLEMENTATION
+*/
+#if !defined(ECS_MALLOC) && !defined(ECS_REALLOC) && !defined(ECS_FREE)
+
+    #define PICO_ECS_CPP_MEMORY_HOOKS
+    #define ECS_MALLOC(size, ctx)       (pico_ecs_cpp::detail::MemoryAllocate((size), (ctx)))
+    #define ECS_REALLOC(ptr, size, ctx) (pico_ecs_cpp::detail::MemoryReallocate((ptr), (size), (ctx)))
+    #define ECS_FREE(ptr, ctx)          (pico_ecs_cpp::detail::MemoryFree((ptr), (ctx)))
+
+namespace pico_ecs_cpp
+{
+    namespace detail
+    {
+        inline void* MemoryAllocate(std::size_t size, void* ctx);
+        inline void* MemoryReallocate(void* ptr, std::size_t size, void* ctx);
+        inline void MemoryFree(void* ptr, void* ctx);
+    }
+}
+
+#endif
+
+// pico_ecs undefines PICO_ECS_IMPLEMENTATION once its implementation is compiled
+#if defined(PICO_ECS_IMPLEMENTATION)
+    #define PICO_ECS_CPP_IMPLEMENTATION
+#endif
+
 #include "pico_ecs.h"
 
 #include <unordered_map>
-#include <typeindex>
 #include <typeinfo>
 #include <algorithm>
 #include <functional>
 #include <string>
+#include <string_view>
 #include <memory>
+#include <limits>
+#include <vector>
+#include <atomic>
+#include <cstddef>
+#include <tuple>
+#include <array>
+#include <utility>
+#include <iterator>
+#include <type_traits>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <optional>
+#include <cstdint>
+#include <new>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <fstream>
+
+#if defined(PICO_ECS_CPP_PROFILING)
+    #include <chrono>
+#endif
+
+#if !defined(PICO_ECS_CPP_NO_SIMD)
+    #if defined(__AVX2__)
+        #define PICO_ECS_CPP_AVX2
+        #include <immintrin.h>
+    #elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+        #define PICO_ECS_CPP_SSE2
+        #include <emmintrin.h>
+    #endif
+#endif
+
+/*
+* pico_ecs defines ECS_MAX_SYSTEMS only where PICO_ECS_IMPLEMENTATION is defined,
+* a raised limit has to be visible wherever systems are registered
+*/
+#if defined(ECS_MAX_SYSTEMS)
+    #define PICO_ECS_CPP_MAX_SYSTEMS ECS_MAX_SYSTEMS
+#else
+    #define PICO_ECS_CPP_MAX_SYSTEMS 16
+#endif
 
 // error handling -----------------------------------------------------
 
@@ -20,6 +97,7 @@ namespace pico_ecs_cpp
         UnknownError,
 
         InitFail,
+        InvalidArg,
 
         CompExists,
         CompRegFail,
@@ -29,7 +107,12 @@ namespace pico_ecs_cpp
         SysExists,
         SysRegFail,
         SysNotReg,
-        SysUpdateFail
+        SysUpdateFail,
+
+        FileFail,
+        SnapshotInvalid,
+
+        ResNotSet
     };
 
     inline std::string GetStatusMessage(StatusCode code)
@@ -40,6 +123,8 @@ namespace pico_ecs_cpp
 
         case StatusCode::InitFail: return "Initialization Failure";
 
+        case StatusCode::InvalidArg: return "Invalid Argument";
+
         case StatusCode::CompExists: return "Component Already Registered";
 
         case StatusCode::CompRegFail: return "Component Registration Failed";
@@ -56,6 +141,12 @@ namespace pico_ecs_cpp
 
         case StatusCode::SysUpdateFail: return "System Update Failure";
 
+        case StatusCode::FileFail: return "File Operation Failed";
+
+        case StatusCode::SnapshotInvalid: return "Invalid Snapshot";
+
+        case StatusCode::ResNotSet: return "Resource Not Set";
+
         case StatusCode::UnknownError:
         default: return "Unknown Error";
         }
@@ -91,6 +182,64 @@ namespace pico_ecs_cpp
     using SystemFunc                = ecs_system_fn;
     using SystemAddedCb             = ecs_added_fn;
     using SystemRemovedCb           = ecs_removed_fn;
+
+    // appends the serialized component to out
+    template<typename CompType>
+    using ComponentSerializer       = void(*)(const CompType& comp, std::string& out);
+
+    // reconstructs a component from the bytes written by its serializer, returns nullopt on failure
+    template<typename CompType>
+    using ComponentDeserializer     = std::optional<CompType>(*)(std::string_view data);
+
+    // type slots -----------------------------------------------------------
+
+    namespace detail
+    {
+        inline std::size_t NextTypeSlot()
+        {
+            static std::atomic<std::size_t> counter{ 0 };
+            return counter++;
+        }
+
+        /*
+        * dense process-wide index of a type, assigned on first use.
+        * used to index per-instance tables without hashing
+        */
+        template<typename T>
+        inline std::size_t TypeSlot()
+        {
+            static const std::size_t slot = NextTypeSlot();
+            return slot;
+        }
+
+        // empty components registered without constructor and destructor are kept as bits only
+        template<typename T>
+        constexpr bool isTag = std::is_empty_v<T> && std::is_trivially_copyable_v<T> && std::is_default_constructible_v<T>;
+
+        // object handed out for tags, which carry no data
+        template<typename T>
+        inline T* TagInstance()
+        {
+            static T instance;
+            return &instance;
+        }
+
+        // index of the lowest set bit, bits must not be zero
+        inline unsigned LowestBit(std::uint64_t bits)
+        {
+#if defined(__GNUC__) || defined(__clang__)
+            return static_cast<unsigned>(__builtin_ctzll(bits));
+#else
+            unsigned index = 0;
+            while (!(bits & 1))
+            {
+                bits >>= 1;
+                ++index;
+            }
+            return index;
+#endif
+        }
+    }
 }
 
 #if defined(PICO_ECS_CPP_ERROR_USE_EXCEPTIONS)
@@ -164,9 +313,8 @@ adds "Constructor" to the name
 #define PICO_ECS_CPP_COMPONENT_CONSTRUCTOR_COPY(CtorName)										                           \
     inline pico_ecs_cpp::ComponentCtor CtorName##Constructor = [](ecs_t* ecs, ecs_id_t entity_id, void* ptr, void* args)   \
     {																							                           \
-        CtorName* comp = static_cast<CtorName*>(ptr);											                           \
         CtorName* init = static_cast<CtorName*>(args);											                           \
-        if(init) (*comp) = (*init);																                           \
+        if(init) new (ptr) CtorName(*init);														                           \
     }
 
 // does not include function body
@@ -177,343 +325,7512 @@ adds "Constructor" to the name
 
 namespace pico_ecs_cpp
 {
-    // ecs instance -------------------------------------------------------------
+    class EcsInstance;
 
-    class EcsInstance
+    template<typename ... CompTypes>
+    class View;
+
+    // thread pool ----------------------------------------------------------
+
+    namespace detail
     {
-    public:
-        EcsInstance() = default;
-        ~EcsInstance();
+        /*
+        * work-stealing pool used to run systems in parallel.
+        * every worker owns a queue, pops its own tasks from the back
+        * and steals from the front of other queues when it runs out.
+        * queue 0 belongs to threads that are not workers of the pool
+        */
+        class ThreadPool
+        {
+        public:
+            using Task = std::function<void()>;
 
-        // initializes an ecs instance
-        EcsInstance(int entityCount);
+            explicit ThreadPool(unsigned workerCount);
+            ~ThreadPool();
 
-        // initializes an ecs instance
-        StatusCode Init(int entityCount);
+            ThreadPool(const ThreadPool&) = delete;
+            ThreadPool& operator=(const ThreadPool&) = delete;
 
-        // destroys an ecs instance
-        StatusCode Destroy();
+            // queues a task, on the queue of the calling worker if called from one
+            void Submit(Task task);
 
-        // removes all entities from the ecs, preserving systems and components
-        StatusCode Reset();
+            // runs queued tasks on the calling thread until pending drops to zero
+            void WaitFor(const std::atomic<int>& pending);
 
-        // updates all systems, should be called once per frame
-        StatusCode Update(EcsDt dt = 0.0f);
+            // returns the number of worker threads, not counting the waiting thread
+            unsigned GetWorkerCount() const;
 
-        // returns pointer to the base ecs instance
-        Ecs* GetInstance() const;
+            // returns 1..workerCount on workers of this pool, 0 on other threads
+            unsigned GetCurrentIndex() const;
+
+        private:
+            struct Queue
+            {
+                std::mutex mutex;
+                std::deque<Task> tasks;
+            };
+
+            struct WorkerSlot
+            {
+                const ThreadPool* pool = nullptr;
+                unsigned index = 0;
+            };
+
+            static WorkerSlot& CurrentSlot();
+
+            bool TryPop(unsigned index, Task& task);
+            void WorkerLoop(unsigned index);
+
+        private:
+            std::vector<std::unique_ptr<Queue>> queues;
+            std::vector<std::thread> threads;
 
+            std::mutex sleepMutex;
+            std::condition_variable wake;
+            std::atomic<int> queued{ 0 };
+            bool stopping = false;
+        };
+    }
+
+    // span ----------------------------------------------------------
+
+    // non-owning view of a contiguous sequence
+    template<typename T>
+    class Span
+    {
     public:
+        Span() = default;
+        Span(T* data, std::size_t size);
 
-        // creates a new entity, returns its id
-        EntityId EntityCreate();
+        // constructs from a container providing data() and size(), such as std::vector or std::array
+        template<typename Container, typename = std::enable_if_t<
+            std::is_convertible_v<decltype(std::declval<Container&>().data()), T*>>>
+        Span(Container& container);
 
-        // checks if entity is currently active
-        bool EntityIsReady(EntityId id) const;
+        // allows passing Span<T> where Span<const T> is expected
+        template<typename U, typename = std::enable_if_t<
+            std::is_convertible_v<U*, T*> && !std::is_same_v<U, T>>>
+        Span(const Span<U>& other);
 
-        // destroys entity
-        StatusCode EntityDestroy(EntityId id);
+        T* Data() const;
+        std::size_t Size() const;
+        bool IsEmpty() const;
 
-        // checks if entity has specified component
-        template<typename CompType>
-        bool EntityHasComponent(EntityId id);
+        T& operator[](std::size_t index) const;
 
-        // gets a pointer to the instance of specified component held by the entity
-        template<typename CompType>
-        CompType* EntityGetComponent(EntityId id);
+        T* begin() const;
+        T* end() const;
 
-        // adds a component to the entity, returns pointer to added component
-        template<typename CompType>
-        CompType* EntityAddComponent(EntityId id, void* args = nullptr);
+    private:
+        T* data = nullptr;
+        std::size_t size = 0;
+    };
 
-        // removes specified component from the entity
-        template<typename CompType>
-        StatusCode EntityRemoveComponent(EntityId id);
+    // simd kernels ----------------------------------------------------------
 
-        /*
-        * queues an entity for destruction at the end of system execution
-        * queued entities are destroyed after the curent iteration
-        */
-        StatusCode EntityQueueDestroy(EntityId id);
+    /*
+    * reference kernels for component columns made only of floats.
+    * the instruction set is picked at compile time: AVX2 when enabled (-mavx2, /arch:AVX2),
+    * SSE2 on x86-64, scalar otherwise or with PICO_ECS_CPP_NO_SIMD
+    */
+    namespace simd
+    {
+        // returns the name of the instruction set used by the kernels
+        const char* GetInstructionSet();
+
+        // dst[i] += src[i] * scale for count floats
+        void AddScaled(float* dst, const float* src, float scale, std::size_t count);
+
+        // scalar version of AddScaled, used for the tail and as a reference
+        void AddScaledScalar(float* dst, const float* src, float scale, std::size_t count);
 
         /*
-        * queues a component for removable
-        * queued entity/component pairs that will be deleted after the current system returns
+        * adds src * scale to dst memberwise, both types must consist only of floats,
+        * e.g. AddScaled(transforms, velocities, dt) with Transform { float x, y; } and Velocity { float x, y; }
         */
-        template<typename CompType>
-        StatusCode EntityQueueRemoveComponent(EntityId id);
+        template<typename Dst, typename Src>
+        void AddScaled(Span<Dst> dst, Span<const Src> src, float scale);
+    }
+
+    // memory ----------------------------------------------------------
 
+    /*
+    * source of the memory used by pico_ecs storage of an EcsInstance.
+    * an instance only calls its allocator from the thread doing structural changes
+    */
+    class Allocator
+    {
     public:
+        virtual ~Allocator() = default;
 
-        // registers a single component with optional constructor and destructor
-        template<typename CompType>
-        StatusCode ComponentRegister(ComponentCtor ctor = nullptr, ComponentDtor dtor = nullptr);
+        virtual void* Allocate(std::size_t size, std::size_t alignment) = 0;
+        virtual void Deallocate(void* ptr, std::size_t size) = 0;
+
+        // allocates a new block and copies the contents, can be overridden to grow in place
+        virtual void* Reallocate(void* ptr, std::size_t oldSize, std::size_t newSize, std::size_t alignment);
+    };
 
+    /*
+    * allocator that only moves forward, freed memory is reclaimed all at once by Release.
+    * suits instances whose storage grows to a steady size and then stays there
+    */
+    class MonotonicArena : public Allocator
+    {
     public:
+        // requests blocks of at least blockSize bytes from the global heap as needed
+        explicit MonotonicArena(std::size_t blockSize = 1 << 20);
 
-        // registers a system with optional added/removed callbacks
-        StatusCode SystemRegister(
-            const std::string& name,
-            SystemFunc func, 
-            SystemAddedCb add = nullptr, 
-            SystemRemovedCb rem = nullptr);
+        /*
+        * serves allocations from buffer first, e.g. a huge page mapping owned by the caller,
+        * then from blocks requested from the global heap
+        */
+        MonotonicArena(void* buffer, std::size_t size, std::size_t blockSize = 1 << 20);
 
-        // determines which components are available to the specified system
-        template<typename CompType>
-        StatusCode SystemRequire(const std::string& sysName);
+        ~MonotonicArena() override;
 
-        // excludes entities that have specified component from the system
-        template<typename CompType>
-        StatusCode SystemExclude(const std::string& sysName);
+        MonotonicArena(const MonotonicArena&) = delete;
+        MonotonicArena& operator=(const MonotonicArena&) = delete;
 
-        // enables a system
-        StatusCode SystemEnable(const std::string& sysName);
+        void* Allocate(std::size_t size, std::size_t alignment) override;
 
-        // disables a system
-        StatusCode SystemDisable(const std::string& sysName);
+        // does nothing, memory is reclaimed by Release
+        void Deallocate(void* ptr, std::size_t size) override;
 
-    private:
-        Ecs* instance = nullptr;
+        // grows the most recent allocation in place when it fits
+        void* Reallocate(void* ptr, std::size_t oldSize, std::size_t newSize, std::size_t alignment) override;
 
-        std::unordered_map<std::type_index, ComponentId> components;
-        std::unordered_map<std::string, SystemId> systems;
-    };
+        // reclaims all memory, nothing allocated from the arena may be in use
+        void Release();
 
-    // definitions -----------------------------------------------
+        // returns the number of bytes handed out since the last release, including alignment padding
+        std::size_t GetUsedSize() const;
 
-    inline EcsInstance::EcsInstance(int entityCount)
-    {
-        Init(entityCount);
-    }
+    private:
+        struct Block
+        {
+            char* data = nullptr;
+            std::size_t size = 0;
+            bool owned = false;
+        };
 
-    inline EcsInstance::~EcsInstance()
+    private:
+        std::vector<Block> blocks;
+        std::size_t blockSize = 0;
+        std::size_t offset = 0;
+        std::size_t used = 0;
+        char* last = nullptr;
+    };
+
+    // allocation counters of an EcsInstance
+    struct MemoryStats
     {
-        if(instance) Destroy();
-    }
+        std::size_t allocationCount = 0;
+        std::size_t reallocationCount = 0;
+        std::size_t freeCount = 0;
+        std::size_t bytesInUse = 0;
+        std::size_t peakBytesInUse = 0;
+    };
 
-    inline StatusCode EcsInstance::Init(int entityCount)
+    namespace detail
     {
-        if (!(entityCount > 0))
+        // memory context passed to pico_ecs, owned by EcsInstance
+        struct MemoryContext
         {
-            PICO_ECS_CPP_ERROR(StatusCode::InitFail, "Invalid entity count");
-            return StatusCode::InitFail;
-        }
+            Allocator* allocator = nullptr;
+            MemoryStats stats;
+        };
 
-        instance = ecs_new(static_cast<size_t>(entityCount), nullptr);
+        // every block starts with its size, since pico_ecs doesn't pass the old size to realloc
+        constexpr std::size_t memoryHeaderSize = alignof(std::max_align_t);
 
-        if (instance)
-        {
-            return StatusCode::Success;
-        }
-        else
-        {
-            PICO_ECS_CPP_ERROR(StatusCode::InitFail, "Failed to initialize ECS instance");
-            return StatusCode::InitFail;
-        }
+        inline void* MemoryAllocate(std::size_t size, void* ctx);
+        inline void* MemoryReallocate(void* ptr, std::size_t size, void* ctx);
+        inline void MemoryFree(void* ptr, void* ctx);
     }
 
-    inline StatusCode EcsInstance::Destroy()
-    {
-        ecs_free(instance);
-        instance = nullptr;
-        return StatusCode::Success;
-    }
+    // component storage ----------------------------------------------------------
 
-    inline StatusCode EcsInstance::Reset()
+    // storage engine of the components of an instance, picked by Init
+    enum class StorageBackend
     {
-        ecs_reset(instance);
-        return StatusCode::Success;
-    }
+        // pico_ecs storage, one array per component indexed by entity id
+        ComponentArrays,
 
-    inline StatusCode EcsInstance::Update(EcsDt dt)
-    {
-        if (ecs_update_systems(instance, dt))
-            return StatusCode::Success;
-        else 
-            return StatusCode::SysUpdateFail;
-    }
+        /*
+        * entities with the same components are grouped into archetypes,
+        * whose components are kept in 16 KiB chunks with one column per component.
+        * systems get their entities chunk by chunk, so views iterate every chunk linearly.
+        * adding and removing components moves the entity to another archetype
+        */
+        Archetypes
+    };
 
-    inline Ecs* EcsInstance::GetInstance() const
+    // storage policy of a component, picked when it is registered
+    enum class ComponentStorage
     {
-        return instance;
-    }
+        // storage of the backend, see StorageBackend
+        Dense,
 
-    template<typename CompType>
-    inline StatusCode EcsInstance::ComponentRegister(ComponentCtor ctor, ComponentDtor dtor)
+        // sparse set holding only the components entities have, for components few entities carry
+        Sparse
+    };
+
+    namespace detail
     {
-        if (components.find(typeid(CompType)) != components.end())
+        /*
+        * sparse set of components of one type. components are packed in a dense array,
+        * and found through a sparse index split into pages of entity ids,
+        * which are only allocated once an entity in their range gets the component.
+        * memory comes from the memory context of the instance
+        */
+        class SparseStorage
         {
-            PICO_ECS_CPP_ERROR(StatusCode::CompExists, 
-                FormatString("Component [%s] is already registered", typeid(CompType).name()));
-            return StatusCode::CompExists;
-        }
+        public:
+            // relocate move constructs a component into dst and destroys src, components are moved bitwise without it
+            SparseStorage(std::size_t elementSize, void(*relocate)(void* dst, void* src), MemoryContext* memory);
+            ~SparseStorage();
 
-        components[typeid(CompType)] = ecs_register_component(instance, sizeof(CompType), ctor, dtor);
-        return StatusCode::Success;
-    }
+            SparseStorage(const SparseStorage&) = delete;
+            SparseStorage& operator=(const SparseStorage&) = delete;
 
-    inline StatusCode EcsInstance::SystemRegister(const std::string& name, SystemFunc func, SystemAddedCb add, SystemRemovedCb rem)
-    {
-        if (systems.find(name) != systems.end())
-        {
-            PICO_ECS_CPP_ERROR(StatusCode::SysExists,
-                FormatString("System [%s] is already registered", name));
-            return StatusCode::SysExists;
-        }
+            // returns the component of the entity, nullptr if it has none
+            void* Get(EntityId id) const;
 
-        systems[name] = ecs_register_system(instance, func, add, rem, this);
+            // returns an uninitialized slot for an entity that doesn't have the component
+            void* Insert(EntityId id);
 
-        return StatusCode::Success;
+            // removes an already destroyed component, the last component is moved into its slot
+            void Erase(EntityId id);
+
+            // hands the component of an entity over to another entity that has none, without moving it
+            void Rename(EntityId from, EntityId to);
+
+            // removes all components, which must already be destroyed, keeping the memory
+            void Clear();
+
+            // entities that have the component, in storage order
+            Span<const EntityId> GetEntities() const;
+
+        private:
+            // moves count components from src to uninitialized dst
+            void Move(char* dst, char* src, std::size_t count);
+
+            // returns the slot of an entity in the sparse index, allocating its page if needed
+            std::uint32_t& IndexSlot(EntityId id);
+
+        private:
+            static constexpr std::size_t pageBits = 8;
+            static constexpr std::size_t pageSize = static_cast<std::size_t>(1) << pageBits;
+            static constexpr std::uint32_t emptySlot = std::numeric_limits<std::uint32_t>::max();
+
+            std::size_t elementSize = 0;
+            void(*relocate)(void* dst, void* src) = nullptr;
+            MemoryContext* memory = nullptr;
+
+            // slot of every entity id, null pages have no components
+            std::uint32_t** pages = nullptr;
+            std::size_t pageCount = 0;
+
+            char* data = nullptr;
+            EntityId* entities = nullptr;
+            std::size_t size = 0;
+            std::size_t capacity = 0;
+        };
     }
 
-    template<typename CompType>
-    inline StatusCode EcsInstance::SystemRequire(const std::string& sysName)
+    // snapshot ----------------------------------------------------------
+
+    namespace detail
     {
-        if (systems.find(sysName) == systems.end())
+        /*
+        * snapshot layout, all offsets are from the start of the file:
+        *   SnapshotHeader
+        *   liveness bitmap, one bit per entity id
+        *   SnapshotEntry and its name padded to 8 bytes, for every component, then for every resource
+        *   component sections, each starting at a 64 byte boundary:
+        *     presence bitmap, one bit per entity id
+        *     trivially copyable: column of entityCount slots at the next 64 byte boundary
+        *     serialized: for every present entity, a uint64 length and the bytes padded to 8
+        *   resource sections, each starting at a 64 byte boundary: the raw value, or the serialized bytes
+        */
+        struct SnapshotHeader
         {
-            PICO_ECS_CPP_ERROR(StatusCode::SysNotReg,
-                FormatString("Name [%s] is not associated with any registered system", sysName));
-            return StatusCode::SysNotReg;
-        }
-        if (components.find(typeid(CompType)) == components.end())
+            char magic[8] = { 'P', 'E', 'C', 'S', 'S', 'N', 'A', 'P' };
+            std::uint32_t version = 1;
+            std::uint32_t byteOrder = 0x01020304;
+            std::uint64_t entityCount = 0;
+            std::uint32_t componentCount = 0;
+
+            // zero in snapshots written before resources were saved
+            std::uint32_t resourceCount = 0;
+        };
+
+        struct SnapshotEntry
         {
-            PICO_ECS_CPP_ERROR(StatusCode::CompNotReg,
-                FormatString("Component of type [%s] is not registered", typeid(CompType).name()));
-            return StatusCode::CompNotReg;
-        }
+            std::uint32_t nameLength = 0;
+            std::uint32_t serialized = 0;
+            std::uint64_t elementSize = 0;
+            std::uint64_t offset = 0;
+            std::uint64_t size = 0;
+        };
 
-        ecs_require_component(instance, systems.at(sysName), components.at(typeid(CompType)));
-        return StatusCode::Success;
-    }
+        static_assert(sizeof(SnapshotHeader) == 32 && sizeof(SnapshotEntry) == 32, "Unexpected snapshot struct padding");
 
-    template<typename CompType>
-    inline StatusCode EcsInstance::SystemExclude(const std::string& sysName)
-    {
-        if (systems.find(sysName) == systems.end())
+        inline std::uint64_t SnapshotAlign(std::uint64_t offset, std::uint64_t alignment)
         {
-            PICO_ECS_CPP_ERROR(StatusCode::SysNotReg,
-                FormatString("Name [%s] is not associated with any registered system", sysName));
-            return StatusCode::SysNotReg;
+            return (offset + alignment - 1) / alignment * alignment;
         }
-        if (components.find(typeid(CompType)) == components.end())
+
+        /*
+        * read-only memory mapping of a whole file.
+        * Open and the destructor are defined where PICO_ECS_IMPLEMENTATION is
+        */
+        class MappedFile
         {
-            PICO_ECS_CPP_ERROR(StatusCode::CompNotReg,
-                FormatString("Component of type [%s] is not registered", typeid(CompType).name()));
-            return StatusCode::CompNotReg;
-        }
+        public:
+            MappedFile() = default;
+            ~MappedFile();
 
-        ecs_exclude_component(instance, systems.at(sysName), components.at(typeid(CompType)));
-        return StatusCode::Success;
-    }
+            MappedFile(const MappedFile&) = delete;
+            MappedFile& operator=(const MappedFile&) = delete;
 
-    inline StatusCode EcsInstance::SystemEnable(const std::string& sysName)
-    {
-        if (systems.find(sysName) == systems.end())
-        {
-            PICO_ECS_CPP_ERROR(StatusCode::SysNotReg,
-                FormatString("Name [%s] is not associated with any registered system", sysName));
-            return StatusCode::SysNotReg;
-        }
+            bool Open(const std::string& path);
 
-        ecs_enable_system(instance, systems.at(sysName));
-        return StatusCode::Success;
+            const char* Data() const;
+            std::size_t Size() const;
+
+        private:
+            const char* data = nullptr;
+            std::size_t size = 0;
+#if defined(_WIN32)
+            // HANDLEs, windows.h is kept out of the header
+            void* file = nullptr;
+            void* mapping = nullptr;
+#endif
+        };
     }
 
-    inline StatusCode EcsInstance::SystemDisable(const std::string& sysName)
+    // system handle ----------------------------------------------------------
+
+    /*
+    * identifies a system registered on an EcsInstance.
+    * obtained from SystemRegister or SystemGetHandle,
+    * accepted by all system methods in place of the name
+    */
+    class SystemHandle
     {
-        if (systems.find(sysName) == systems.end())
-        {
-            PICO_ECS_CPP_ERROR(StatusCode::SysNotReg,
-                FormatString("Name [%s] is not associated with any registered system", sysName));
-            return StatusCode::SysNotReg;
-        }
+        friend class EcsInstance;
 
-        ecs_disable_system(instance, systems.at(sysName));
-        return StatusCode::Success;
-    }
+    public:
+        SystemHandle() = default;
 
-    inline EntityId EcsInstance::EntityCreate()
-    {
-        return ecs_create(instance);
-    }
+        // checks if the handle refers to a system
+        bool IsValid() const;
 
-    inline bool EcsInstance::EntityIsReady(EntityId id) const
+        bool operator==(const SystemHandle& other) const;
+        bool operator!=(const SystemHandle& other) const;
+
+    private:
+        explicit SystemHandle(SystemId id);
+
+    private:
+        static constexpr SystemId invalidId = std::numeric_limits<SystemId>::max();
+        SystemId id = invalidId;
+    };
+
+    // system signatures ----------------------------------------------------------
+
+    // components required by a system registered through the templated SystemRegister
+    template<typename ... CompTypes>
+    struct Require {};
+
+    // components excluded from a system registered through the templated SystemRegister
+    template<typename ... CompTypes>
+    struct Exclude {};
+
+    // components only read by a system, used to schedule systems in parallel
+    template<typename ... CompTypes>
+    struct Read {};
+
+    // components written by a system, used to schedule systems in parallel
+    template<typename ... CompTypes>
+    struct Write {};
+
+    /*
+    * components whose changes a system reacts to. the system only gets the entities
+    * for which at least one of them changed since its previous run, see EcsInstance::SystemChanged.
+    * the components are required and read by the system
+    */
+    template<typename ... CompTypes>
+    struct Changed {};
+
+    // components an entity needs to match EcsInstance::Query, the same as Require
+    template<typename ... CompTypes>
+    using With = Require<CompTypes...>;
+
+    // components an entity must not have to match EcsInstance::Query, the same as Exclude
+    template<typename ... CompTypes>
+    using Without = Exclude<CompTypes...>;
+
+    // scheduling ----------------------------------------------------------
+
+    // systems run phase by phase within Update, in registration order within each phase
+    enum class SystemPhase
+    {
+        PreUpdate,
+        Update,
+        PostUpdate
+    };
+
+    /*
+    * how often a system runs within Update.
+    * fixed step runs it with dt = step as often as the accumulated time allows, at most maxSteps times per Update,
+    * whole steps beyond that are dropped so a slow frame doesn't make the next one slower.
+    * every n frames runs it on every frames-th Update, with the time accumulated since its previous run.
+    * time sliced runs it on every Update with the next 1/frames of its entities, continuing from a cursor,
+    * so every entity is processed once per frames Updates, with the time of those Updates as dt
+    */
+    struct SystemRate
+    {
+        enum class Mode
+        {
+            EveryFrame,
+            FixedStep,
+            EveryNFrames,
+            TimeSliced
+        };
+
+        Mode mode = Mode::EveryFrame;
+        EcsDt step = 0;
+        int maxSteps = 1;
+        int frames = 1;
+
+        static SystemRate EveryFrame();
+        static SystemRate FixedStep(EcsDt step, int maxSteps = 4);
+        static SystemRate EveryNFrames(int frames);
+        static SystemRate TimeSliced(int frames);
+    };
+
+    // parallel for ----------------------------------------------------------
+
+    /*
+    * splits entity arrays into chunks processed on the thread pool.
+    * chunk size is rounded up to whole cache lines of entity ids,
+    * and does not depend on the number of threads
+    */
+    struct ParallelOptions
+    {
+        // minimum number of entities per chunk
+        int minChunkSize = 1024;
+
+        // merges reduction results in chunk order instead of completion order
+        bool deterministicMerge = false;
+    };
+
+    namespace detail
+    {
+        template<typename Sig>
+        struct RequiredTypes { using type = std::tuple<>; };
+
+        template<typename ... CompTypes>
+        struct RequiredTypes<Require<CompTypes...>>
+        {
+            using type = decltype(std::tuple_cat(std::declval<
+                std::conditional_t<isTag<std::remove_cv_t<CompTypes>>, std::tuple<>, std::tuple<CompTypes>>>()...));
+        };
+
+        template<typename Tuple>
+        struct ViewFromTuple;
+
+        template<typename ... CompTypes>
+        struct ViewFromTuple<std::tuple<CompTypes...>> { using type = View<CompTypes...>; };
+
+        // View over all components listed in the Require<...> entries of a signature, except tags
+        template<typename ... Signature>
+        using SignatureView = typename ViewFromTuple<
+            decltype(std::tuple_cat(std::declval<typename RequiredTypes<Signature>::type>()...))>::type;
+    }
+
+    // change detection ----------------------------------------------------------
+
+    namespace detail
+    {
+        // tick written by mutable accesses while a system of owner runs on the current thread
+        struct ChangeScope
+        {
+            const void* owner = nullptr;
+            std::uint32_t tick = 0;
+        };
+
+        inline ChangeScope& CurrentChangeScope()
+        {
+            static thread_local ChangeScope scope;
+            return scope;
+        }
+
+        // compares ticks so that they can wrap around
+        inline bool ChangeIsNewer(std::uint32_t tick, std::uint32_t since)
+        {
+            return static_cast<std::int32_t>(tick - since) > 0;
+        }
+    }
+
+    // command buffer ----------------------------------------------------------
+
+    namespace detail
+    {
+        /*
+        * playback order of commands recorded on the current thread.
+        * set while systems and their chunks run, 0 outside of systems
+        */
+        inline std::uint64_t& CommandOrderKey()
+        {
+            static thread_local std::uint64_t key = 0;
+            return key;
+        }
+    }
+
+    // entity created through a command buffer, valid until the buffer is played back
+    struct DeferredEntity
+    {
+        std::uint32_t buffer = 0;
+        std::uint32_t index = 0;
+    };
+
+    /*
+    * records structural changes to be applied at the next sync point,
+    * the end of Update or FlushCommandBuffers.
+    * every thread of the pool records into its own buffer, see EcsInstance::GetCommandBuffer.
+    * commands are played back ordered by the system and chunk that recorded them,
+    * so the result doesn't depend on which thread ran what.
+    * component payloads are kept in an arena owned by the buffer
+    */
+    class CommandBuffer
+    {
+        friend class EcsInstance;
+
+    public:
+        explicit CommandBuffer(std::uint32_t index);
+        ~CommandBuffer();
+
+        CommandBuffer(const CommandBuffer&) = delete;
+        CommandBuffer& operator=(const CommandBuffer&) = delete;
+
+        // records creation of an entity
+        DeferredEntity EntityCreate();
+
+        // records destruction of an entity
+        void EntityDestroy(EntityId id);
+
+        // records adding a component, the value is passed as args to the component constructor
+        template<typename CompType>
+        void EntityAddComponent(EntityId id, CompType value);
+
+        template<typename CompType>
+        void EntityAddComponent(DeferredEntity entity, CompType value);
+
+        // records removal of a component
+        template<typename CompType>
+        void EntityRemoveComponent(EntityId id);
+
+        // checks if there are no recorded commands
+        bool IsEmpty() const;
+
+    private:
+        enum class CommandType
+        {
+            Create,
+            Destroy,
+            Apply
+        };
+
+        struct Command
+        {
+            CommandType type = CommandType::Apply;
+            std::uint64_t order = 0;
+            std::uint32_t sequence = 0;
+
+            // target, or index of the deferred entity when deferred is set
+            EntityId entity = 0;
+            bool deferred = false;
+
+            void* payload = nullptr;
+            void(*apply)(EcsInstance& ecs, EntityId id, void* payload) = nullptr;
+            void(*release)(void* payload) = nullptr;
+        };
+
+        void Push(Command command);
+
+        // returns memory for a payload from the arena
+        void* Allocate(std::size_t size, std::size_t alignment);
+
+        // destroys payloads and rewinds the arena, keeping its memory
+        void Clear();
+
+        template<typename CompType>
+        static void ApplyAdd(EcsInstance& ecs, EntityId id, void* payload);
+
+        template<typename CompType>
+        static void ApplyRemove(EcsInstance& ecs, EntityId id, void* payload);
+
+        template<typename CompType>
+        static void ReleasePayload(void* payload);
+
+    private:
+        static constexpr std::size_t arenaBlockSize = 16 * 1024;
+
+        std::uint32_t index = 0;
+        std::uint32_t sequence = 0;
+        std::vector<Command> commands;
+
+        // ids of created entities, indexed by DeferredEntity::index
+        std::vector<EntityId> created;
+        std::uint32_t createCount = 0;
+
+        std::vector<std::unique_ptr<unsigned char[]>> blocks;
+        std::vector<std::size_t> blockSizes;
+        std::size_t blockIndex = 0;
+        std::size_t blockOffset = 0;
+    };
+
+    // prefab -------------------------------------------------------------
+
+    /*
+    * set of component values stamped onto new entities by EcsInstance::PrefabInstantiate.
+    * independent of any instance, so one prefab can be used with several of them
+    */
+    class Prefab
+    {
+        friend class EcsInstance;
+
+    public:
+        // sets the value of a component, replacing the previous value of the same type
+        template<typename CompType>
+        Prefab& Set(CompType value);
+
+        // returns the number of components in the prefab
+        std::size_t Size() const;
+
+    private:
+        struct Entry
+        {
+            std::size_t slot = 0;
+            std::shared_ptr<void> value;
+            StatusCode(*add)(EcsInstance& ecs, Span<const EntityId> ids, const void* value) = nullptr;
+        };
+
+    private:
+        std::vector<Entry> entries;
+    };
+
+    // observers -------------------------------------------------------------
+
+    // event raised when the component is added to an entity, see EcsInstance::ObserverRegister
+    template<typename CompType>
+    struct OnAdd {};
+
+    // event raised when the component is removed from an entity, or the entity is destroyed
+    template<typename CompType>
+    struct OnRemove {};
+
+    // called with all entities an event was raised for since the previous flush
+    using ObserverFunc = std::function<void(EcsInstance& ecs, Span<const EntityId> entities)>;
+
+    namespace detail
+    {
+        template<typename Event>
+        struct ObserverEvent;
+
+        template<typename CompType>
+        struct ObserverEvent<OnAdd<CompType>>
+        {
+            using Component = CompType;
+            static constexpr bool add = true;
+        };
+
+        template<typename CompType>
+        struct ObserverEvent<OnRemove<CompType>>
+        {
+            using Component = CompType;
+            static constexpr bool add = false;
+        };
+    }
+
+    // system sorting -------------------------------------------------------------
+
+    // returns the key a system orders an entity by, see SystemSortBy
+    using SortKeyFunc = std::function<std::uint64_t(EcsInstance& ecs, EntityId id)>;
+
+    namespace detail
+    {
+        using SortItem = std::pair<std::uint64_t, EntityId>;
+
+        /*
+        * stable radix sort of items by key, one pass per byte,
+        * skipping the bytes all keys share. scratch is resized to the size of items
+        */
+        inline void SortByKey(std::vector<SortItem>& items, std::vector<SortItem>& scratch)
+        {
+            if (items.size() < 2)
+                return;
+
+            std::array<std::array<std::size_t, 256>, 8> counts{};
+            for (const SortItem& item : items)
+            {
+                for (std::size_t byte = 0; byte < 8; ++byte)
+                    ++counts[byte][(item.first >> (byte * 8)) & 0xff];
+            }
+
+            scratch.resize(items.size());
+            for (std::size_t byte = 0; byte < 8; ++byte)
+            {
+                std::array<std::size_t, 256>& offsets = counts[byte];
+                if (offsets[(items[0].first >> (byte * 8)) & 0xff] == items.size())
+                    continue;
+
+                std::size_t offset = 0;
+                for (std::size_t& count : offsets)
+                {
+                    const std::size_t size = count;
+                    count = offset;
+                    offset += size;
+                }
+                for (const SortItem& item : items)
+                    scratch[offsets[(item.first >> (byte * 8)) & 0xff]++] = item;
+                items.swap(scratch);
+            }
+        }
+    }
+
+    // profiling -------------------------------------------------------------
+
+#if defined(PICO_ECS_CPP_PROFILING)
+
+    // timing over the most recent frames, in milliseconds
+    struct ProfileStats
+    {
+        double lastMs = 0.0;
+        double minMs = 0.0;
+        double meanMs = 0.0;
+        double p99Ms = 0.0;
+        int sampleCount = 0;
+    };
+
+    struct SystemProfile
+    {
+        std::string_view name;
+        SystemHandle handle;
+
+        // number of entities passed to the system on its last run
+        int entityCount = 0;
+
+        // time spent in the system
+        ProfileStats time;
+
+        // time spent by pico_ecs after the system returns, mostly draining its destroy and remove queues
+        ProfileStats queueTime;
+    };
+
+    namespace detail
+    {
+        // rolling window of the most recent samples
+        class ProfileWindow
+        {
+        public:
+            static constexpr std::size_t capacity = 128;
+
+            void Add(double ms);
+            ProfileStats GetStats() const;
+            void Clear();
+
+        private:
+            std::array<double, capacity> samples{};
+            std::size_t count = 0;
+            std::size_t next = 0;
+            double last = 0.0;
+        };
+
+        // nanoseconds since the first call, shared by all instances
+        inline std::int64_t ProfileNow()
+        {
+            static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+        }
+    }
+
+#endif
+
+    // ecs instance -------------------------------------------------------------
+
+    class EcsInstance
+    {
+        template<typename ... CompTypes>
+        friend class View;
+        friend class Prefab;
+
+    public:
+        EcsInstance() = default;
+        ~EcsInstance();
+
+        // systems keep a pointer to their instance, so it can be neither copied nor moved
+        EcsInstance(const EcsInstance&) = delete;
+        EcsInstance& operator=(const EcsInstance&) = delete;
+
+        // initializes an ecs instance
+        EcsInstance(int entityCount, Allocator* allocator = nullptr, StorageBackend backend = StorageBackend::ComponentArrays);
+
+        /*
+        * initializes an ecs instance.
+        * if allocator is not null, all pico_ecs storage of the instance is allocated from it,
+        * and it must outlive the instance.
+        * backend decides where dense components are stored, see StorageBackend
+        */
+        StatusCode Init(int entityCount, Allocator* allocator = nullptr, StorageBackend backend = StorageBackend::ComponentArrays);
+
+        // destroys an ecs instance
+        StatusCode Destroy();
+
+        // removes all entities from the ecs, preserving systems and components
+        StatusCode Reset();
+
+        // updates all systems, should be called once per frame
+        StatusCode Update(EcsDt dt = 0.0f);
+
+        /*
+        * sets the number of threads used by Update, including the calling thread.
+        * with more than one thread, systems that declared their component access
+        * run concurrently as long as they don't write components used by each other.
+        * systems without declared access run alone, and conflicting systems
+        * keep their registration order.
+        * systems running concurrently must not change entity structure,
+        * other than through command buffers, EntityQueueDestroy and EntityQueueRemoveComponent
+        */
+        StatusCode SetThreadCount(unsigned count);
+
+        // returns pointer to the base ecs instance
+        Ecs* GetInstance() const;
+
+        // returns allocation counters of pico_ecs storage since Init
+        MemoryStats GetMemoryStats() const;
+
+        /*
+        * calls func(EntityId* chunk, int chunkCount) for consecutive chunks of the entity array,
+        * in parallel on the thread pool set up by SetThreadCount
+        */
+        template<typename Func>
+        void ParallelFor(EntityId* entities, int entityCount, const ParallelOptions& options, Func&& func);
+
+        /*
+        * computes map(EntityId* chunk, int chunkCount) for every chunk in parallel,
+        * and folds the results into init with merge(T, T).
+        * with deterministicMerge, results are merged in chunk order,
+        * so the result doesn't depend on the number of threads or their timing
+        */
+        template<typename T, typename MapFunc, typename MergeFunc>
+        T ParallelReduce(EntityId* entities, int entityCount, const ParallelOptions& options,
+            T init, MapFunc&& map, MergeFunc&& merge);
+
+        /*
+        * returns the command buffer of the calling thread.
+        * threads outside of the thread pool share one buffer
+        */
+        CommandBuffer& GetCommandBuffer();
+
+        // plays back all recorded commands, also done at the end of Update
+        StatusCode FlushCommandBuffers();
+
+    public:
+
+        /*
+        * registers an observer of OnAdd<CompType> or OnRemove<CompType> events.
+        * events are buffered and every observer gets them as one span per ObserverFlush.
+        * removals are delivered before additions, and a component added and removed
+        * between two flushes is not reported. the entities of removals may be destroyed,
+        * queued removals and destructions are reported when they are queued.
+        * events are raised by the wrapper, so observers take no pico_ecs system
+        * and only see changes made after they were registered
+        */
+        template<typename Event, typename Func>
+        StatusCode ObserverRegister(Func&& func);
+
+        /*
+        * delivers buffered events, also done at the end of Update after the command buffers.
+        * events raised by observers are delivered in the same call
+        */
+        StatusCode ObserverFlush();
+
+    public:
+
+        /*
+        * returns a view over the entities with all components of With<...> and none of Without<...>,
+        * e.g. Query<With<Transform>, Without<Name>>(). the view holds the components of With<...>, except tags.
+        * the first call for a signature collects the matching entities, after that the wrapper keeps them up to date
+        * as components are added and removed, so a call costs as much as the matches.
+        * queries take no pico_ecs system, every query adds a check of the entity to adding or removing its components.
+        * removals queued with EntityQueueRemoveComponent are applied once pico_ecs carried them out.
+        * like views passed to systems, the view is invalidated by adding or removing components,
+        * and by creating or destroying entities
+        */
+        template<typename ... Signature>
+        detail::SignatureView<Signature...> Query();
+
+    public:
+
+        /*
+        * sets the resource of type T, a value the instance holds at most one of, e.g. time, config or a spatial grid.
+        * constructs it from args, replacing the previous value, and returns it.
+        * resources are found by type slot without hashing, so systems can get them on every run,
+        * also concurrently, as long as no resource is set or removed meanwhile.
+        * they are kept by Reset and copied by CloneInto
+        */
+        template<typename T, typename ... Args>
+        T* SetResource(Args&& ... args);
+
+        // returns the resource of type T, nullptr if it isn't set
+        template<typename T>
+        T* GetResource();
+
+        template<typename T>
+        const T* GetResource() const;
+
+        // checks if the resource of type T is set
+        template<typename T>
+        bool HasResource() const;
+
+        // destroys the resource of type T
+        template<typename T>
+        StatusCode RemoveResource();
+
+        /*
+        * includes a resource in snapshots under a name that stays the same across builds.
+        * trivially copyable resources are stored raw, other resources need a serializer and a deserializer.
+        * loading a snapshot sets the resources it holds and keeps the others
+        */
+        template<typename T>
+        StatusCode SetResourceSerialization(
+            std::string_view stableName,
+            ComponentSerializer<T> serialize = nullptr,
+            ComponentDeserializer<T> deserialize = nullptr);
+
+#if defined(PICO_ECS_CPP_PROFILING)
+    public:
+
+        // timing of every system over the most recent frames, in registration order
+        std::vector<SystemProfile> ProfileGetSystems() const;
+
+        // timing of whole Update calls
+        ProfileStats ProfileGetUpdate() const;
+
+        // timing of command buffer playback at the end of Update
+        ProfileStats ProfileGetFlush() const;
+
+        /*
+        * writes the most recent events in the Chrome trace_event format,
+        * viewable in chrome://tracing or Perfetto
+        */
+        StatusCode ProfileWriteTrace(std::string_view path) const;
+
+        // clears all timing and recorded events
+        void ProfileClear();
+#endif
+
+    public:
+
+        // creates a new entity, returns its id
+        EntityId EntityCreate();
+
+        // creates count entities, writes their ids into out
+        StatusCode EntityCreateBatch(int count, Span<EntityId> out);
+
+        // checks if entity is currently active
+        bool EntityIsReady(EntityId id) const;
+
+        // destroys entity
+        StatusCode EntityDestroy(EntityId id);
+
+        // id that Compact maps the ids of dead entities to
+        static constexpr EntityId invalidEntity = std::numeric_limits<EntityId>::max();
+
+        /*
+        * renumbers the live entities to ids 0 to their count, keeping their order, and moves their components along.
+        * translation[oldId] receives the new id of every entity, invalidEntity for ids that weren't live,
+        * ids stored outside the instance or inside components have to be remapped through it.
+        * pending observer events are flushed first, the renumbering raises none,
+        * but systems with added and removed callbacks see each moved entity leave and join.
+        * must not be called during Update
+        */
+        StatusCode Compact(std::vector<EntityId>& translation);
+
+        // checks if entity has specified component
+        template<typename CompType>
+        bool EntityHasComponent(EntityId id);
+
+        /*
+        * gets a pointer to the instance of specified component held by the entity.
+        * marks the component as changed, see SystemChanged
+        */
+        template<typename CompType>
+        CompType* EntityGetComponent(EntityId id);
+
+        // gets a pointer to the component held by the entity without marking it as changed
+        template<typename CompType>
+        const CompType* EntityReadComponent(EntityId id) const;
+
+        // marks the component as changed, for writes through component columns or raw pointers
+        template<typename CompType>
+        StatusCode EntityMarkChanged(EntityId id);
+
+        /*
+        * adds a component to the entity, returns pointer to added component.
+        * args are passed to the constructor the component was registered with,
+        * without one, args point to a CompType the component is copied from
+        */
+        template<typename CompType>
+        CompType* EntityAddComponent(EntityId id, void* args = nullptr);
+
+        /*
+        * adds a component constructed in place from args, returns pointer to added component.
+        * components registered with their own constructor get a temporary constructed from args
+        */
+        template<typename CompType, typename ... Args>
+        CompType* EntityEmplaceComponent(EntityId id, Args&& ... args);
+
+        /*
+        * adds a component to every entity in ids, values[i] is used as args for ids[i].
+        * the component id is resolved once for the whole batch.
+        * components registered without a constructor are copied from values
+        * in one contiguous pass after all of them are added
+        */
+        template<typename CompType>
+        StatusCode EntityAddComponentBatch(Span<const EntityId> ids, Span<const CompType> values);
+
+        /*
+        * creates count entities with the components of the prefab, writes their ids into out if it's not empty.
+        * every component is added to all entities at once, trivially copyable components
+        * registered without a constructor are copied in bulk, the rest are passed as args to their constructor
+        */
+        StatusCode PrefabInstantiate(const Prefab& prefab, int count, Span<EntityId> out = Span<EntityId>());
+
+        // removes specified component from the entity
+        template<typename CompType>
+        StatusCode EntityRemoveComponent(EntityId id);
+
+        /*
+        * queues an entity for destruction at the end of system execution
+        * queued entities are destroyed after the curent iteration,
+        * or once all systems returned while systems run concurrently
+        */
+        StatusCode EntityQueueDestroy(EntityId id);
+
+        /*
+        * queues a component for removable
+        * queued entity/component pairs that will be deleted after the current system returns,
+        * or once all systems returned while systems run concurrently
+        */
+        template<typename CompType>
+        StatusCode EntityQueueRemoveComponent(EntityId id);
+
+    public:
+
+        /*
+        * registers a single component with optional constructor and destructor.
+        * without either of them, components that are not trivially copyable get
+        * generated ones, which construct, copy, move and destroy them properly.
+        * pico_ecs grows its storage with realloc, so such components must stay valid
+        * when moved bitwise, or the instance must be created with enough entities.
+        * a constructor is called by the instance, not by pico_ecs directly,
+        * so components that have one must be added through the instance
+        */
+        template<typename CompType>
+        StatusCode ComponentRegister(ComponentCtor ctor = nullptr, ComponentDtor dtor = nullptr);
+
+        /*
+        * registers a single component with a storage policy, see above.
+        * sparse components only take memory for the entities that have them,
+        * at the cost of a lookup on every access. they can't be used in change filters
+        * or with ComponentColumn, ComponentGather and ComponentScatter.
+        * the ones with generated constructors are moved with their move constructor.
+        * sparse and chunked storage aligns components to alignof(std::max_align_t), more is rejected
+        */
+        template<typename CompType>
+        StatusCode ComponentRegister(ComponentStorage storage, ComponentCtor ctor = nullptr, ComponentDtor dtor = nullptr);
+
+        /*
+        * returns the raw storage of a trivially copyable component as a span indexed by entity id,
+        * covering ids up to the highest one in entities. every entity in entities must have the component.
+        * slots of other entities hold unspecified data, and the span is invalidated
+        * by creating entities or adding components
+        */
+        template<typename CompType>
+        Span<CompType> ComponentColumn(Span<const EntityId> entities);
+
+        // copies the component of every entity into out, packed in the order of entities
+        template<typename CompType>
+        StatusCode ComponentGather(Span<const EntityId> entities, Span<CompType> out);
+
+        // copies values back into the component of every entity, in the order of entities
+        template<typename CompType>
+        StatusCode ComponentScatter(Span<const EntityId> entities, Span<const CompType> values);
+
+        /*
+        * includes a component in snapshots under a name that stays the same across builds.
+        * trivially copyable components are stored as raw columns,
+        * other components need a serializer and a deserializer
+        */
+        template<typename CompType>
+        StatusCode ComponentSetSerialization(
+            std::string_view stableName,
+            ComponentSerializer<CompType> serialize = nullptr,
+            ComponentDeserializer<CompType> deserialize = nullptr);
+
+    public:
+
+        /*
+        * writes all entities and their components set up with ComponentSetSerialization to a file,
+        * along with the resources set up with SetResourceSerialization.
+        * other components and resources, systems and pending commands are not saved
+        */
+        StatusCode SaveSnapshot(std::string_view path);
+
+        /*
+        * replaces all entities with the ones from a snapshot, keeping their ids.
+        * every component in the snapshot must be set up with ComponentSetSerialization under the same name.
+        * the file is memory mapped and raw columns are copied out of it, one copy per column in pico_ecs storage,
+        * without running component constructors. nothing refers to the file once loaded.
+        * the snapshot is validated before the instance is touched,
+        * if a deserializer fails afterwards the instance is left partially loaded
+        */
+        StatusCode LoadSnapshot(std::string_view path);
+
+        /*
+        * makes dst a copy of this instance: the same entity ids, and the same components with copied values.
+        * dst must have the same components registered, or none, in which case the registrations are copied.
+        * trivially copyable components are copied in bulk, others through their copy constructor,
+        * so components that aren't trivially copyable must be copy constructible. registered constructors aren't run.
+        * resources are copied too, and dst loses the ones this instance doesn't have.
+        * systems and pending commands are not copied, systems of dst see entities enter and leave as usual.
+        * cheapest when dst already holds a similar state, e.g. a frame or two older
+        */
+        StatusCode CloneInto(EcsInstance& dst) const;
+
+    public:
+
+        /*
+        * registers a system with optional added/removed callbacks.
+        * if handle is not null, it receives the handle of the system
+        */
+        StatusCode SystemRegister(
+            std::string_view name,
+            SystemFunc func, 
+            SystemAddedCb add = nullptr, 
+            SystemRemovedCb rem = nullptr,
+            SystemHandle* handle = nullptr);
+
+        /*
+        * registers a lambda or functor as a system, along with its signature.
+        * signature is a list of Require<...> and Exclude<...> entries.
+        * the callable is invoked with one of:
+        *   (View<required components...>, EcsDt)
+        *   (EcsInstance&, EntityId* entities, int entityCount, EcsDt)
+        *   (Ecs*, EntityId* entities, int entityCount, EcsDt, void* udata)
+        * and may return void or a ReturnCode.
+        * Read<...> and Write<...> entries declare component access for parallel updates.
+        * Changed<...> entries limit the system to entities whose components changed, see SystemChanged.
+        * if handle is not null, it receives the handle of the system
+        */
+        template<typename ... Signature, typename Func>
+        StatusCode SystemRegister(std::string_view name, Func&& func, SystemHandle* handle = nullptr);
+
+        /*
+        * registers a system whose entities are split into chunks processed in parallel,
+        * the function is called once per chunk with a part of the entity array.
+        * with no thread pool, chunks are processed on the calling thread
+        */
+        StatusCode SystemRegister(
+            std::string_view name,
+            SystemFunc func,
+            const ParallelOptions& parallel,
+            SystemHandle* handle = nullptr);
+
+        // registers a callable system processed in parallel chunks, see above
+        template<typename ... Signature, typename Func>
+        StatusCode SystemRegister(std::string_view name, Func&& func, const ParallelOptions& parallel, SystemHandle* handle = nullptr);
+
+        // returns the handle of a system, invalid handle if no system has the name
+        SystemHandle SystemGetHandle(std::string_view sysName) const;
+
+        // determines which components are available to the specified system
+        template<typename CompType>
+        StatusCode SystemRequire(SystemHandle sys);
+
+        template<typename CompType>
+        StatusCode SystemRequire(std::string_view sysName);
+
+        // excludes entities that have specified component from the system
+        template<typename CompType>
+        StatusCode SystemExclude(SystemHandle sys);
+
+        template<typename CompType>
+        StatusCode SystemExclude(std::string_view sysName);
+
+        // declares that the system reads specified component, see SetThreadCount
+        template<typename CompType>
+        StatusCode SystemRead(SystemHandle sys);
+
+        template<typename CompType>
+        StatusCode SystemRead(std::string_view sysName);
+
+        // declares that the system writes specified component, see SetThreadCount
+        template<typename CompType>
+        StatusCode SystemWrite(SystemHandle sys);
+
+        template<typename CompType>
+        StatusCode SystemWrite(std::string_view sysName);
+
+        /*
+        * makes the system run only on entities for which specified component changed since its previous run,
+        * with several components, on entities for which any of them changed. the component is required.
+        * changes are tracked from this call on, components entities already have count as changed.
+        * adding the component, EntityGetComponent, EntityMarkChanged and views with non-const access mark it
+        */
+        template<typename CompType>
+        StatusCode SystemChanged(SystemHandle sys);
+
+        template<typename CompType>
+        StatusCode SystemChanged(std::string_view sysName);
+
+        /*
+        * sorts the entities of a system by key before every run, lower keys first,
+        * e.g. by spatial cell so neighbouring entities are processed together.
+        * entities with equal keys keep the order pico_ecs lists them in, an empty key stops sorting
+        */
+        StatusCode SystemSortBy(SystemHandle sys, SortKeyFunc key);
+        StatusCode SystemSortBy(std::string_view sysName, SortKeyFunc key);
+
+        // moves a system to a phase, systems are in SystemPhase::Update by default
+        StatusCode SystemSetPhase(SystemHandle sys, SystemPhase phase);
+        StatusCode SystemSetPhase(std::string_view sysName, SystemPhase phase);
+
+        /*
+        * sets how often a system runs within Update, systems run every frame by default.
+        * time sliced systems only get part of their entities, so changes outside it are missed by their change filters
+        */
+        StatusCode SystemSetRate(SystemHandle sys, const SystemRate& rate);
+        StatusCode SystemSetRate(std::string_view sysName, const SystemRate& rate);
+
+        // enables a system
+        StatusCode SystemEnable(SystemHandle sys);
+        StatusCode SystemEnable(std::string_view sysName);
+
+        // disables a system
+        StatusCode SystemDisable(SystemHandle sys);
+        StatusCode SystemDisable(std::string_view sysName);
+
+    private:
+        struct ComponentRecord
+        {
+            ComponentId id = 0;
+            bool registered = false;
+            ComponentCtor ctor = nullptr;
+            ComponentDtor dtor = nullptr;
+
+            // ctor and dtor were generated, ctor takes ComponentInit as args
+            bool managed = false;
+
+            // set by ComponentSetSerialization, columns are copied raw if save is empty
+            std::string stableName;
+            std::size_t size = 0;
+            std::function<void(EcsInstance& ecs, EntityId id, std::string& out)> save;
+            std::function<bool(EcsInstance& ecs, EntityId id, std::string_view data)> load;
+
+            /*
+            * used by CloneInto, copy is set for components that are copy constructible.
+            * it copy constructs ctx into a blank component, whatever args the constructor takes
+            */
+            bool trivial = false;
+            void(*copy)(void* ptr, void* ctx) = nullptr;
+
+            // moves managed sparse components when their storage grows or is compacted
+            void(*relocate)(void* dst, void* src) = nullptr;
+
+            // used by Compact, set for components that are move constructible, moves ctx into a blank component
+            void(*move)(void* ptr, void* ctx) = nullptr;
+
+            // not known to pico_ecs, id indexes tagBits
+            bool tag = false;
+
+            // not known to pico_ecs either, id indexes tagBits and sparseColumns
+            bool sparse = false;
+
+            // kept in archetype chunks, id indexes tagBits and chunkedComponents
+            bool chunked = false;
+
+            // membership is kept in tagBits instead of pico_ecs
+            bool InTagBits() const { return tag || sparse || chunked; }
+        };
+
+        // args of a generated constructor, construct is called with the storage slot and ctx
+        struct ComponentInit
+        {
+            void(*construct)(void* ptr, void* ctx) = nullptr;
+            void* ctx = nullptr;
+        };
+
+        /*
+        * args pico_ecs passes to components registered with their own constructor,
+        * which is not called without them
+        */
+        struct ComponentCtorArgs
+        {
+            ComponentCtor ctor = nullptr;
+            void* args = nullptr;
+        };
+
+        // returns the record of a registered component, nullptr otherwise
+        template<typename CompType>
+        const ComponentRecord* FindComponent() const;
+
+        /*
+        * returns the address of the storage slot of entity 0 for specified component,
+        * resolved through an entity that has the component.
+        * pico_ecs keeps one array per component indexed by entity id,
+        * so the slot of any entity is base + id * sizeof(CompType)
+        */
+        template<typename CompType>
+        char* ComponentStorageBase(EntityId id);
+
+        /*
+        * adds a component to every entity, values are either one per entity,
+        * or a single value shared by all of them
+        */
+        template<typename CompType>
+        StatusCode ComponentAddBatch(const ComponentRecord& comp, Span<const EntityId> ids, Span<const CompType> values);
+
+        template<typename CompType>
+        static StatusCode PrefabAdd(EcsInstance& ecs, Span<const EntityId> ids, const void* value);
+
+        // adds a managed component, destroying the previous one if the entity already has it
+        void ComponentAddManaged(const ComponentRecord& comp, EntityId id, const ComponentInit* init);
+
+        // add, get and check a component like ecs_add, ecs_get and ecs_has, in pico_ecs, sparse or chunked storage
+        void* ComponentAddRaw(const ComponentRecord& comp, EntityId id, void* args);
+        void* ComponentGetRaw(const ComponentRecord& comp, EntityId id) const;
+
+        // adds a zeroed component without running its constructor, the caller copies or constructs the value into it
+        void* ComponentAddBlank(const ComponentRecord& comp, EntityId id);
+
+        // registers a component that isn't kept in tagBits with pico_ecs, returns its id
+        ComponentId ComponentRegisterRaw(const ComponentRecord& comp);
+        bool ComponentHasRaw(const ComponentRecord& comp, EntityId id) const;
+
+        // removes a component like ecs_remove, in pico_ecs, sparse or chunked storage
+        void ComponentRemoveRaw(const ComponentRecord& comp, EntityId id);
+
+        // ecs_add and ecs_remove, raising the events of observed components and updating queries
+        void* PicoAdd(const ComponentRecord& comp, EntityId id, void* args);
+        void PicoRemove(const ComponentRecord& comp, EntityId id);
+
+        // destroys managed components of all entities, pico_ecs doesn't run destructors on reset and free
+        void ComponentDestroyAll();
+
+        /*
+        * makes exactly the ids below count whose bit is set in live, one bit per id, live.
+        * compares 64 ids at a time with liveBits, so only entities whose liveness differs are created or destroyed
+        */
+        void EntityMatchLiveness(EntityId count, const std::vector<std::uint64_t>& live);
+
+        // sets the bit of an entity in liveBits
+        void LiveSet(EntityId id, bool live);
+
+        // clears the bits of entities pico_ecs destroyed since they were queued
+        void LiveSync();
+
+        // copies liveBits into out, without the entities pico_ecs destroyed since they were queued
+        void LiveGather(std::vector<std::uint64_t>& out) const;
+
+        // moves the components of an entity to a lower id that has none, Compact drops the observer events it raises
+        void EntityRenumber(EntityId from, EntityId to);
+
+        // checks if both instances have the same components registered under the same ids
+        bool ComponentLayoutMatches(const EcsInstance& other) const;
+
+        // id used to declare access, tags don't share ids with pico_ecs components
+        static ComponentId ComponentAccessId(const ComponentRecord& comp);
+
+        template<typename CompType>
+        static void ComponentConstructThunk(Ecs* ecs, EntityId id, void* ptr, void* args);
+
+        template<typename CompType>
+        static void ComponentDestroyThunk(Ecs* ecs, EntityId id, void* ptr);
+
+        // calls the constructor in ComponentCtorArgs
+        static void ComponentCtorThunk(Ecs* ecs, EntityId id, void* ptr, void* args);
+
+        template<typename CompType>
+        static void ComponentCopy(void* ptr, void* ctx);
+
+        template<typename CompType>
+        static void ComponentRelocate(void* dst, void* src);
+
+        template<typename CompType>
+        static void ComponentMove(void* ptr, void* ctx);
+
+    private:
+        /*
+        * every system is registered with pico_ecs through SystemTrampoline,
+        * with its record as user data
+        */
+        struct SystemRecord
+        {
+            ~SystemRecord();
+
+            EcsInstance* owner = nullptr;
+            SystemId id = 0;
+            std::string name;
+
+            // function systems
+            SystemFunc func = nullptr;
+            SystemAddedCb added = nullptr;
+            SystemRemovedCb removed = nullptr;
+
+            // callable systems
+            void* callable = nullptr;
+            ReturnCode(*invoke)(void* callable, EcsInstance& ecs, EntityId* entities, int entityCount, EcsDt dt) = nullptr;
+            void(*release)(void* callable) = nullptr;
+
+            /*
+            * entities matching the system, in the order pico_ecs keeps them.
+            * parallel updates run the system over this list, as pico_ecs can't be entered from several threads
+            */
+            std::vector<EntityId> members;
+            std::vector<std::size_t> memberSlots;
+            bool enabled = true;
+
+            // chunked execution
+            bool parallel = false;
+            ParallelOptions parallelOptions;
+
+            // declared component access, used by the parallel scheduler
+            bool accessDeclared = false;
+            std::vector<ComponentId> reads;
+            std::vector<ComponentId> writes;
+
+            // tags are unknown to pico_ecs, so entities are filtered against them before every run
+            std::vector<ComponentId> tagRequire;
+            std::vector<ComponentId> tagExclude;
+            std::vector<EntityId> tagEntities;
+            bool requiresComponents = false;
+            std::vector<ComponentId> excludes;
+
+            // chunked components among the tags, and the archetypes matching them out of the first archetypesSeen
+            std::vector<ComponentId> chunkRequire;
+            std::vector<ComponentId> chunkExclude;
+            std::vector<std::uint32_t> archetypes;
+            std::size_t archetypesSeen = 0;
+
+            // change filter, changedEntities holds the filtered entities during a run
+            std::vector<ComponentId> changed;
+            std::vector<EntityId> changedEntities;
+            std::uint32_t lastRunTick = 0;
+
+            // set by SystemSortBy, sortedEntities holds the sorted entities during a run
+            SortKeyFunc sortKey;
+            std::vector<detail::SortItem> sortKeys;
+            std::vector<detail::SortItem> sortScratch;
+            std::vector<EntityId> sortedEntities;
+
+            // set by SystemSetPhase and SystemSetRate
+            SystemPhase phase = SystemPhase::Update;
+            SystemRate rate;
+
+            /*
+            * rate state. rateTime is the time accumulated for fixed step and every n frames,
+            * rateFrame counts Updates, sliceTimes holds the dt of the last frames Updates,
+            * sliceCursor is where the next slice of entities starts
+            */
+            EcsDt rateTime = 0;
+            int rateFrame = 0;
+            std::vector<EcsDt> sliceTimes;
+            int sliceCursor = 0;
+
+#if defined(PICO_ECS_CPP_PROFILING)
+            // written only by the thread running the system
+            bool profileRan = false;
+            std::int64_t profileRunNs = 0;
+            int profileEntityCount = 0;
+            detail::ProfileWindow profileTime;
+            detail::ProfileWindow profileQueueTime;
+#endif
+        };
+
+        // node of the system dependency graph, indexed by SystemId
+        struct ScheduleNode
+        {
+            int dependencies = 0;
+            std::vector<SystemId> successors;
+        };
+
+        // declares component access of a system
+        void SystemDeclareAccess(SystemId sys, ComponentId comp, bool write);
+
+        // checks if two systems can't run at the same time
+        bool SystemsConflict(const SystemRecord& first, const SystemRecord& second) const;
+
+        // builds dependency graph, earlier systems precede later conflicting ones
+        void ScheduleBuild();
+
+        // runs all systems through the thread pool
+        StatusCode UpdateParallel(EcsDt dt);
+
+        // runs a system, then releases the systems that depend on it
+        void ScheduleRun(SystemId sys);
+
+        // applies the destroys and removals queued while systems ran concurrently
+        void DeferredQueueFlush();
+
+        // runs a system through pico_ecs
+        ReturnCode SystemUpdate(SystemId sys, EcsDt dt);
+        ReturnCode SystemDispatch(SystemId sys, EcsDt dt);
+
+        // runs a system as often as its rate says for an Update of dt
+        ReturnCode SystemTick(SystemId sys, EcsDt dt);
+
+        // runs all systems one by one, phase by phase
+        StatusCode UpdateInOrder(EcsDt dt);
+
+        // registers the record of a system with pico_ecs
+        StatusCode SystemRegisterRecord(std::string_view name, std::unique_ptr<SystemRecord> record, SystemHandle* handle);
+
+        // returns the handle of a system, reports an error if no system has the name
+        SystemHandle SystemFind(std::string_view sysName) const;
+
+        // checks that the handle refers to a system of this instance, reports an error otherwise
+        bool SystemIsRegistered(SystemHandle sys) const;
+
+        template<typename ... Signature, typename Func>
+        StatusCode SystemRegisterCallable(std::string_view name, Func&& func, const ParallelOptions* parallel, SystemHandle* handle);
+
+        // runs the system, in chunks if it was registered as parallel
+        ReturnCode SystemRun(SystemRecord& record, EntityId* entities, int entityCount, EcsDt dt);
+
+        // runs the system through its function or callable
+        ReturnCode SystemInvokeRecord(SystemRecord& record, EntityId* entities, int entityCount, EcsDt dt);
+
+        // orders the entities of a run by the sort key of the system
+        Span<EntityId> SystemSort(SystemRecord& record, EntityId* entities, int entityCount);
+
+        /*
+        * calls func(int chunkIndex, int begin, int count) for every chunk of count elements,
+        * on the thread pool if there is more than one chunk
+        */
+        template<typename Func>
+        void ParallelChunks(int count, const ParallelOptions& options, Func&& func);
+
+        // returns the number of elements per chunk
+        static int ParallelChunkSize(const ParallelOptions& options);
+
+        static ReturnCode SystemTrampoline(Ecs* ecs, EntityId* entities, int entityCount, EcsDt dt, void* udata);
+        static void SystemAddedTrampoline(Ecs* ecs, EntityId id, void* udata);
+        static void SystemRemovedTrampoline(Ecs* ecs, EntityId id, void* udata);
+
+        template<typename Func, typename ... Signature>
+        static ReturnCode SystemInvoke(void* callable, EcsInstance& ecs, EntityId* entities, int entityCount, EcsDt dt);
+
+        template<typename Func>
+        static void SystemRelease(void* callable);
+
+        template<typename ... CompTypes>
+        bool SignatureRegistered(Require<CompTypes...>) const;
+
+        template<typename ... CompTypes>
+        bool SignatureRegistered(Exclude<CompTypes...>) const;
+
+        template<typename ... CompTypes>
+        void SignatureApply(SystemId sys, Require<CompTypes...>);
+
+        template<typename ... CompTypes>
+        void SignatureApply(SystemId sys, Exclude<CompTypes...>);
+
+        template<typename ... CompTypes>
+        bool SignatureRegistered(Read<CompTypes...>) const;
+
+        template<typename ... CompTypes>
+        bool SignatureRegistered(Write<CompTypes...>) const;
+
+        template<typename ... CompTypes>
+        void SignatureApply(SystemId sys, Read<CompTypes...>);
+
+        template<typename ... CompTypes>
+        void SignatureApply(SystemId sys, Write<CompTypes...>);
+
+        template<typename ... CompTypes>
+        bool SignatureRegistered(Changed<CompTypes...>) const;
+
+        template<typename ... CompTypes>
+        void SignatureApply(SystemId sys, Changed<CompTypes...>);
+
+    private:
+        /*
+        * buffered events of an observed component, raised wherever the wrapper
+        * adds, removes or destroys, see PicoAdd and PicoRemove
+        */
+        struct ObserverColumn
+        {
+            std::vector<ObserverFunc> onAdd;
+            std::vector<ObserverFunc> onRemove;
+
+            // pending events per entity id, lets a removal cancel an addition of the same flush
+            std::vector<std::uint8_t> pending;
+            std::vector<EntityId> added;
+            std::vector<EntityId> removed;
+
+            // events being delivered, observers may raise new ones meanwhile
+            std::vector<EntityId> deliverAdded;
+            std::vector<EntityId> deliverRemoved;
+
+            // observers registered during delivery, appended once it's done so the running ones stay in place
+            bool delivering = false;
+            std::vector<ObserverFunc> registeredAdd;
+            std::vector<ObserverFunc> registeredRemove;
+        };
+
+        static constexpr std::uint8_t observerPendingAdd = 1;
+        static constexpr std::uint8_t observerPendingRemove = 2;
+
+        // returns the events of a component kept by pico_ecs
+        ObserverColumn& ObserverGetColumn(ComponentId comp);
+
+        // returns the events of a tag, raised by TagSet
+        ObserverColumn& ObserverGetTagColumn(ComponentId tag);
+
+        // drops all buffered events, pico_ecs doesn't report entities cleared by a reset
+        void ObserverClear();
+
+        // raises the removal of every observed pico_ecs component an entity has, before it is destroyed
+        void ObserverRaiseDestroyed(EntityId id);
+
+        static void ObserverRaiseAdded(ObserverColumn& column, EntityId id);
+        static void ObserverRaiseRemoved(ObserverColumn& column, EntityId id);
+
+    private:
+        /*
+        * entities matching a query. changes of components pico_ecs knows are reported
+        * by PicoAdd and PicoRemove, changes of the others by TagSet
+        */
+        struct QueryRecord
+        {
+            std::vector<ComponentId> require;
+            std::vector<ComponentId> exclude;
+            std::vector<ComponentId> tagRequire;
+            std::vector<ComponentId> tagExclude;
+
+            std::vector<EntityId> entities;
+
+            // indexed by entity id, position in entities plus one, zero for entities not in the query
+            std::vector<std::uint32_t> slots;
+        };
+
+        // returns the query of a signature, creating it on first use, nullptr on error
+        template<typename ... Signature>
+        QueryRecord* QueryFind();
+
+        template<typename ... CompTypes>
+        void QueryApply(QueryRecord& query, Require<CompTypes...>);
+
+        template<typename ... CompTypes>
+        void QueryApply(QueryRecord& query, Exclude<CompTypes...>);
+
+        // checks the components of an entity against the query
+        bool QueryMatches(const QueryRecord& query, EntityId id) const;
+        bool QueryTagsMatch(const QueryRecord& query, EntityId id) const;
+
+        void QueryInsert(QueryRecord& query, EntityId id);
+        void QueryErase(QueryRecord& query, EntityId id);
+
+        // collects the matching entities again, after changes PicoAdd, PicoRemove and TagSet don't report
+        void QueryPopulate(QueryRecord& query);
+
+        // checks an entity against the given queries, after one of their components changed
+        void QueryRecheck(const std::vector<QueryRecord*>& checked, EntityId id);
+
+        // called by TagSet for components in tagBits
+        void QueryTagChanged(ComponentId tag, EntityId id);
+
+        // called by PicoAdd and PicoRemove for components pico_ecs knows
+        void QueryComponentChanged(ComponentId comp, EntityId id);
+
+        // rechecks the entities of queued removals pico_ecs carried out since they were queued
+        void QuerySync();
+
+        // removes an entity being destroyed, or created with a reused id, from all queries
+        void QueryForget(EntityId id);
+
+    private:
+        // value of a resource and the operations on its type, value is null while the resource isn't set
+        struct ResourceRecord
+        {
+            void* value = nullptr;
+            const char* typeName = nullptr;
+            std::size_t size = 0;
+            void(*dtor)(void* value) = nullptr;
+
+            // copy constructs into uninitialized memory, null for types that aren't copy constructible
+            void(*copy)(void* dst, const void* src) = nullptr;
+
+            // set by SetResourceSerialization, save is null for resources stored raw
+            std::string stableName;
+            std::function<void(const void* value, std::string& out)> save;
+            std::function<bool(EcsInstance& ecs, std::string_view data)> load;
+        };
+
+        // returns the record of a resource type, creating it on first use
+        template<typename T>
+        ResourceRecord& ResourceGetRecord();
+
+        // destroys the value of a resource, if set
+        void ResourceDestroy(ResourceRecord& resource);
+
+        template<typename T>
+        static void ResourceDtor(void* value);
+
+        template<typename T>
+        static void ResourceCopy(void* dst, const void* src);
+
+    private:
+        // per entity ticks of a component, empty ticks of a tracked component are grown with the entities
+        struct ChangeColumn
+        {
+            bool tracked = false;
+            std::vector<std::uint32_t> ticks;
+        };
+
+        // starts tracking changes of a component, components entities already have count as changed
+        void ChangeTrack(ComponentId comp);
+
+        // adds the component to the change filter of a system
+        void ChangeFilterAdd(SystemId sys, ComponentId comp);
+
+        // marks the component of the entity as changed if its changes are tracked
+        void ChangeMark(ComponentId comp, EntityId id);
+
+        // marks tracked components of all entities as changed, after they were replaced wholesale
+        void ChangeMarkAll();
+
+        // grows the ticks of tracked components to cover all entity ids, new ids count as changed like in ChangeTrack
+        void ChangeGrow();
+
+        // returns the tick mutable accesses on the calling thread write
+        std::uint32_t ChangeTickCurrent() const;
+
+        // returns the ticks of a component, empty if its changes are not tracked
+        template<typename CompType>
+        Span<std::uint32_t> ChangeTicks();
+
+        // keeps the entities for which any component of the change filter changed since the previous run
+        Span<EntityId> ChangeFilter(SystemRecord& record, EntityId* entities, int entityCount);
+
+        // marks the component as changed unless it is sparse or chunked, those share ids with tags
+        void ChangeMark(const ComponentRecord& comp, EntityId id);
+
+    private:
+        bool TagHas(ComponentId tag, EntityId id) const;
+
+        // sets or clears the tag of an entity, raising observer events if that changes it
+        void TagSet(ComponentId tag, EntityId id, bool value);
+
+        // returns the shared tag instance if the entity has the tag, reports an error otherwise
+        template<typename CompType>
+        CompType* TagGet(const ComponentRecord& comp, EntityId id) const;
+
+        // raises removal events for the tags of an entity that is being destroyed
+        void TagRaiseRemoved(EntityId id);
+
+        /*
+        * clears the tags left by a destroyed entity and destroys its sparse and chunked components,
+        * pico_ecs destroys queued entities on its own
+        */
+        void TagClearEntity(EntityId id);
+
+        /*
+        * keeps the entities that match the tags required and excluded by the system.
+        * systems that require no other components get all matching entities,
+        * pico_ecs only lists entities that have a component
+        */
+        Span<EntityId> TagFilter(SystemRecord& record, EntityId* entities, int entityCount);
+
+        // requires or excludes a component or tag
+        void SystemRequireComponent(SystemId sys, const ComponentRecord& comp);
+        void SystemExcludeComponent(SystemId sys, const ComponentRecord& comp);
+
+    private:
+        // sparse storage of a component, along with its destructor
+        struct SparseColumn
+        {
+            SparseColumn(std::size_t size, void(*relocate)(void* dst, void* src), ComponentDtor dtor, detail::MemoryContext* memory);
+
+            detail::SparseStorage storage;
+            ComponentDtor dtor = nullptr;
+        };
+
+        // adds a sparse component like ecs_add, the slot is zeroed and passed to ctor along with args
+        void* SparseAdd(const ComponentRecord& comp, EntityId id, ComponentCtor ctor, void* args);
+
+        // destroys the sparse component of the entity if it has one, leaves its bit alone
+        void SparseRemove(ComponentId comp, EntityId id);
+
+        // destroys all sparse components
+        void SparseClear();
+
+        // removes the sparse and chunked components queued by EntityQueueRemoveComponent and EntityQueueDestroy
+        void RemovalQueueFlush();
+
+        // returns the sparse storage of a component, nullptr if it's not sparse
+        template<typename CompType>
+        const detail::SparseStorage* ComponentSparseStorage() const;
+
+        // component kept in archetype chunks, indexed by its id in tagBits
+        struct ChunkedComponent
+        {
+            std::size_t size = 0;
+            void(*relocate)(void* dst, void* src) = nullptr;
+            ComponentDtor dtor = nullptr;
+        };
+
+        // block of archetypeChunkSize bytes, starting with the ids of its entities, followed by a column per component
+        struct ArchetypeChunk
+        {
+            char* data = nullptr;
+            std::uint32_t count = 0;
+        };
+
+        // entities that have exactly the same chunked components, all chunks but the last one are full
+        struct Archetype
+        {
+            // sorted component ids, and the offsets of their columns in a chunk
+            std::vector<ComponentId> comps;
+            std::vector<std::size_t> offsets;
+            std::uint32_t capacity = 0;
+            std::size_t chunkSize = 0;
+            std::vector<ArchetypeChunk> chunks;
+
+            // archetypes with the key component added or removed
+            std::unordered_map<ComponentId, std::uint32_t> edges;
+        };
+
+        // archetype 0 has no components and holds no entities
+        struct EntityLocation
+        {
+            std::uint32_t archetype = 0;
+            std::uint32_t chunk = 0;
+            std::uint32_t row = 0;
+        };
+
+        static constexpr std::size_t archetypeChunkSize = 16 * 1024;
+        static constexpr ComponentId noComponent = std::numeric_limits<ComponentId>::max();
+
+        // returns the archetype with comp added if it doesn't have it, or removed if it does
+        std::uint32_t ArchetypeToggle(std::uint32_t archetype, ComponentId comp);
+
+        // returns the index of the column of comp in the archetype, -1 if it has none
+        static int ArchetypeColumn(const Archetype& archetype, ComponentId comp);
+
+        // adds a chunked component like ecs_add, moving the entity to the archetype with it
+        void* ArchetypeAdd(const ComponentRecord& comp, EntityId id, ComponentCtor ctor, void* args);
+
+        // returns the chunked component of the entity, nullptr if it has none
+        void* ArchetypeGet(ComponentId comp, EntityId id) const;
+
+        // destroys the chunked component of the entity if it has one, moving the entity to the archetype without it
+        void ArchetypeRemove(ComponentId comp, EntityId id);
+
+        // destroys all chunked components of the entity and takes it out of its archetype
+        void ArchetypeRemoveEntity(EntityId id);
+
+        // moves the entity and its components to another archetype, its components missing there must be destroyed already
+        void ArchetypeMove(EntityId id, std::uint32_t target);
+
+        // fills a row left by an entity with the last entity of the archetype
+        void ArchetypeEraseRow(std::uint32_t index, std::uint32_t chunk, std::uint32_t row);
+
+        // destroys all chunked components and frees the chunks, keeping the archetypes
+        void ArchetypeClear();
+
+        // adds the archetypes created since the previous run that match the system
+        void ArchetypeMatch(SystemRecord& record);
+
+        // moves a chunked component into uninitialized memory
+        static void ArchetypeRelocate(const ChunkedComponent& comp, char* dst, char* src);
+
+        // returns the id of a chunked component, noComponent if it's not chunked
+        template<typename CompType>
+        ComponentId ComponentChunkedId() const;
+
+#if defined(PICO_ECS_CPP_PROFILING)
+    private:
+        struct TraceEvent
+        {
+            std::string_view name;
+            const char* category = nullptr;
+            std::int64_t start = 0;
+            std::int64_t duration = 0;
+            unsigned thread = 0;
+            int entityCount = 0;
+        };
+
+        // records the run of a system that started at start
+        void ProfileSystem(SystemRecord& record, std::int64_t start, int entityCount);
+
+        // records an event, overwriting the oldest one once the buffer is full
+        void ProfileTrace(std::string_view name, const char* category, std::int64_t start, std::int64_t end, int entityCount = 0);
+
+        static constexpr std::size_t profileMaxEvents = 1 << 16;
+
+        mutable std::mutex profileMutex;
+        std::vector<TraceEvent> profileEvents;
+        std::size_t profileNextEvent = 0;
+        detail::ProfileWindow profileUpdate;
+        detail::ProfileWindow profileFlush;
+#endif
+
+    private:
+        Ecs* instance = nullptr;
+        detail::MemoryContext memory;
+
+        // indexed by detail::TypeSlot<CompType>()
+        std::vector<ComponentRecord> components;
+        // one past the highest entity id created, bounds the search for managed components
+        EntityId entityHighWater = 0;
+
+        /*
+        * one bit per entity id, set for live entities. pico_ecs destroys queued entities on its own,
+        * so their ids are kept in liveQueued until LiveSync finds them gone
+        */
+        std::vector<std::uint64_t> liveBits;
+        std::vector<EntityId> liveQueued;
+
+        // indexed by ComponentId, the tick is advanced by every system run
+        std::vector<ChangeColumn> changeColumns;
+        std::atomic<std::uint32_t> changeTick{ 0 };
+
+        // indexed by ComponentId, null for components without observers
+        std::vector<std::unique_ptr<ObserverColumn>> observerColumns;
+
+        // indexed by the id of a tag, one bit per entity
+        std::vector<std::vector<std::uint64_t>> tagBits;
+        std::vector<std::unique_ptr<ObserverColumn>> tagObserverColumns;
+
+        // indexed by detail::TypeSlot of the query signature, null for signatures that weren't queried
+        std::vector<std::unique_ptr<QueryRecord>> queryRecords;
+        std::vector<QueryRecord*> queries;
+
+        // indexed by the id of a component in tagBits, queries requiring or excluding it
+        std::vector<std::vector<QueryRecord*>> tagQueries;
+
+        // indexed by the pico_ecs id of a component, queries requiring or excluding it
+        std::vector<std::vector<QueryRecord*>> componentQueries;
+
+        // removals queued with pico_ecs for components with queries, see QuerySync
+        std::vector<std::pair<ComponentId, EntityId>> queryQueued;
+
+        // indexed by detail::TypeSlot<T>()
+        std::vector<ResourceRecord> resources;
+
+        // indexed by the id of a sparse component in tagBits, null for tags
+        std::vector<std::unique_ptr<SparseColumn>> sparseColumns;
+
+        /*
+        * sparse and chunked components removed after the running system returns, like the queues of pico_ecs.
+        * removalQueueAll stands for all such components of a destroyed entity
+        */
+        std::vector<std::pair<ComponentId, EntityId>> removalQueue;
+        static constexpr ComponentId removalQueueAll = std::numeric_limits<ComponentId>::max();
+
+        // indexed by the id of a chunked component in tagBits, zero size for other ids
+        std::vector<ChunkedComponent> chunkedComponents;
+        std::vector<std::unique_ptr<Archetype>> archetypes;
+
+        // indexed by entity id
+        std::vector<EntityLocation> entityLocations;
+        StorageBackend backend = StorageBackend::ComponentArrays;
+
+        // keys view the names held by system records
+        std::unordered_map<std::string_view, SystemId> systems;
+
+        // indexed by SystemId
+        std::vector<std::unique_ptr<SystemRecord>> systemRecords;
+
+        std::unique_ptr<detail::ThreadPool> threadPool;
+
+        // indexed by thread pool index
+        std::vector<std::unique_ptr<CommandBuffer>> commandBuffers;
+        std::vector<ScheduleNode> schedule;
+        std::unique_ptr<std::atomic<int>[]> scheduleRemaining;
+        std::atomic<int> schedulePending{ 0 };
+        std::atomic<bool> scheduleFailed{ false };
+        bool scheduleDirty = true;
+        EcsDt scheduleDt = 0;
+
+        /*
+        * destroys and removals queued while systems run concurrently or a thread pool is set,
+        * a null record stands for a destroy. pico_ecs drains its queues after every system,
+        * while the other systems still iterate, so they are applied on the calling thread instead
+        */
+        std::mutex deferredMutex;
+        std::vector<std::pair<const ComponentRecord*, EntityId>> deferredQueue;
+        bool deferQueue = false;
+
+        // ids of all systems ordered by phase, built along with the schedule
+        std::vector<SystemId> phaseOrder;
+
+        // set once a system gets a phase or rate, until then pico_ecs runs the systems on its own
+        bool phasesUsed = false;
+    };
+
+    // frame history -------------------------------------------------------------
+
+    /*
+    * ring buffer of world states for rollback and lookahead.
+    * every frame is an EcsInstance filled through CloneInto
+    */
+    class FrameHistory
+    {
+    public:
+        // keeps up to capacity frames, each initialized for entityCount entities
+        FrameHistory(std::size_t capacity, int entityCount);
+
+        // copies ecs as the newest frame, replacing the oldest one when full
+        StatusCode Push(const EcsInstance& ecs);
+
+        // copies the frame age frames older than the newest one into ecs
+        StatusCode Restore(std::size_t age, EcsInstance& ecs) const;
+
+        // discards the newest count frames, e.g. the ones after a restored frame
+        void Pop(std::size_t count = 1);
+
+        // returns the frame age frames older than the newest one, nullptr if there is no such frame
+        const EcsInstance* Get(std::size_t age) const;
+
+        std::size_t Size() const;
+        std::size_t Capacity() const;
+
+        void Clear();
+
+    private:
+        std::vector<std::unique_ptr<EcsInstance>> frames;
+        std::size_t newest = 0;
+        std::size_t size = 0;
+    };
+
+    // view -------------------------------------------------------------
+
+    /*
+    * range over the entities passed to a system, yielding tuples of component references.
+    * storage base pointers are resolved once on construction,
+    * so iteration only does pointer arithmetic, or a lookup for sparse components.
+    * chunked components are resolved once per run of entities in consecutive rows of a chunk.
+    * every entity in the range must have all of the viewed components,
+    * which holds when they are required by the system.
+    * dereferencing an iterator marks the non-const components as changed,
+    * so components that are only read should be viewed as const, e.g. View<const Position, Velocity>.
+    * the view is invalidated by creating entities or adding components
+    */
+    template<typename ... CompTypes>
+    class View
+    {
+    public:
+        View(EcsInstance& ecs, EntityId* entities, int entityCount);
+
+        class Iterator
+        {
+        public:
+            using iterator_category     = std::forward_iterator_tag;
+            using value_type            = std::tuple<CompTypes&...>;
+            using reference             = std::tuple<CompTypes&...>;
+            using difference_type       = std::ptrdiff_t;
+
+            Iterator(const View* view, int index);
+
+            reference operator*() const;
+            Iterator& operator++();
+            Iterator operator++(int);
+            bool operator==(const Iterator& other) const;
+            bool operator!=(const Iterator& other) const;
+
+            // returns the entity the iterator currently points to
+            EntityId GetEntity() const;
+
+        private:
+            template<std::size_t ... Indices>
+            reference Get(std::index_sequence<Indices...>) const;
+
+        private:
+            const View* view = nullptr;
+            int index = 0;
+
+            // run the index falls in, and the chunked components of the entity at the index
+            std::size_t run = 0;
+            std::array<char*, sizeof...(CompTypes)> columns{};
+        };
+
+        Iterator begin() const;
+        Iterator end() const;
+
+        // returns the number of entities in the view
+        int Size() const;
+
+        // calls func(EntityId, CompTypes&...) for each entity
+        template<typename Func>
+        void Each(Func&& func) const;
+
+    private:
+        // marks the component at Index as changed for the entity, unless it is viewed as const
+        template<std::size_t Index>
+        void MarkChanged(std::size_t id) const;
+
+        // returns the component at Index of the entity, columns hold its chunked components
+        template<std::size_t Index>
+        char* GetSlot(std::size_t id, const std::array<char*, sizeof...(CompTypes)>& columns) const;
+
+        // splits the entities into runs of consecutive rows in a chunk, empties the view if one has no chunked components
+        void LocateRuns(const EcsInstance& ecs);
+
+    private:
+        // entities up to end, with the columns of their chunked components starting at the first one
+        struct Run
+        {
+            int end = 0;
+            std::array<char*, sizeof...(CompTypes)> columns{};
+        };
+
+    private:
+        EntityId* entities = nullptr;
+        int entityCount = 0;
+        std::array<char*, sizeof...(CompTypes)> bases{};
+
+        // set for sparse components, which have no base
+        std::array<const detail::SparseStorage*, sizeof...(CompTypes)> sparse{};
+
+        // set for chunked components, which have no base either
+        std::array<ComponentId, sizeof...(CompTypes)> chunked{};
+        std::vector<Run> runs;
+
+        // size of chunked components, zero for others
+        std::array<std::size_t, sizeof...(CompTypes)> strides{};
+
+        // empty for const and untracked components
+        std::array<Span<std::uint32_t>, sizeof...(CompTypes)> ticks{};
+        std::uint32_t tick = 0;
+    };
+
+    // definitions -----------------------------------------------
+
+    inline detail::ThreadPool::ThreadPool(unsigned workerCount)
+    {
+        for (unsigned i = 0; i <= workerCount; ++i)
+            queues.push_back(std::make_unique<Queue>());
+
+        for (unsigned i = 1; i <= workerCount; ++i)
+            threads.emplace_back([this, i]() { WorkerLoop(i); });
+    }
+
+    inline detail::ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+
+        for (std::thread& thread : threads)
+            thread.join();
+    }
+
+    inline void detail::ThreadPool::Submit(Task task)
+    {
+        Queue& queue = *queues[GetCurrentIndex()];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.tasks.push_back(std::move(task));
+        }
+
+        queued.fetch_add(1);
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+        }
+        wake.notify_one();
+    }
+
+    inline void detail::ThreadPool::WaitFor(const std::atomic<int>& pending)
+    {
+        const unsigned index = GetCurrentIndex();
+        Task task;
+        while (pending.load() > 0)
+        {
+            if (TryPop(index, task))
+            {
+                task();
+                task = nullptr;
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    inline unsigned detail::ThreadPool::GetWorkerCount() const
+    {
+        return static_cast<unsigned>(threads.size());
+    }
+
+    inline unsigned detail::ThreadPool::GetCurrentIndex() const
+    {
+        const WorkerSlot& slot = CurrentSlot();
+        return slot.pool == this ? slot.index : 0;
+    }
+
+    inline detail::ThreadPool::WorkerSlot& detail::ThreadPool::CurrentSlot()
+    {
+        static thread_local WorkerSlot slot;
+        return slot;
+    }
+
+    inline bool detail::ThreadPool::TryPop(unsigned index, Task& task)
+    {
+        {
+            Queue& own = *queues[index];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.tasks.empty())
+            {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                queued.fetch_sub(1);
+                return true;
+            }
+        }
+
+        const std::size_t count = queues.size();
+        for (std::size_t i = 1; i < count; ++i)
+        {
+            Queue& victim = *queues[(index + i) % count];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty())
+            {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                queued.fetch_sub(1);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    inline void detail::ThreadPool::WorkerLoop(unsigned index)
+    {
+        CurrentSlot() = WorkerSlot{ this, index };
+
+        Task task;
+        while (true)
+        {
+            if (TryPop(index, task))
+            {
+                task();
+                task = nullptr;
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wake.wait(lock, [this]() { return stopping || queued.load() > 0; });
+            if (stopping && queued.load() == 0)
+                return;
+        }
+    }
+
+    template<typename T>
+    inline Span<T>::Span(T* data, std::size_t size)
+        : data(data), size(size)
+    {
+    }
+
+    template<typename T>
+    template<typename Container, typename>
+    inline Span<T>::Span(Container& container)
+        : data(container.data()), size(container.size())
+    {
+    }
+
+    template<typename T>
+    template<typename U, typename>
+    inline Span<T>::Span(const Span<U>& other)
+        : data(other.Data()), size(other.Size())
+    {
+    }
+
+    template<typename T>
+    inline T* Span<T>::Data() const
+    {
+        return data;
+    }
+
+    template<typename T>
+    inline std::size_t Span<T>::Size() const
+    {
+        return size;
+    }
+
+    template<typename T>
+    inline bool Span<T>::IsEmpty() const
+    {
+        return size == 0;
+    }
+
+    template<typename T>
+    inline T& Span<T>::operator[](std::size_t index) const
+    {
+        return data[index];
+    }
+
+    template<typename T>
+    inline T* Span<T>::begin() const
+    {
+        return data;
+    }
+
+    template<typename T>
+    inline T* Span<T>::end() const
+    {
+        return data + size;
+    }
+
+    inline const char* simd::GetInstructionSet()
+    {
+#if defined(PICO_ECS_CPP_AVX2)
+        return "AVX2";
+#elif defined(PICO_ECS_CPP_SSE2)
+        return "SSE2";
+#else
+        return "scalar";
+#endif
+    }
+
+    inline void simd::AddScaled(float* dst, const float* src, float scale, std::size_t count)
+    {
+        std::size_t i = 0;
+
+#if defined(PICO_ECS_CPP_AVX2)
+        const __m256 factor = _mm256_set1_ps(scale);
+        for (; i + 8 <= count; i += 8)
+        {
+            const __m256 sum = _mm256_add_ps(_mm256_loadu_ps(dst + i), _mm256_mul_ps(_mm256_loadu_ps(src + i), factor));
+            _mm256_storeu_ps(dst + i, sum);
+        }
+#elif defined(PICO_ECS_CPP_SSE2)
+        const __m128 factor = _mm_set1_ps(scale);
+        for (; i + 4 <= count; i += 4)
+        {
+            const __m128 sum = _mm_add_ps(_mm_loadu_ps(dst + i), _mm_mul_ps(_mm_loadu_ps(src + i), factor));
+            _mm_storeu_ps(dst + i, sum);
+        }
+#endif
+
+        AddScaledScalar(dst + i, src + i, scale, count - i);
+    }
+
+    inline void simd::AddScaledScalar(float* dst, const float* src, float scale, std::size_t count)
+    {
+        for (std::size_t i = 0; i < count; ++i)
+            dst[i] += src[i] * scale;
+    }
+
+    template<typename Dst, typename Src>
+    inline void simd::AddScaled(Span<Dst> dst, Span<const Src> src, float scale)
+    {
+        static_assert(std::is_trivially_copyable_v<Dst> && std::is_trivially_copyable_v<Src>,
+            "AddScaled requires trivially copyable types");
+        static_assert(sizeof(Dst) == sizeof(Src) && sizeof(Dst) % sizeof(float) == 0,
+            "AddScaled requires types of the same size made of floats");
+
+        const std::size_t count = std::min(dst.Size(), src.Size()) * (sizeof(Dst) / sizeof(float));
+        AddScaled(reinterpret_cast<float*>(dst.Data()), reinterpret_cast<const float*>(src.Data()), scale, count);
+    }
+
+    inline void* Allocator::Reallocate(void* ptr, std::size_t oldSize, std::size_t newSize, std::size_t alignment)
+    {
+        void* block = Allocate(newSize, alignment);
+        if (block && ptr)
+        {
+            std::memcpy(block, ptr, std::min(oldSize, newSize));
+            Deallocate(ptr, oldSize);
+        }
+        return block;
+    }
+
+    inline MonotonicArena::MonotonicArena(std::size_t blockSize)
+        : blockSize(blockSize)
+    {
+    }
+
+    inline MonotonicArena::MonotonicArena(void* buffer, std::size_t size, std::size_t blockSize)
+        : blockSize(blockSize)
+    {
+        if (buffer && size > 0)
+            blocks.push_back(Block{ static_cast<char*>(buffer), size, false });
+    }
+
+    inline MonotonicArena::~MonotonicArena()
+    {
+        for (Block& block : blocks)
+        {
+            if (block.owned) std::free(block.data);
+        }
+    }
+
+    inline void* MonotonicArena::Allocate(std::size_t size, std::size_t alignment)
+    {
+        if (!blocks.empty())
+        {
+            Block& block = blocks.back();
+            const std::uintptr_t address = reinterpret_cast<std::uintptr_t>(block.data + offset);
+            const std::size_t padding = static_cast<std::size_t>((alignment - address % alignment) % alignment);
+
+            if (offset + padding + size <= block.size)
+            {
+                last = block.data + offset + padding;
+                offset += padding + size;
+                used += padding + size;
+                return last;
+            }
+        }
+
+        // the new block is aligned by malloc up to max_align_t, the extra space covers larger alignments
+        const std::size_t newSize = std::max(blockSize, size + alignment);
+        Block block{ static_cast<char*>(std::malloc(newSize)), newSize, true };
+        if (!block.data)
+            return nullptr;
+
+        blocks.push_back(block);
+        offset = 0;
+        return Allocate(size, alignment);
+    }
+
+    inline void MonotonicArena::Deallocate(void* ptr, std::size_t size)
+    {
+    }
+
+    inline void* MonotonicArena::Reallocate(void* ptr, std::size_t oldSize, std::size_t newSize, std::size_t alignment)
+    {
+        if (ptr && ptr == last)
+        {
+            Block& block = blocks.back();
+            const std::size_t start = static_cast<std::size_t>(last - block.data);
+            if (start + newSize <= block.size)
+            {
+                used = used - (offset - start) + newSize;
+                offset = start + newSize;
+                return ptr;
+            }
+        }
+        return Allocator::Reallocate(ptr, oldSize, newSize, alignment);
+    }
+
+    inline void MonotonicArena::Release()
+    {
+        // keeps the caller's buffer, if any
+        std::vector<Block> kept;
+        for (Block& block : blocks)
+        {
+            if (block.owned) std::free(block.data);
+            else kept.push_back(block);
+        }
+        blocks = std::move(kept);
+        offset = 0;
+        used = 0;
+        last = nullptr;
+    }
+
+    inline std::size_t MonotonicArena::GetUsedSize() const
+    {
+        return used;
+    }
+
+    inline void* detail::MemoryAllocate(std::size_t size, void* ctx)
+    {
+        if (!ctx)
+            return std::malloc(size);
+
+        MemoryContext& memory = *static_cast<MemoryContext*>(ctx);
+        const std::size_t total = size + memoryHeaderSize;
+        void* block = memory.allocator ? memory.allocator->Allocate(total, alignof(std::max_align_t)) : std::malloc(total);
+        if (!block)
+            return nullptr;
+
+        *static_cast<std::size_t*>(block) = size;
+        ++memory.stats.allocationCount;
+        memory.stats.bytesInUse += size;
+        memory.stats.peakBytesInUse = std::max(memory.stats.peakBytesInUse, memory.stats.bytesInUse);
+        return static_cast<char*>(block) + memoryHeaderSize;
+    }
+
+    inline void* detail::MemoryReallocate(void* ptr, std::size_t size, void* ctx)
+    {
+        if (!ctx)
+            return std::realloc(ptr, size);
+        if (!ptr)
+            return MemoryAllocate(size, ctx);
+
+        MemoryContext& memory = *static_cast<MemoryContext*>(ctx);
+        void* block = static_cast<char*>(ptr) - memoryHeaderSize;
+        const std::size_t oldSize = *static_cast<std::size_t*>(block);
+        const std::size_t total = size + memoryHeaderSize;
+
+        void* resized = memory.allocator
+            ? memory.allocator->Reallocate(block, oldSize + memoryHeaderSize, total, alignof(std::max_align_t))
+            : std::realloc(block, total);
+        if (!resized)
+            return nullptr;
+
+        *static_cast<std::size_t*>(resized) = size;
+        ++memory.stats.reallocationCount;
+        memory.stats.bytesInUse = memory.stats.bytesInUse - oldSize + size;
+        memory.stats.peakBytesInUse = std::max(memory.stats.peakBytesInUse, memory.stats.bytesInUse);
+        return static_cast<char*>(resized) + memoryHeaderSize;
+    }
+
+    inline void detail::MemoryFree(void* ptr, void* ctx)
+    {
+        if (!ctx)
+        {
+            std::free(ptr);
+            return;
+        }
+        if (!ptr)
+            return;
+
+        MemoryContext& memory = *static_cast<MemoryContext*>(ctx);
+        void* block = static_cast<char*>(ptr) - memoryHeaderSize;
+        const std::size_t size = *static_cast<std::size_t*>(block);
+
+        if (memory.allocator)
+            memory.allocator->Deallocate(block, size + memoryHeaderSize);
+        else
+            std::free(block);
+
+        ++memory.stats.freeCount;
+        memory.stats.bytesInUse -= size;
+    }
+
+    inline detail::SparseStorage::SparseStorage(std::size_t elementSize, void(*relocate)(void* dst, void* src), MemoryContext* memory)
+        : elementSize(elementSize), relocate(relocate), memory(memory)
+    {
+    }
+
+    inline detail::SparseStorage::~SparseStorage()
+    {
+        for (std::size_t page = 0; page < pageCount; ++page)
+            MemoryFree(pages[page], memory);
+        MemoryFree(pages, memory);
+        MemoryFree(data, memory);
+        MemoryFree(entities, memory);
+    }
+
+    inline void* detail::SparseStorage::Get(EntityId id) const
+    {
+        const std::size_t page = static_cast<std::size_t>(id) >> pageBits;
+        if (page >= pageCount || !pages[page])
+            return nullptr;
+
+        const std::uint32_t slot = pages[page][id & (pageSize - 1)];
+        return slot == emptySlot ? nullptr : data + slot * elementSize;
+    }
+
+    inline void* detail::SparseStorage::Insert(EntityId id)
+    {
+        std::uint32_t& slot = IndexSlot(id);
+        if (size == capacity)
+        {
+            const std::size_t grown = std::max<std::size_t>(capacity * 2, 16);
+            char* moved = static_cast<char*>(MemoryAllocate(grown * elementSize, memory));
+            Move(moved, data, size);
+            MemoryFree(data, memory);
+            data = moved;
+            entities = static_cast<EntityId*>(MemoryReallocate(entities, grown * sizeof(EntityId), memory));
+            capacity = grown;
+        }
+
+        slot = static_cast<std::uint32_t>(size);
+        entities[size] = id;
+        return data + size++ * elementSize;
+    }
+
+    inline void detail::SparseStorage::Erase(EntityId id)
+    {
+        std::uint32_t& slot = pages[static_cast<std::size_t>(id) >> pageBits][id & (pageSize - 1)];
+        const std::size_t last = --size;
+        if (slot != last)
+        {
+            Move(data + slot * elementSize, data + last * elementSize, 1);
+            entities[slot] = entities[last];
+            pages[static_cast<std::size_t>(entities[slot]) >> pageBits][entities[slot] & (pageSize - 1)] = slot;
+        }
+        slot = emptySlot;
+    }
+
+    inline void detail::SparseStorage::Rename(EntityId from, EntityId to)
+    {
+        std::uint32_t& slot = pages[static_cast<std::size_t>(from) >> pageBits][from & (pageSize - 1)];
+        const std::uint32_t index = slot;
+        slot = emptySlot;
+        IndexSlot(to) = index;
+        entities[index] = to;
+    }
+
+    inline void detail::SparseStorage::Clear()
+    {
+        for (std::size_t i = 0; i < size; ++i)
+            pages[static_cast<std::size_t>(entities[i]) >> pageBits][entities[i] & (pageSize - 1)] = emptySlot;
+        size = 0;
+    }
+
+    inline Span<const EntityId> detail::SparseStorage::GetEntities() const
+    {
+        return Span<const EntityId>(entities, size);
+    }
+
+    inline void detail::SparseStorage::Move(char* dst, char* src, std::size_t count)
+    {
+        if (!relocate)
+        {
+            if (count > 0)
+                std::memcpy(dst, src, count * elementSize);
+            return;
+        }
+
+        for (std::size_t i = 0; i < count; ++i)
+            relocate(dst + i * elementSize, src + i * elementSize);
+    }
+
+    inline std::uint32_t& detail::SparseStorage::IndexSlot(EntityId id)
+    {
+        const std::size_t page = static_cast<std::size_t>(id) >> pageBits;
+        if (page >= pageCount)
+        {
+            const std::size_t count = std::max(page + 1, pageCount * 2);
+            pages = static_cast<std::uint32_t**>(MemoryReallocate(pages, count * sizeof(std::uint32_t*), memory));
+            std::fill(pages + pageCount, pages + count, nullptr);
+            pageCount = count;
+        }
+        if (!pages[page])
+        {
+            pages[page] = static_cast<std::uint32_t*>(MemoryAllocate(pageSize * sizeof(std::uint32_t), memory));
+            std::fill(pages[page], pages[page] + pageSize, emptySlot);
+        }
+        return pages[page][id & (pageSize - 1)];
+    }
+
+    inline const char* detail::MappedFile::Data() const
+    {
+        return data;
+    }
+
+    inline std::size_t detail::MappedFile::Size() const
+    {
+        return size;
+    }
+
+    inline SystemHandle::SystemHandle(SystemId id)
+        : id(id)
+    {
+    }
+
+    inline bool SystemHandle::IsValid() const
+    {
+        return id != invalidId;
+    }
+
+    inline bool SystemHandle::operator==(const SystemHandle& other) const
+    {
+        return id == other.id;
+    }
+
+    inline bool SystemHandle::operator!=(const SystemHandle& other) const
+    {
+        return id != other.id;
+    }
+
+    inline SystemRate SystemRate::EveryFrame()
+    {
+        return SystemRate();
+    }
+
+    inline SystemRate SystemRate::FixedStep(EcsDt step, int maxSteps)
+    {
+        SystemRate rate;
+        rate.mode = Mode::FixedStep;
+        rate.step = step;
+        rate.maxSteps = maxSteps;
+        return rate;
+    }
+
+    inline SystemRate SystemRate::EveryNFrames(int frames)
+    {
+        SystemRate rate;
+        rate.mode = Mode::EveryNFrames;
+        rate.frames = frames;
+        return rate;
+    }
+
+    inline SystemRate SystemRate::TimeSliced(int frames)
+    {
+        SystemRate rate;
+        rate.mode = Mode::TimeSliced;
+        rate.frames = frames;
+        return rate;
+    }
+
+    inline EcsInstance::EcsInstance(int entityCount, Allocator* allocator, StorageBackend backend)
+    {
+        Init(entityCount, allocator, backend);
+    }
+
+    inline EcsInstance::~EcsInstance()
+    {
+        if(instance) Destroy();
+    }
+
+    inline StatusCode EcsInstance::Init(int entityCount, Allocator* allocator, StorageBackend backend)
+    {
+        if (!(entityCount > 0))
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::InitFail, "Invalid entity count");
+            return StatusCode::InitFail;
+        }
+
+        memory = detail::MemoryContext();
+        memory.allocator = allocator;
+        this->backend = backend;
+
+#if defined(PICO_ECS_CPP_MEMORY_HOOKS)
+        instance = ecs_new(static_cast<size_t>(entityCount), &memory);
+#else
+        if (allocator)
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::InitFail, "Allocators require the default memory hooks, ECS_MALLOC/ECS_REALLOC/ECS_FREE are user-defined");
+            return StatusCode::InitFail;
+        }
+        instance = ecs_new(static_cast<size_t>(entityCount), nullptr);
+#endif
+
+        if (instance)
+        {
+            return StatusCode::Success;
+        }
+        else
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::InitFail, "Failed to initialize ECS instance");
+            return StatusCode::InitFail;
+        }
+    }
+
+    inline StatusCode EcsInstance::Destroy()
+    {
+        for (ResourceRecord& resource : resources)
+            ResourceDestroy(resource);
+        resources.clear();
+        ComponentDestroyAll();
+        SparseClear();
+        ArchetypeClear();
+        entityHighWater = 0;
+        liveBits.clear();
+        liveQueued.clear();
+        ecs_free(instance);
+        instance = nullptr;
+        components.clear();
+        changeColumns.clear();
+        observerColumns.clear();
+        tagBits.clear();
+        tagObserverColumns.clear();
+        queryRecords.clear();
+        queries.clear();
+        tagQueries.clear();
+        componentQueries.clear();
+        queryQueued.clear();
+        sparseColumns.clear();
+        chunkedComponents.clear();
+        archetypes.clear();
+        systems.clear();
+        systemRecords.clear();
+        scheduleDirty = true;
+        phasesUsed = false;
+#if defined(PICO_ECS_CPP_PROFILING)
+        // events view the names of the destroyed systems
+        ProfileClear();
+#endif
+        return StatusCode::Success;
+    }
+
+    inline StatusCode EcsInstance::Reset()
+    {
+        ComponentDestroyAll();
+        SparseClear();
+        ArchetypeClear();
+        entityHighWater = 0;
+        liveBits.clear();
+        liveQueued.clear();
+        ecs_reset(instance);
+        // pico_ecs empties its systems without calling their callbacks
+        for (std::unique_ptr<SystemRecord>& record : systemRecords)
+        {
+            record->members.clear();
+            record->memberSlots.clear();
+        }
+        ObserverClear();
+        for (std::vector<std::uint64_t>& bits : tagBits)
+            std::fill(bits.begin(), bits.end(), 0);
+
+        queryQueued.clear();
+        for (QueryRecord* query : queries)
+            QueryPopulate(*query);
+        return StatusCode::Success;
+    }
+
+    inline StatusCode EcsInstance::Update(EcsDt dt)
+    {
+#if defined(PICO_ECS_CPP_PROFILING)
+        const std::int64_t updateStart = detail::ProfileNow();
+#endif
+
+        StatusCode code = StatusCode::Success;
+        if (threadPool && systemRecords.size() > 1)
+        {
+            code = UpdateParallel(dt);
+        }
+        else
+        {
+#if defined(PICO_ECS_CPP_PROFILING)
+            // systems are updated one by one, so the work pico_ecs does after each of them can be timed
+            code = UpdateInOrder(dt);
+#else
+            if (phasesUsed)
+                code = UpdateInOrder(dt);
+            else if (ecs_update_systems(instance, dt) != 0)
+                code = StatusCode::SysUpdateFail;
+#endif
+            if (!deferredQueue.empty())
+                DeferredQueueFlush();
+        }
+
+#if defined(PICO_ECS_CPP_PROFILING)
+        const std::int64_t flushStart = detail::ProfileNow();
+        FlushCommandBuffers();
+        ObserverFlush();
+        const std::int64_t updateEnd = detail::ProfileNow();
+
+        profileFlush.Add(static_cast<double>(updateEnd - flushStart) / 1e6);
+        profileUpdate.Add(static_cast<double>(updateEnd - updateStart) / 1e6);
+        ProfileTrace("FlushCommandBuffers", "flush", flushStart, updateEnd);
+        ProfileTrace("Update", "frame", updateStart, updateEnd);
+#else
+        FlushCommandBuffers();
+        ObserverFlush();
+#endif
+        LiveSync();
+        if (!queryQueued.empty())
+            QuerySync();
+        return code;
+    }
+
+    inline StatusCode EcsInstance::SetThreadCount(unsigned count)
+    {
+        threadPool.reset();
+        if (count > 1)
+            threadPool = std::make_unique<detail::ThreadPool>(count - 1);
+
+        while (commandBuffers.size() < std::max(count, 1u))
+            commandBuffers.push_back(std::make_unique<CommandBuffer>(static_cast<std::uint32_t>(commandBuffers.size())));
+        return StatusCode::Success;
+    }
+
+    inline CommandBuffer& EcsInstance::GetCommandBuffer()
+    {
+        if (commandBuffers.empty())
+            commandBuffers.push_back(std::make_unique<CommandBuffer>(0));
+
+        const unsigned index = threadPool ? threadPool->GetCurrentIndex() : 0;
+        return *commandBuffers[index];
+    }
+
+    inline StatusCode EcsInstance::FlushCommandBuffers()
+    {
+        struct Entry
+        {
+            std::uint64_t order;
+            std::uint32_t sequence;
+            CommandBuffer::Command* command;
+            CommandBuffer* buffer;
+        };
+
+        std::vector<Entry> entries;
+        for (std::unique_ptr<CommandBuffer>& buffer : commandBuffers)
+        {
+            for (CommandBuffer::Command& command : buffer->commands)
+                entries.push_back(Entry{ command.order, command.sequence, &command, buffer.get() });
+        }
+
+        if (entries.empty())
+            return StatusCode::Success;
+
+        // a system or chunk records into one buffer only, so order and sequence are unique
+        std::sort(entries.begin(), entries.end(), [](const Entry& first, const Entry& second)
+            {
+                if (first.order != second.order)
+                    return first.order < second.order;
+                return first.sequence < second.sequence;
+            });
+
+        for (Entry& entry : entries)
+        {
+            CommandBuffer::Command& command = *entry.command;
+            if (command.type == CommandBuffer::CommandType::Create)
+            {
+                entry.buffer->created[command.entity] = EntityCreate();
+                continue;
+            }
+
+            const EntityId id = command.deferred ? entry.buffer->created[command.entity] : command.entity;
+            if (!EntityIsReady(id))
+                continue;
+
+            if (command.type == CommandBuffer::CommandType::Destroy)
+                EntityDestroy(id);
+            else
+                command.apply(*this, id, command.payload);
+        }
+
+        for (std::unique_ptr<CommandBuffer>& buffer : commandBuffers)
+            buffer->Clear();
+        return StatusCode::Success;
+    }
+
+    template<typename Event, typename Func>
+    inline StatusCode EcsInstance::ObserverRegister(Func&& func)
+    {
+        using CompType = typename detail::ObserverEvent<Event>::Component;
+        static_assert(std::is_invocable_v<Func&, EcsInstance&, Span<const EntityId>>,
+            "Observer callable must accept (EcsInstance&, Span<const EntityId>)");
+
+        const ComponentRecord* comp = FindComponent<CompType>();
+        if (!comp)
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::CompNotReg,
+                FormatString("Component of type [%s] is not registered", typeid(CompType).name()));
+            return StatusCode::CompNotReg;
+        }
+
+        ObserverColumn& column = comp->InTagBits() ? ObserverGetTagColumn(comp->id) : ObserverGetColumn(comp->id);
+        if constexpr (detail::ObserverEvent<Event>::add)
+            (column.delivering ? column.registeredAdd : column.onAdd).emplace_back(std::forward<Func>(func));
+        else
+            (column.delivering ? column.registeredRemove : column.onRemove).emplace_back(std::forward<Func>(func));
+        return StatusCode::Success;
+    }
+
+    inline StatusCode EcsInstance::ObserverFlush()
+    {
+        // keeps the events still pending, so every entity is reported once
+        auto take = [](std::vector<std::uint8_t>& pending, std::vector<EntityId>& ids, std::uint8_t event)
+            {
+                std::size_t kept = 0;
+                for (EntityId id : ids)
+                {
+                    if (pending[id] & event)
+                    {
+                        pending[id] &= static_cast<std::uint8_t>(~event);
+                        ids[kept++] = id;
+                    }
+                }
+                ids.resize(kept);
+            };
+
+        bool delivered = true;
+        while (delivered)
+        {
+            delivered = false;
+            for (std::size_t index = 0; index < observerColumns.size() + tagObserverColumns.size(); ++index)
+            {
+                ObserverColumn* column = index < observerColumns.size()
+                    ? observerColumns[index].get()
+                    : tagObserverColumns[index - observerColumns.size()].get();
+                if (!column || (column->added.empty() && column->removed.empty()))
+                    continue;
+
+                delivered = true;
+                column->deliverRemoved.clear();
+                column->deliverAdded.clear();
+                std::swap(column->removed, column->deliverRemoved);
+                std::swap(column->added, column->deliverAdded);
+                take(column->pending, column->deliverRemoved, observerPendingRemove);
+                take(column->pending, column->deliverAdded, observerPendingAdd);
+
+                column->delivering = true;
+                if (!column->deliverRemoved.empty())
+                {
+                    for (ObserverFunc& observer : column->onRemove)
+                        observer(*this, Span<const EntityId>(column->deliverRemoved));
+                }
+                if (!column->deliverAdded.empty())
+                {
+                    for (ObserverFunc& observer : column->onAdd)
+                        observer(*this, Span<const EntityId>(column->deliverAdded));
+                }
+                column->delivering = false;
+
+                for (ObserverFunc& observer : column->registeredRemove)
+                    column->onRemove.push_back(std::move(observer));
+                for (ObserverFunc& observer : column->registeredAdd)
+                    column->onAdd.push_back(std::move(observer));
+                column->registeredRemove.clear();
+                column->registeredAdd.clear();
+            }
+        }
+        return StatusCode::Success;
+    }
+
+    inline EcsInstance::ObserverColumn& EcsInstance::ObserverGetColumn(ComponentId comp)
+    {
+        if (comp >= observerColumns.size())
+            observerColumns.resize(comp + 1);
+        if (observerColumns[comp])
+            return *observerColumns[comp];
+
+        observerColumns[comp] = std::make_unique<ObserverColumn>();
+        return *observerColumns[comp];
+    }
+
+    inline EcsInstance::ObserverColumn& EcsInstance::ObserverGetTagColumn(ComponentId tag)
+    {
+        if (tag >= tagObserverColumns.size())
+            tagObserverColumns.resize(tag + 1);
+        if (!tagObserverColumns[tag])
+            tagObserverColumns[tag] = std::make_unique<ObserverColumn>();
+        return *tagObserverColumns[tag];
+    }
+
+    inline void EcsInstance::ObserverClear()
+    {
+        for (std::vector<std::unique_ptr<ObserverColumn>>* columns : { &observerColumns, &tagObserverColumns })
+        {
+            for (std::unique_ptr<ObserverColumn>& column : *columns)
+            {
+                if (!column)
+                    continue;
+
+                std::fill(column->pending.begin(), column->pending.end(), std::uint8_t(0));
+                column->added.clear();
+                column->removed.clear();
+            }
+        }
+    }
+
+    inline void EcsInstance::ObserverRaiseDestroyed(EntityId id)
+    {
+        for (std::size_t comp = 0; comp < observerColumns.size(); ++comp)
+        {
+            if (observerColumns[comp] && ecs_has(instance, id, static_cast<ComponentId>(comp)))
+                ObserverRaiseRemoved(*observerColumns[comp], id);
+        }
+    }
+
+    inline void EcsInstance::ObserverRaiseAdded(ObserverColumn& column, EntityId id)
+    {
+        if (id >= column.pending.size())
+            column.pending.resize(static_cast<std::size_t>(id) + 1, 0);
+
+        std::uint8_t& pending = column.pending[id];
+        if (!(pending & observerPendingAdd))
+        {
+            pending |= observerPendingAdd;
+            column.added.push_back(id);
+        }
+    }
+
+    inline void EcsInstance::ObserverRaiseRemoved(ObserverColumn& column, EntityId id)
+    {
+        if (id >= column.pending.size())
+            column.pending.resize(static_cast<std::size_t>(id) + 1, 0);
+
+        // an addition that wasn't delivered yet cancels out
+        std::uint8_t& pending = column.pending[id];
+        if (pending & observerPendingAdd)
+        {
+            pending &= static_cast<std::uint8_t>(~observerPendingAdd);
+        }
+        else if (!(pending & observerPendingRemove))
+        {
+            pending |= observerPendingRemove;
+            column.removed.push_back(id);
+        }
+    }
+
+    template<typename ... Signature>
+    inline detail::SignatureView<Signature...> EcsInstance::Query()
+    {
+        using QueryView = detail::SignatureView<Signature...>;
+
+        QueryRecord* query = QueryFind<Signature...>();
+        if (!query)
+            return QueryView(*this, nullptr, 0);
+
+        if (!queryQueued.empty())
+            QuerySync();
+        return QueryView(*this, query->entities.data(), static_cast<int>(query->entities.size()));
+    }
+
+    template<typename ... Signature>
+    inline EcsInstance::QueryRecord* EcsInstance::QueryFind()
+    {
+        const std::size_t slot = detail::TypeSlot<std::tuple<Signature...>>();
+        if (slot < queryRecords.size() && queryRecords[slot])
+            return queryRecords[slot].get();
+
+        if (!(SignatureRegistered(Signature{}) && ...))
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::CompNotReg, "Query contains unregistered components");
+            return nullptr;
+        }
+
+        auto query = std::make_unique<QueryRecord>();
+        (QueryApply(*query, Signature{}), ...);
+        if (query->require.empty() && query->tagRequire.empty())
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::InvalidArg, "Query requires no components");
+            return nullptr;
+        }
+
+        auto index = [&query](std::vector<std::vector<QueryRecord*>>& lists, const std::vector<ComponentId>& comps)
+            {
+                for (ComponentId comp : comps)
+                {
+                    if (comp >= lists.size())
+                        lists.resize(comp + 1);
+                    lists[comp].push_back(query.get());
+                }
+            };
+        index(componentQueries, query->require);
+        index(componentQueries, query->exclude);
+        index(tagQueries, query->tagRequire);
+        index(tagQueries, query->tagExclude);
+
+        QueryPopulate(*query);
+        if (slot >= queryRecords.size())
+            queryRecords.resize(slot + 1);
+        queries.push_back(query.get());
+        queryRecords[slot] = std::move(query);
+        return queryRecords[slot].get();
+    }
+
+    template<typename ... CompTypes>
+    inline void EcsInstance::QueryApply(QueryRecord& query, Require<CompTypes...>)
+    {
+        auto add = [&query](const ComponentRecord* comp)
+            {
+                std::vector<ComponentId>& ids = comp->InTagBits() ? query.tagRequire : query.require;
+                if (std::find(ids.begin(), ids.end(), comp->id) == ids.end())
+                    ids.push_back(comp->id);
+            };
+        (add(FindComponent<CompTypes>()), ...);
+    }
+
+    template<typename ... CompTypes>
+    inline void EcsInstance::QueryApply(QueryRecord& query, Exclude<CompTypes...>)
+    {
+        auto add = [&query](const ComponentRecord* comp)
+            {
+                std::vector<ComponentId>& ids = comp->InTagBits() ? query.tagExclude : query.exclude;
+                if (std::find(ids.begin(), ids.end(), comp->id) == ids.end())
+                    ids.push_back(comp->id);
+            };
+        (add(FindComponent<CompTypes>()), ...);
+    }
+
+    inline bool EcsInstance::QueryMatches(const QueryRecord& query, EntityId id) const
+    {
+        if (!ecs_is_ready(instance, id))
+            return false;
+
+        for (ComponentId comp : query.require)
+        {
+            if (!ecs_has(instance, id, comp))
+                return false;
+        }
+        for (ComponentId comp : query.exclude)
+        {
+            if (ecs_has(instance, id, comp))
+                return false;
+        }
+        return QueryTagsMatch(query, id);
+    }
+
+    inline bool EcsInstance::QueryTagsMatch(const QueryRecord& query, EntityId id) const
+    {
+        for (ComponentId tag : query.tagRequire)
+        {
+            if (!TagHas(tag, id))
+                return false;
+        }
+        for (ComponentId tag : query.tagExclude)
+        {
+            if (TagHas(tag, id))
+                return false;
+        }
+        return true;
+    }
+
+    inline void EcsInstance::QueryInsert(QueryRecord& query, EntityId id)
+    {
+        if (id >= query.slots.size())
+            query.slots.resize(static_cast<std::size_t>(id) + 1, 0);
+        if (query.slots[id])
+            return;
+
+        query.entities.push_back(id);
+        query.slots[id] = static_cast<std::uint32_t>(query.entities.size());
+    }
+
+    inline void EcsInstance::QueryErase(QueryRecord& query, EntityId id)
+    {
+        if (id >= query.slots.size() || !query.slots[id])
+            return;
+
+        const std::uint32_t index = query.slots[id] - 1;
+        const EntityId last = query.entities.back();
+        query.entities[index] = last;
+        query.slots[last] = index + 1;
+        query.entities.pop_back();
+        query.slots[id] = 0;
+    }
+
+    inline void EcsInstance::QueryPopulate(QueryRecord& query)
+    {
+        for (EntityId id : query.entities)
+            query.slots[id] = 0;
+        query.entities.clear();
+
+        for (EntityId id = 0; id < entityHighWater; ++id)
+        {
+            if (QueryMatches(query, id))
+                QueryInsert(query, id);
+        }
+    }
+
+    inline void EcsInstance::QueryRecheck(const std::vector<QueryRecord*>& checked, EntityId id)
+    {
+        for (QueryRecord* query : checked)
+        {
+            if (QueryMatches(*query, id))
+                QueryInsert(*query, id);
+            else
+                QueryErase(*query, id);
+        }
+    }
+
+    inline void EcsInstance::QueryTagChanged(ComponentId tag, EntityId id)
+    {
+        QueryRecheck(tagQueries[tag], id);
+    }
+
+    inline void EcsInstance::QueryComponentChanged(ComponentId comp, EntityId id)
+    {
+        if (comp < componentQueries.size())
+            QueryRecheck(componentQueries[comp], id);
+    }
+
+    inline void EcsInstance::QuerySync()
+    {
+        // kept while pico_ecs still has the component, e.g. until the next system ran
+        std::size_t kept = 0;
+        for (const std::pair<ComponentId, EntityId>& removal : queryQueued)
+        {
+            if (ecs_is_ready(instance, removal.second) && ecs_has(instance, removal.second, removal.first))
+                queryQueued[kept++] = removal;
+            else
+                QueryComponentChanged(removal.first, removal.second);
+        }
+        queryQueued.resize(kept);
+    }
+
+    inline void EcsInstance::QueryForget(EntityId id)
+    {
+        for (QueryRecord* query : queries)
+            QueryErase(*query, id);
+    }
+
+    template<typename T, typename ... Args>
+    inline T* EcsInstance::SetResource(Args&& ... args)
+    {
+        static_assert(alignof(T) <= detail::memoryHeaderSize, "Resources can't be over-aligned");
+
+        // constructed before the previous value is destroyed, so args may refer to it
+        void* storage = detail::MemoryAllocate(sizeof(T), &memory);
+
+        // frees the block if the constructor throws, without requiring exceptions to be enabled
+        struct StorageGuard
+        {
+            void* storage;
+            void* ctx;
+            ~StorageGuard() { if (storage) detail::MemoryFree(storage, ctx); }
+        } guard{ storage, &memory };
+
+        T* value = new (storage) T(std::forward<Args>(args)...);
+        guard.storage = nullptr;
+
+        ResourceRecord& resource = ResourceGetRecord<T>();
+        ResourceDestroy(resource);
+        resource.value = value;
+        return value;
+    }
+
+    template<typename T>
+    inline T* EcsInstance::GetResource()
+    {
+        return const_cast<T*>(static_cast<const EcsInstance*>(this)->GetResource<T>());
+    }
+
+    template<typename T>
+    inline const T* EcsInstance::GetResource() const
+    {
+        const std::size_t slot = detail::TypeSlot<T>();
+        if (slot >= resources.size() || !resources[slot].value)
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::ResNotSet,
+                FormatString("Resource of type [%s] is not set", typeid(T).name()));
+            return nullptr;
+        }
+        return static_cast<const T*>(resources[slot].value);
+    }
+
+    template<typename T>
+    inline bool EcsInstance::HasResource() const
+    {
+        const std::size_t slot = detail::TypeSlot<T>();
+        return slot < resources.size() && resources[slot].value;
+    }
+
+    template<typename T>
+    inline StatusCode EcsInstance::RemoveResource()
+    {
+        if (!HasResource<T>())
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::ResNotSet,
+                FormatString("Resource of type [%s] is not set", typeid(T).name()));
+            return StatusCode::ResNotSet;
+        }
+
+        ResourceDestroy(resources[detail::TypeSlot<T>()]);
+        return StatusCode::Success;
+    }
+
+    template<typename T>
+    inline StatusCode EcsInstance::SetResourceSerialization(std::string_view stableName,
+        ComponentSerializer<T> serialize, ComponentDeserializer<T> deserialize)
+    {
+        if (stableName.empty() || !serialize != !deserialize || (!serialize && !std::is_trivially_copyable_v<T>))
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::InvalidArg,
+                FormatString("Resource [%s] needs a stable name, and a serializer and deserializer unless it's trivially copyable",
+                    typeid(T).name()));
+            return StatusCode::InvalidArg;
+        }
+
+        ResourceRecord& found = ResourceGetRecord<T>();
+        for (const ResourceRecord& other : resources)
+        {
+            if (&other != &found && other.stableName == stableName)
+            {
+                PICO_ECS_CPP_ERROR(StatusCode::InvalidArg,
+                    FormatString("Stable name [%s] is already used by another resource", std::string(stableName).c_str()));
+                return StatusCode::InvalidArg;
+            }
+        }
+
+        found.stableName = std::string(stableName);
+        if (serialize)
+        {
+            found.save = [serialize](const void* value, std::string& out)
+                {
+                    serialize(*static_cast<const T*>(value), out);
+                };
+            found.load = [deserialize](EcsInstance& ecs, std::string_view data)
+                {
+                    std::optional<T> value = deserialize(data);
+                    if (!value)
+                        return false;
+
+                    ecs.SetResource<T>(std::move(*value));
+                    return true;
+                };
+        }
+        else
+        {
+            found.save = nullptr;
+            found.load = [](EcsInstance& ecs, std::string_view data)
+                {
+                    // the mapped file gives no alignment guarantee
+                    alignas(T) unsigned char bytes[sizeof(T)];
+                    std::memcpy(bytes, data.data(), sizeof(T));
+                    ecs.SetResource<T>(*reinterpret_cast<const T*>(bytes));
+                    return true;
+                };
+        }
+        return StatusCode::Success;
+    }
+
+    template<typename T>
+    inline EcsInstance::ResourceRecord& EcsInstance::ResourceGetRecord()
+    {
+        const std::size_t slot = detail::TypeSlot<T>();
+        if (slot >= resources.size())
+            resources.resize(slot + 1);
+
+        ResourceRecord& resource = resources[slot];
+        if (!resource.dtor)
+        {
+            resource.typeName = typeid(T).name();
+            resource.size = sizeof(T);
+            resource.dtor = ResourceDtor<T>;
+            if constexpr (std::is_copy_constructible_v<T>)
+                resource.copy = ResourceCopy<T>;
+        }
+        return resource;
+    }
+
+    inline void EcsInstance::ResourceDestroy(ResourceRecord& resource)
+    {
+        if (!resource.value)
+            return;
+
+        resource.dtor(resource.value);
+        detail::MemoryFree(resource.value, &memory);
+        resource.value = nullptr;
+    }
+
+    template<typename T>
+    inline void EcsInstance::ResourceDtor(void* value)
+    {
+        static_cast<T*>(value)->~T();
+    }
+
+    template<typename T>
+    inline void EcsInstance::ResourceCopy(void* dst, const void* src)
+    {
+        new (dst) T(*static_cast<const T*>(src));
+    }
+
+    inline StatusCode EcsInstance::UpdateParallel(EcsDt dt)
+    {
+        if (scheduleDirty)
+            ScheduleBuild();
+
+        const std::size_t count = schedule.size();
+        scheduleDt = dt;
+        scheduleFailed = false;
+        schedulePending = static_cast<int>(count);
+        for (std::size_t i = 0; i < count; ++i)
+            scheduleRemaining[i] = schedule[i].dependencies;
+
+        deferQueue = true;
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            if (schedule[i].dependencies == 0)
+            {
+                const SystemId sys = static_cast<SystemId>(i);
+                threadPool->Submit([this, sys]() { ScheduleRun(sys); });
+            }
+        }
+        threadPool->WaitFor(schedulePending);
+        deferQueue = false;
+        DeferredQueueFlush();
+
+        return scheduleFailed ? StatusCode::SysUpdateFail : StatusCode::Success;
+    }
+
+    inline void EcsInstance::DeferredQueueFlush()
+    {
+        // like pico_ecs, skips entities and components that are already gone
+        for (const auto& [comp, id] : deferredQueue)
+        {
+            if (!ecs_is_ready(instance, id))
+                continue;
+
+            if (!comp)
+                EntityDestroy(id);
+            else if (comp->tag)
+                TagSet(comp->id, id, false);
+            else if (ComponentHasRaw(*comp, id))
+                ComponentRemoveRaw(*comp, id);
+        }
+        deferredQueue.clear();
+    }
+
+    inline StatusCode EcsInstance::UpdateInOrder(EcsDt dt)
+    {
+        if (scheduleDirty)
+            ScheduleBuild();
+
+        for (SystemId sys : phaseOrder)
+        {
+            if (SystemTick(sys, dt) != 0)
+                return StatusCode::SysUpdateFail;
+        }
+        return StatusCode::Success;
+    }
+
+    inline void EcsInstance::ScheduleRun(SystemId sys)
+    {
+        while (true)
+        {
+            if (SystemTick(sys, scheduleDt) != 0)
+                scheduleFailed = true;
+
+            // the first released successor runs on this thread, the rest go to the pool
+            bool hasNext = false;
+            SystemId next = 0;
+            for (SystemId successor : schedule[sys].successors)
+            {
+                if (--scheduleRemaining[successor] == 0)
+                {
+                    if (!hasNext)
+                    {
+                        hasNext = true;
+                        next = successor;
+                    }
+                    else
+                    {
+                        threadPool->Submit([this, successor]() { ScheduleRun(successor); });
+                    }
+                }
+            }
+
+            --schedulePending;
+            if (!hasNext)
+                return;
+            sys = next;
+        }
+    }
+
+    inline ReturnCode EcsInstance::SystemUpdate(SystemId sys, EcsDt dt)
+    {
+#if defined(PICO_ECS_CPP_PROFILING)
+        SystemRecord* record = sys < systemRecords.size() ? systemRecords[sys].get() : nullptr;
+        if (record)
+            record->profileRan = false;
+
+        const std::int64_t start = detail::ProfileNow();
+        const ReturnCode code = SystemDispatch(sys, dt);
+
+        // disabled systems don't run
+        if (record && record->profileRan)
+        {
+            const std::int64_t end = detail::ProfileNow();
+            const std::int64_t queueNs = std::max<std::int64_t>(end - start - record->profileRunNs, 0);
+            record->profileQueueTime.Add(static_cast<double>(queueNs) / 1e6);
+            ProfileTrace(record->name, "queue", end - queueNs, end);
+        }
+        return code;
+#else
+        return SystemDispatch(sys, dt);
+#endif
+    }
+
+    inline ReturnCode EcsInstance::SystemDispatch(SystemId sys, EcsDt dt)
+    {
+        // pico_ecs drains its queues after every system, which would race with the systems still running
+        if (deferQueue)
+        {
+            SystemRecord& record = *systemRecords[sys];
+            if (!record.enabled)
+                return 0;
+            return SystemTrampoline(instance, record.members.data(), static_cast<int>(record.members.size()), dt, &record);
+        }
+        return ecs_update_system(instance, sys, dt);
+    }
+
+    inline void EcsInstance::ScheduleBuild()
+    {
+        phaseOrder.clear();
+        for (SystemId sys = 0; sys < systemRecords.size(); ++sys)
+        {
+            if (systemRecords[sys])
+                phaseOrder.push_back(sys);
+        }
+        std::stable_sort(phaseOrder.begin(), phaseOrder.end(),
+            [this](SystemId first, SystemId second) { return systemRecords[first]->phase < systemRecords[second]->phase; });
+
+        const std::size_t count = systemRecords.size();
+        schedule.assign(count, ScheduleNode());
+        scheduleRemaining.reset(new std::atomic<int>[count]);
+
+        // systems of a later phase wait for all systems of earlier ones
+        for (std::size_t later = 0; later < phaseOrder.size(); ++later)
+        {
+            for (std::size_t earlier = 0; earlier < later; ++earlier)
+            {
+                const SystemRecord& first = *systemRecords[phaseOrder[earlier]];
+                const SystemRecord& second = *systemRecords[phaseOrder[later]];
+                if (first.phase != second.phase || SystemsConflict(first, second))
+                {
+                    schedule[phaseOrder[earlier]].successors.push_back(phaseOrder[later]);
+                    ++schedule[phaseOrder[later]].dependencies;
+                }
+            }
+        }
+        scheduleDirty = false;
+    }
+
+    inline ReturnCode EcsInstance::SystemTick(SystemId sys, EcsDt dt)
+    {
+        SystemRecord* record = sys < systemRecords.size() ? systemRecords[sys].get() : nullptr;
+        if (!record)
+            return SystemUpdate(sys, dt);
+
+        const SystemRate& rate = record->rate;
+        switch (rate.mode)
+        {
+        case SystemRate::Mode::FixedStep:
+        {
+            record->rateTime += dt;
+            for (int step = 0; step < rate.maxSteps && record->rateTime >= rate.step; ++step)
+            {
+                record->rateTime -= rate.step;
+                const ReturnCode code = SystemUpdate(sys, rate.step);
+                if (code != 0)
+                    return code;
+            }
+            record->rateTime = std::fmod(record->rateTime, rate.step);
+            return 0;
+        }
+        case SystemRate::Mode::EveryNFrames:
+        {
+            record->rateTime += dt;
+            const bool due = record->rateFrame == 0;
+            record->rateFrame = (record->rateFrame + 1) % rate.frames;
+            if (!due)
+                return 0;
+
+            const EcsDt elapsed = record->rateTime;
+            record->rateTime = 0;
+            return SystemUpdate(sys, elapsed);
+        }
+        case SystemRate::Mode::TimeSliced:
+        {
+            // every entity was last processed frames Updates ago
+            record->sliceTimes.resize(static_cast<std::size_t>(rate.frames), 0);
+            record->sliceTimes[static_cast<std::size_t>(record->rateFrame)] = dt;
+            record->rateFrame = (record->rateFrame + 1) % rate.frames;
+
+            EcsDt elapsed = 0;
+            for (EcsDt time : record->sliceTimes)
+                elapsed += time;
+            return SystemUpdate(sys, elapsed);
+        }
+        default:
+            return SystemUpdate(sys, dt);
+        }
+    }
+
+    inline bool EcsInstance::SystemsConflict(const SystemRecord& first, const SystemRecord& second) const
+    {
+        if (!first.accessDeclared || !second.accessDeclared)
+            return true;
+
+        auto contains = [](const std::vector<ComponentId>& comps, ComponentId comp)
+            {
+                return std::find(comps.begin(), comps.end(), comp) != comps.end();
+            };
+
+        for (ComponentId comp : first.writes)
+        {
+            if (contains(second.writes, comp) || contains(second.reads, comp))
+                return true;
+        }
+        for (ComponentId comp : second.writes)
+        {
+            if (contains(first.reads, comp))
+                return true;
+        }
+        return false;
+    }
+
+    inline void EcsInstance::SystemDeclareAccess(SystemId sys, ComponentId comp, bool write)
+    {
+        SystemRecord& record = *systemRecords[sys];
+        std::vector<ComponentId>& comps = write ? record.writes : record.reads;
+        if (std::find(comps.begin(), comps.end(), comp) == comps.end())
+            comps.push_back(comp);
+
+        record.accessDeclared = true;
+        scheduleDirty = true;
+    }
+
+    inline Ecs* EcsInstance::GetInstance() const
+    {
+        return instance;
+    }
+
+    inline MemoryStats EcsInstance::GetMemoryStats() const
+    {
+        return memory.stats;
+    }
+
+    template<typename CompType>
+    inline const EcsInstance::ComponentRecord* EcsInstance::FindComponent() const
+    {
+        const std::size_t slot = detail::TypeSlot<std::remove_cv_t<CompType>>();
+        if (slot < components.size() && components[slot].registered)
+            return &components[slot];
+        return nullptr;
+    }
+
+    template<typename CompType>
+    inline Span<CompType> EcsInstance::ComponentColumn(Span<const EntityId> entities)
+    {
+        static_assert(std::is_trivially_copyable_v<CompType>, "Component columns require trivially copyable components");
+
+        if (entities.IsEmpty())
+            return Span<CompType>();
+
+        char* base = ComponentStorageBase<CompType>(entities[0]);
+        if (!base)
+            return Span<CompType>();
+
+        const EntityId last = *std::max_element(entities.begin(), entities.end());
+        return Span<CompType>(reinterpret_cast<CompType*>(base), static_cast<std::size_t>(last) + 1);
+    }
+
+    template<typename CompType>
+    inline StatusCode EcsInstance::ComponentGather(Span<const EntityId> entities, Span<CompType> out)
+    {
+        static_assert(std::is_trivially_copyable_v<CompType>, "Gathering requires trivially copyable components");
+
+        if (entities.Size() != out.Size())
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::InvalidArg,
+                FormatString("Gathering [%zu] entities into a span of size [%zu]", entities.Size(), out.Size()));
+            return StatusCode::InvalidArg;
+        }
+        if (entities.IsEmpty())
+            return StatusCode::Success;
+
+        const char* base = ComponentStorageBase<CompType>(entities[0]);
+        if (!base)
+            return StatusCode::CompNotReg;
+
+        for (std::size_t i = 0; i < entities.Size(); ++i)
+            std::memcpy(&out[i], base + static_cast<std::size_t>(entities[i]) * sizeof(CompType), sizeof(CompType));
+        return StatusCode::Success;
+    }
+
+    template<typename CompType>
+    inline StatusCode EcsInstance::ComponentScatter(Span<const EntityId> entities, Span<const CompType> values)
+    {
+        static_assert(std::is_trivially_copyable_v<CompType>, "Scattering requires trivially copyable components");
+
+        if (entities.Size() != values.Size())
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::InvalidArg,
+                FormatString("Scattering [%zu] values to [%zu] entities", values.Size(), entities.Size()));
+            return StatusCode::InvalidArg;
+        }
+        if (entities.IsEmpty())
+            return StatusCode::Success;
+
+        char* base = ComponentStorageBase<CompType>(entities[0]);
+        if (!base)
+            return StatusCode::CompNotReg;
+
+        const ComponentId compId = FindComponent<CompType>()->id;
+        for (std::size_t i = 0; i < entities.Size(); ++i)
+        {
+            std::memcpy(base + static_cast<std::size_t>(entities[i]) * sizeof(CompType), &values[i], sizeof(CompType));
+            ChangeMark(compId, entities[i]);
+        }
+        return StatusCode::Success;
+    }
+
+    template<typename CompType>
+    inline StatusCode EcsInstance::ComponentSetSerialization(std::string_view stableName,
+        ComponentSerializer<CompType> serialize, ComponentDeserializer<CompType> deserialize)
+    {
+        const ComponentRecord* found = FindComponent<CompType>();
+        if (!found)
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::CompNotReg,
+                FormatString("Component of type [%s] is not registered", typeid(CompType).name()));
+            return StatusCode::CompNotReg;
+        }
+        if (stableName.empty() || !serialize != !deserialize || (!serialize && !std::is_trivially_copyable_v<CompType>))
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::InvalidArg,
+                FormatString("Component [%s] needs a stable name, and a serializer and deserializer unless it's trivially copyable",
+                    typeid(CompType).name()));
+            return StatusCode::InvalidArg;
+        }
+        if (found->tag && serialize)
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::InvalidArg,
+                FormatString("Tag [%s] is saved as presence only, without a serializer", typeid(CompType).name()));
+            return StatusCode::InvalidArg;
+        }
+        for (const ComponentRecord& other : components)
+        {
+            if (&other != found && other.stableName == stableName)
+            {
+                PICO_ECS_CPP_ERROR(StatusCode::InvalidArg,
+                    FormatString("Stable name [%s] is already used by another component", std::string(stableName).c_str()));
+                return StatusCode::InvalidArg;
+            }
+        }
+
+        ComponentRecord& comp = components[detail::TypeSlot<CompType>()];
+        comp.stableName = std::string(stableName);
+        comp.save = nullptr;
+        comp.load = nullptr;
+
+        if (serialize)
+        {
+            comp.save = [serialize](EcsInstance& ecs, EntityId id, std::string& out)
+                {
+                    serialize(*ecs.EntityReadComponent<CompType>(id), out);
+                };
+            comp.load = [deserialize](EcsInstance& ecs, EntityId id, std::string_view data)
+                {
+                    std::optional<CompType> value = deserialize(data);
+                    if (!value)
+                        return false;
+
+                    ecs.EntityEmplaceComponent<CompType>(id, std::move(*value));
+                    return true;
+                };
+        }
+        return StatusCode::Success;
+    }
+
+    inline StatusCode EcsInstance::SaveSnapshot(std::string_view path)
+    {
+        const std::uint64_t entityCount = entityHighWater;
+        const std::size_t wordCount = static_cast<std::size_t>((entityCount + 63) / 64);
+        const std::uint64_t bitmapSize = wordCount * sizeof(std::uint64_t);
+
+        std::vector<std::uint64_t> liveness(wordCount, 0);
+        for (EntityId id = 0; id < entityHighWater; ++id)
+        {
+            if (ecs_is_ready(instance, id))
+                liveness[id / 64] |= 1ull << (id % 64);
+        }
+
+        struct Section
+        {
+            const ComponentRecord* comp = nullptr;
+            detail::SnapshotEntry entry;
+            std::vector<std::uint64_t> presence;
+            std::string blob;
+            const char* column = nullptr;
+
+            // column of a sparse or chunked component, laid out like pico_ecs storage
+            std::string packed;
+            std::uint64_t columnStart = 0;
+            std::uint64_t columnSize = 0;
+        };
+
+        std::vector<Section> sections;
+        for (const ComponentRecord& comp : components)
+        {
+            if (!comp.registered || comp.stableName.empty())
+                continue;
+
+            Section section;
+            section.comp = &comp;
+            section.presence.assign(wordCount, 0);
+            section.entry.nameLength = static_cast<std::uint32_t>(comp.stableName.size());
+            section.entry.serialized = comp.save ? 1 : 0;
+            section.entry.elementSize = comp.size;
+
+            std::string data;
+            for (EntityId id = 0; id < entityHighWater; ++id)
+            {
+                if (!ecs_is_ready(instance, id) || !ComponentHasRaw(comp, id))
+                    continue;
+
+                section.presence[id / 64] |= 1ull << (id % 64);
+                if (comp.tag)
+                    continue;
+
+                if (comp.save)
+                {
+                    data.clear();
+                    comp.save(*this, id, data);
+
+                    const std::uint64_t length = data.size();
+                    section.blob.append(reinterpret_cast<const char*>(&length), sizeof(length));
+                    section.blob.append(data);
+                    section.blob.resize(static_cast<std::size_t>(detail::SnapshotAlign(section.blob.size(), 8)), '\0');
+                }
+                else if (comp.sparse || comp.chunked)
+                {
+                    section.columnSize = (static_cast<std::uint64_t>(id) + 1) * comp.size;
+                    section.packed.resize(static_cast<std::size_t>(section.columnSize), '\0');
+                    std::memcpy(&section.packed[static_cast<std::size_t>(id) * comp.size], ComponentGetRaw(comp, id), comp.size);
+                }
+                else
+                {
+                    // storage is only guaranteed to reach the last entity with the component
+                    if (!section.column)
+                        section.column = static_cast<const char*>(ecs_get(instance, id, comp.id)) - static_cast<std::size_t>(id) * comp.size;
+                    section.columnSize = (static_cast<std::uint64_t>(id) + 1) * comp.size;
+                }
+            }
+            sections.push_back(std::move(section));
+        }
+
+        struct ResourceSection
+        {
+            const ResourceRecord* resource = nullptr;
+            detail::SnapshotEntry entry;
+            std::string blob;
+        };
+
+        std::vector<ResourceSection> resourceSections;
+        for (const ResourceRecord& resource : resources)
+        {
+            if (!resource.value || resource.stableName.empty())
+                continue;
+
+            ResourceSection section;
+            section.resource = &resource;
+            section.entry.nameLength = static_cast<std::uint32_t>(resource.stableName.size());
+            section.entry.serialized = resource.save ? 1 : 0;
+            section.entry.elementSize = resource.size;
+            if (resource.save)
+                resource.save(resource.value, section.blob);
+            section.entry.size = resource.save ? section.blob.size() : resource.size;
+            resourceSections.push_back(std::move(section));
+        }
+
+        // lays out sections after the header, liveness bitmap and manifest
+        std::uint64_t position = sizeof(detail::SnapshotHeader) + bitmapSize;
+        for (Section& section : sections)
+            position += sizeof(detail::SnapshotEntry) + detail::SnapshotAlign(section.entry.nameLength, 8);
+        for (ResourceSection& section : resourceSections)
+            position += sizeof(detail::SnapshotEntry) + detail::SnapshotAlign(section.entry.nameLength, 8);
+
+        for (Section& section : sections)
+        {
+            section.entry.offset = detail::SnapshotAlign(position, 64);
+            if (section.entry.serialized)
+            {
+                section.entry.size = bitmapSize + section.blob.size();
+            }
+            else
+            {
+                section.columnStart = detail::SnapshotAlign(section.entry.offset + bitmapSize, 64);
+                section.entry.size = section.columnStart - section.entry.offset + section.columnSize;
+            }
+            position = section.entry.offset + section.entry.size;
+        }
+        for (ResourceSection& section : resourceSections)
+        {
+            section.entry.offset = detail::SnapshotAlign(position, 64);
+            position = section.entry.offset + section.entry.size;
+        }
+
+        std::ofstream file(std::string(path), std::ios::binary);
+        if (!file)
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::FileFail, FormatString("Failed to open [%s] for writing", std::string(path).c_str()));
+            return StatusCode::FileFail;
+        }
+
+        std::uint64_t written = 0;
+        auto write = [&file, &written](const void* bytes, std::uint64_t count)
+            {
+                file.write(static_cast<const char*>(bytes), static_cast<std::streamsize>(count));
+                written += count;
+            };
+        auto pad = [&write, &written](std::uint64_t target)
+            {
+                static const char zeros[64] = {};
+                while (written < target)
+                    write(zeros, std::min<std::uint64_t>(target - written, sizeof(zeros)));
+            };
+
+        detail::SnapshotHeader header;
+        header.entityCount = entityCount;
+        header.componentCount = static_cast<std::uint32_t>(sections.size());
+        header.resourceCount = static_cast<std::uint32_t>(resourceSections.size());
+        write(&header, sizeof(header));
+        write(liveness.data(), bitmapSize);
+
+        for (Section& section : sections)
+        {
+            write(&section.entry, sizeof(section.entry));
+            write(section.comp->stableName.data(), section.entry.nameLength);
+            pad(detail::SnapshotAlign(written, 8));
+        }
+        for (ResourceSection& section : resourceSections)
+        {
+            write(&section.entry, sizeof(section.entry));
+            write(section.resource->stableName.data(), section.entry.nameLength);
+            pad(detail::SnapshotAlign(written, 8));
+        }
+
+        for (Section& section : sections)
+        {
+            pad(section.entry.offset);
+            write(section.presence.data(), bitmapSize);
+            if (section.entry.serialized)
+            {
+                write(section.blob.data(), section.blob.size());
+            }
+            else
+            {
+                pad(section.columnStart);
+                write(section.column ? section.column : section.packed.data(), section.columnSize);
+            }
+        }
+        for (ResourceSection& section : resourceSections)
+        {
+            pad(section.entry.offset);
+            write(section.entry.serialized ? section.blob.data() : section.resource->value, section.entry.size);
+        }
+
+        if (!file)
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::FileFail, FormatString("Failed to write [%s]", std::string(path).c_str()));
+            return StatusCode::FileFail;
+        }
+        return StatusCode::Success;
+    }
+
+    inline StatusCode EcsInstance::LoadSnapshot(std::string_view path)
+    {
+        const std::string pathStr(path);
+
+        detail::MappedFile file;
+        if (!file.Open(pathStr))
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::FileFail, FormatString("Failed to map [%s]", pathStr.c_str()));
+            return StatusCode::FileFail;
+        }
+
+        const char* data = file.Data();
+        const std::uint64_t fileSize = file.Size();
+        auto fits = [fileSize](std::uint64_t offset, std::uint64_t count)
+            {
+                return offset <= fileSize && count <= fileSize - offset;
+            };
+        auto invalid = [&pathStr](const char* reason)
+            {
+                PICO_ECS_CPP_ERROR(StatusCode::SnapshotInvalid, FormatString("Snapshot [%s] is invalid: %s", pathStr.c_str(), reason));
+                return StatusCode::SnapshotInvalid;
+            };
+        auto bit = [](const std::uint64_t* words, std::uint64_t id)
+            {
+                std::uint64_t word;
+                std::memcpy(&word, words + id / 64, sizeof(word));
+                return ((word >> (id % 64)) & 1ull) != 0;
+            };
+
+        // validates everything before touching the instance
+        detail::SnapshotHeader header;
+        if (!fits(0, sizeof(header)))
+            return invalid("truncated header");
+        std::memcpy(&header, data, sizeof(header));
+
+        const detail::SnapshotHeader expected;
+        if (std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0)
+            return invalid("not a snapshot");
+        if (header.version != expected.version || header.byteOrder != expected.byteOrder)
+            return invalid("unsupported version or byte order");
+        if (header.entityCount / 8 > fileSize || header.entityCount > static_cast<std::uint64_t>(std::numeric_limits<int>::max()))
+            return invalid("entity count out of range");
+
+        const std::uint64_t entityCount = header.entityCount;
+        const std::uint64_t bitmapSize = (entityCount + 63) / 64 * sizeof(std::uint64_t);
+        if (!fits(sizeof(header), bitmapSize))
+            return invalid("truncated liveness bitmap");
+        const std::uint64_t* liveness = reinterpret_cast<const std::uint64_t*>(data + sizeof(header));
+
+        struct Section
+        {
+            const ComponentRecord* comp = nullptr;
+            detail::SnapshotEntry entry;
+            std::uint64_t columnStart = 0;
+        };
+
+        std::vector<Section> sections;
+        std::uint64_t position = sizeof(header) + bitmapSize;
+        for (std::uint32_t i = 0; i < header.componentCount; ++i)
+        {
+            Section section;
+            if (!fits(position, sizeof(section.entry)))
+                return invalid("truncated manifest");
+            std::memcpy(&section.entry, data + position, sizeof(section.entry));
+            position += sizeof(section.entry);
+
+            const detail::SnapshotEntry& entry = section.entry;
+            if (!fits(position, entry.nameLength))
+                return invalid("truncated manifest");
+            const std::string_view name(data + position, entry.nameLength);
+            position += detail::SnapshotAlign(entry.nameLength, 8);
+
+            for (const ComponentRecord& comp : components)
+            {
+                if (comp.registered && comp.stableName == name)
+                    section.comp = &comp;
+            }
+            if (!section.comp)
+            {
+                PICO_ECS_CPP_ERROR(StatusCode::CompNotReg,
+                    FormatString("Snapshot component [%s] is not set up for serialization", std::string(name).c_str()));
+                return StatusCode::CompNotReg;
+            }
+
+            if ((entry.serialized != 0) != static_cast<bool>(section.comp->save))
+                return invalid("component serialization doesn't match registration");
+            if (!fits(entry.offset, entry.size) || entry.size < bitmapSize)
+                return invalid("component section out of range");
+
+            const std::uint64_t* presence = reinterpret_cast<const std::uint64_t*>(data + entry.offset);
+            if (entry.serialized)
+            {
+                std::uint64_t blob = entry.offset + bitmapSize;
+                const std::uint64_t end = entry.offset + entry.size;
+                for (std::uint64_t id = 0; id < entityCount; ++id)
+                {
+                    if (!bit(presence, id))
+                        continue;
+
+                    std::uint64_t length = 0;
+                    if (!bit(liveness, id) || blob + sizeof(length) > end)
+                        return invalid("serialized component out of range");
+                    std::memcpy(&length, data + blob, sizeof(length));
+                    blob += sizeof(length);
+                    if (length > end - blob)
+                        return invalid("serialized component out of range");
+                    blob += detail::SnapshotAlign(length, 8);
+                }
+            }
+            else if (section.comp->tag)
+            {
+                if (entry.elementSize != 0)
+                    return invalid("component size doesn't match registration");
+
+                for (std::uint64_t id = 0; id < entityCount; ++id)
+                {
+                    if (bit(presence, id) && !bit(liveness, id))
+                        return invalid("tag out of range");
+                }
+            }
+            else
+            {
+                if (entry.elementSize != section.comp->size)
+                    return invalid("component size doesn't match registration");
+
+                section.columnStart = detail::SnapshotAlign(entry.offset + bitmapSize, 64);
+                const std::uint64_t sectionEnd = entry.offset + entry.size;
+                if (section.columnStart > sectionEnd || (sectionEnd - section.columnStart) % entry.elementSize != 0)
+                    return invalid("component column out of range");
+
+                const std::uint64_t slotCount = (sectionEnd - section.columnStart) / entry.elementSize;
+                for (std::uint64_t id = 0; id < entityCount; ++id)
+                {
+                    if (bit(presence, id) && (!bit(liveness, id) || id >= slotCount))
+                        return invalid("component column out of range");
+                }
+            }
+            sections.push_back(section);
+        }
+
+        struct ResourceSection
+        {
+            ResourceRecord* resource = nullptr;
+            detail::SnapshotEntry entry;
+        };
+
+        std::vector<ResourceSection> resourceSections;
+        for (std::uint32_t i = 0; i < header.resourceCount; ++i)
+        {
+            ResourceSection section;
+            if (!fits(position, sizeof(section.entry)))
+                return invalid("truncated manifest");
+            std::memcpy(&section.entry, data + position, sizeof(section.entry));
+            position += sizeof(section.entry);
+
+            const detail::SnapshotEntry& entry = section.entry;
+            if (!fits(position, entry.nameLength))
+                return invalid("truncated manifest");
+            const std::string_view name(data + position, entry.nameLength);
+            position += detail::SnapshotAlign(entry.nameLength, 8);
+
+            for (ResourceRecord& resource : resources)
+            {
+                if (resource.load && resource.stableName == name)
+                    section.resource = &resource;
+            }
+            if (!section.resource)
+            {
+                PICO_ECS_CPP_ERROR(StatusCode::ResNotSet,
+                    FormatString("Snapshot resource [%s] is not set up for serialization", std::string(name).c_str()));
+                return StatusCode::ResNotSet;
+            }
+
+            if ((entry.serialized != 0) != static_cast<bool>(section.resource->save))
+                return invalid("resource serialization doesn't match registration");
+            if (!entry.serialized && (entry.elementSize != section.resource->size || entry.size != section.resource->size))
+                return invalid("resource size doesn't match registration");
+            if (!fits(entry.offset, entry.size))
+                return invalid("resource section out of range");
+            resourceSections.push_back(section);
+        }
+
+        Reset();
+        EntityMatchLiveness(static_cast<EntityId>(entityCount), std::vector<std::uint64_t>(liveness, liveness + bitmapSize / sizeof(std::uint64_t)));
+
+        for (const Section& section : sections)
+        {
+            const ComponentRecord& comp = *section.comp;
+            const detail::SnapshotEntry& entry = section.entry;
+            const std::uint64_t* presence = reinterpret_cast<const std::uint64_t*>(data + entry.offset);
+
+            if (entry.serialized)
+            {
+                std::uint64_t blob = entry.offset + bitmapSize;
+                for (std::uint64_t id = 0; id < entityCount; ++id)
+                {
+                    if (!bit(presence, id))
+                        continue;
+
+                    std::uint64_t length = 0;
+                    std::memcpy(&length, data + blob, sizeof(length));
+                    blob += sizeof(length);
+                    if (!comp.load(*this, static_cast<EntityId>(id), std::string_view(data + blob, static_cast<std::size_t>(length))))
+                        return invalid("component deserialization failed");
+                    blob += detail::SnapshotAlign(length, 8);
+                }
+                continue;
+            }
+
+            if (comp.tag)
+            {
+                for (std::uint64_t id = 0; id < entityCount; ++id)
+                {
+                    if (bit(presence, id))
+                        TagSet(comp.id, static_cast<EntityId>(id), true);
+                }
+                continue;
+            }
+
+            // raw columns hold finished values, so constructors are not run
+            if (comp.sparse || comp.chunked)
+            {
+                for (std::uint64_t id = 0; id < entityCount; ++id)
+                {
+                    if (bit(presence, id))
+                        std::memcpy(ComponentAddBlank(comp, static_cast<EntityId>(id)), data + section.columnStart + id * comp.size, comp.size);
+                }
+                continue;
+            }
+
+            // components are added first, then their column is copied over in one pass
+            std::uint64_t first = entityCount, last = 0;
+            for (std::uint64_t id = 0; id < entityCount; ++id)
+            {
+                if (!bit(presence, id))
+                    continue;
+
+                ComponentAddBlank(comp, static_cast<EntityId>(id));
+                first = std::min(first, id);
+                last = id;
+            }
+            if (first == entityCount)
+                continue;
+
+            char* base = static_cast<char*>(ecs_get(instance, static_cast<EntityId>(first), comp.id)) - static_cast<std::size_t>(first) * comp.size;
+            std::memcpy(base, data + section.columnStart, static_cast<std::size_t>((last + 1) * comp.size));
+        }
+
+        // records of loaded resources exist already, so setting them doesn't move the records
+        for (const ResourceSection& section : resourceSections)
+        {
+            if (!section.resource->load(*this, std::string_view(data + section.entry.offset, static_cast<std::size_t>(section.entry.size))))
+                return invalid("resource deserialization failed");
+        }
+
+        ChangeMarkAll();
+        return StatusCode::Success;
+    }
+
+    inline StatusCode EcsInstance::CloneInto(EcsInstance& dst) const
+    {
+        if (&dst == this)
+            return StatusCode::Success;
+        if (!instance || !dst.instance)
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::InvalidArg, "Cloning requires initialized instances");
+            return StatusCode::InvalidArg;
+        }
+
+        const bool dstEmpty = std::none_of(dst.components.begin(), dst.components.end(),
+            [](const ComponentRecord& comp) { return comp.registered; });
+        if (!dstEmpty && !dst.ComponentLayoutMatches(*this))
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::InvalidArg, "Clone destination has a different component layout");
+            return StatusCode::InvalidArg;
+        }
+        for (const ComponentRecord& comp : components)
+        {
+            if (comp.registered && !comp.tag && !comp.trivial && !comp.copy)
+            {
+                PICO_ECS_CPP_ERROR(StatusCode::InvalidArg, "Cloning requires copy constructible components");
+                return StatusCode::InvalidArg;
+            }
+        }
+        for (const ResourceRecord& resource : resources)
+        {
+            if (resource.value && !resource.copy)
+            {
+                PICO_ECS_CPP_ERROR(StatusCode::InvalidArg,
+                    FormatString("Cloning requires copy constructible resources, [%s] isn't", resource.typeName));
+                return StatusCode::InvalidArg;
+            }
+        }
+
+        // registrations are copied in id order, so pico_ecs assigns the same ids
+        if (dstEmpty)
+        {
+            std::vector<const ComponentRecord*> ordered;
+            for (const ComponentRecord& comp : components)
+            {
+                if (comp.registered)
+                    ordered.push_back(&comp);
+            }
+            std::sort(ordered.begin(), ordered.end(),
+                [](const ComponentRecord* first, const ComponentRecord* second) { return first->id < second->id; });
+
+            dst.components.resize(components.size());
+            dst.tagBits.resize(tagBits.size());
+            dst.sparseColumns.resize(sparseColumns.size());
+            dst.chunkedComponents = chunkedComponents;
+            for (const ComponentRecord* comp : ordered)
+            {
+                ComponentRecord& copied = dst.components[static_cast<std::size_t>(comp - components.data())];
+                copied = *comp;
+                if (comp->sparse)
+                    dst.sparseColumns[comp->id] = std::make_unique<SparseColumn>(comp->size, comp->relocate, comp->dtor, &dst.memory);
+                else if (!comp->tag && !comp->chunked)
+                    copied.id = dst.ComponentRegisterRaw(*comp);
+            }
+        }
+
+        const EntityId count = entityHighWater;
+        std::vector<std::uint64_t> live;
+        LiveGather(live);
+        dst.EntityMatchLiveness(count, live);
+
+        for (const ComponentRecord& comp : components)
+        {
+            if (!comp.registered)
+                continue;
+
+            if (comp.tag)
+            {
+                for (EntityId id = 0; id < count; ++id)
+                    dst.TagSet(comp.id, id, ecs_is_ready(instance, id) && TagHas(comp.id, id));
+                continue;
+            }
+
+            const ComponentId compId = comp.id;
+            EntityId first = count, last = 0;
+            for (EntityId id = 0; id < count; ++id)
+            {
+                const bool srcHas = ecs_is_ready(instance, id) && ComponentHasRaw(comp, id);
+                const bool dstHas = ecs_is_ready(dst.instance, id) && dst.ComponentHasRaw(comp, id);
+                if (!srcHas)
+                {
+                    if (dstHas)
+                        dst.ComponentRemoveRaw(comp, id);
+                    continue;
+                }
+
+                // constructors aren't run, their args mean whatever the component defines
+                void* source = ComponentGetRaw(comp, id);
+                if (comp.trivial && !comp.InTagBits())
+                {
+                    // values are copied in bulk below
+                    if (!dstHas)
+                        dst.ComponentAddBlank(comp, id);
+                    first = std::min(first, id);
+                    last = id;
+                }
+                else if (comp.trivial)
+                {
+                    void* target = dstHas ? dst.ComponentGetRaw(comp, id) : dst.ComponentAddBlank(comp, id);
+                    std::memcpy(target, source, comp.size);
+                }
+                else
+                {
+                    void* target = dstHas ? dst.ComponentGetRaw(comp, id) : dst.ComponentAddBlank(comp, id);
+                    if (dstHas && comp.dtor)
+                        comp.dtor(dst.instance, id, target);
+                    comp.copy(target, source);
+                }
+            }
+
+            if (first == count)
+                continue;
+
+            const std::size_t offset = static_cast<std::size_t>(first) * comp.size;
+            const char* sourceBase = static_cast<const char*>(ecs_get(instance, first, compId)) - offset;
+            char* targetBase = static_cast<char*>(ecs_get(dst.instance, first, compId)) - offset;
+            std::memcpy(targetBase + offset, sourceBase + offset, static_cast<std::size_t>(last - first + 1) * comp.size);
+        }
+
+        // resources are copied along with their serialization, dst loses the ones this instance doesn't have
+        if (dst.resources.size() < resources.size())
+            dst.resources.resize(resources.size());
+        for (std::size_t slot = 0; slot < dst.resources.size(); ++slot)
+        {
+            ResourceRecord& target = dst.resources[slot];
+            dst.ResourceDestroy(target);
+            if (slot >= resources.size() || !resources[slot].value)
+                continue;
+
+            const ResourceRecord& source = resources[slot];
+            if (!target.dtor)
+            {
+                target = source;
+                target.value = nullptr;
+            }
+            target.value = detail::MemoryAllocate(source.size, &dst.memory);
+            source.copy(target.value, source.value);
+        }
+
+        dst.ChangeMarkAll();
+        return StatusCode::Success;
+    }
+
+    inline void EcsInstance::EntityMatchLiveness(EntityId count, const std::vector<std::uint64_t>& live)
+    {
+        LiveSync();
+        const auto wanted = [&](EntityId id) {
+            const std::size_t word = static_cast<std::size_t>(id) / 64;
+            return id < count && word < live.size() && (live[word] >> (id % 64)) & 1;
+        };
+
+        const std::size_t words = (static_cast<std::size_t>(std::max(count, entityHighWater)) + 63) / 64;
+        if (liveBits.size() < words)
+            liveBits.resize(words, 0);
+        std::size_t missing = 0;
+        for (std::size_t word = 0; word < words; ++word)
+        {
+            std::uint64_t want = word < live.size() ? live[word] : 0;
+            const std::size_t base = word * 64;
+            if (base >= count)
+                want = 0;
+            else if (count - base < 64)
+                want &= (1ull << (count - base)) - 1;
+
+            for (std::uint64_t extra = liveBits[word] & ~want; extra; extra &= extra - 1)
+                EntityDestroy(static_cast<EntityId>(base + detail::LowestBit(extra)));
+            for (std::uint64_t absent = want & ~liveBits[word]; absent; absent &= absent - 1)
+                ++missing;
+        }
+
+        /*
+        * pico_ecs can't hand out a given id, so entities are created until all missing ids came up.
+        * the others are freed in reverse, which leaves the free list as it was
+        */
+        std::vector<EntityId> unused;
+        while (missing > 0)
+        {
+            const EntityId id = ecs_create(instance);
+            if (!wanted(id))
+            {
+                unused.push_back(id);
+                continue;
+            }
+
+            --missing;
+            entityHighWater = std::max(entityHighWater, id + 1);
+            LiveSet(id, true);
+            if (!tagBits.empty())
+                TagClearEntity(id);
+        }
+        for (auto id = unused.rbegin(); id != unused.rend(); ++id)
+            ecs_destroy(instance, *id);
+
+        if (!changeColumns.empty())
+            ChangeGrow();
+        entityHighWater = count;
+    }
+
+    inline void EcsInstance::LiveSet(EntityId id, bool live)
+    {
+        const std::size_t word = static_cast<std::size_t>(id) / 64;
+        if (word >= liveBits.size())
+            liveBits.resize(word + 1, 0);
+        if (live)
+            liveBits[word] |= 1ull << (id % 64);
+        else
+            liveBits[word] &= ~(1ull << (id % 64));
+    }
+
+    inline void EcsInstance::LiveSync()
+    {
+        if (liveQueued.empty())
+            return;
+
+        // an id can be queued again once it was reused
+        std::sort(liveQueued.begin(), liveQueued.end());
+        liveQueued.erase(std::unique(liveQueued.begin(), liveQueued.end()), liveQueued.end());
+        liveQueued.erase(std::remove_if(liveQueued.begin(), liveQueued.end(), [this](EntityId id) {
+            if (ecs_is_ready(instance, id))
+                return false;
+            LiveSet(id, false);
+            return true;
+        }), liveQueued.end());
+    }
+
+    inline void EcsInstance::LiveGather(std::vector<std::uint64_t>& out) const
+    {
+        out = liveBits;
+        for (EntityId id : liveQueued)
+        {
+            if (!ecs_is_ready(instance, id))
+                out[static_cast<std::size_t>(id) / 64] &= ~(1ull << (id % 64));
+        }
+    }
+
+    inline void EcsInstance::EntityRenumber(EntityId from, EntityId to)
+    {
+        for (const ComponentRecord& comp : components)
+        {
+            if (!comp.registered || comp.InTagBits() || !ecs_has(instance, from, comp.id))
+                continue;
+
+            // constructors aren't run, the source is destroyed by ecs_remove once its value was moved or copied out
+            void* source = ecs_get(instance, from, comp.id);
+            void* target = ComponentAddBlank(comp, to);
+            if (comp.trivial)
+                std::memcpy(target, source, comp.size);
+            else
+                (comp.move ? comp.move : comp.copy)(target, source);
+            ecs_remove(instance, from, comp.id);
+        }
+
+        // tags, sparse and chunked components stay where they are, only the id they are found by changes
+        const std::size_t fromWord = static_cast<std::size_t>(from) / 64;
+        const std::size_t toWord = static_cast<std::size_t>(to) / 64;
+        for (std::vector<std::uint64_t>& bits : tagBits)
+        {
+            if (fromWord >= bits.size() || !(bits[fromWord] & (1ull << (from % 64))))
+                continue;
+
+            bits[fromWord] &= ~(1ull << (from % 64));
+            bits[toWord] |= 1ull << (to % 64);
+        }
+        for (std::unique_ptr<SparseColumn>& column : sparseColumns)
+        {
+            if (column && column->storage.Get(from))
+                column->storage.Rename(from, to);
+        }
+        if (from < entityLocations.size() && entityLocations[from].archetype != 0)
+        {
+            const EntityLocation location = entityLocations[from];
+            reinterpret_cast<EntityId*>(archetypes[location.archetype]->chunks[location.chunk].data)[location.row] = to;
+            entityLocations[to] = location;
+            entityLocations[from] = EntityLocation();
+        }
+
+        for (ChangeColumn& column : changeColumns)
+        {
+            if (from < column.ticks.size())
+                column.ticks[to] = column.ticks[from];
+        }
+    }
+
+    inline bool EcsInstance::ComponentLayoutMatches(const EcsInstance& other) const
+    {
+        const std::size_t slots = std::max(components.size(), other.components.size());
+        for (std::size_t slot = 0; slot < slots; ++slot)
+        {
+            const bool registered = slot < components.size() && components[slot].registered;
+            const bool otherRegistered = slot < other.components.size() && other.components[slot].registered;
+            if (registered != otherRegistered)
+                return false;
+            if (registered && (components[slot].id != other.components[slot].id || components[slot].size != other.components[slot].size
+                || components[slot].tag != other.components[slot].tag || components[slot].sparse != other.components[slot].sparse
+                || components[slot].chunked != other.components[slot].chunked))
+                return false;
+        }
+        return true;
+    }
+
+    inline FrameHistory::FrameHistory(std::size_t capacity, int entityCount)
+    {
+        for (std::size_t i = 0; i < capacity; ++i)
+            frames.push_back(std::make_unique<EcsInstance>(entityCount));
+    }
+
+    inline StatusCode FrameHistory::Push(const EcsInstance& ecs)
+    {
+        if (frames.empty())
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::InvalidArg, "Frame history has no capacity");
+            return StatusCode::InvalidArg;
+        }
+
+        const std::size_t slot = size == 0 ? newest : (newest + 1) % frames.size();
+        const StatusCode code = ecs.CloneInto(*frames[slot]);
+        if (code != StatusCode::Success)
+            return code;
+
+        newest = slot;
+        size = std::min(size + 1, frames.size());
+        return StatusCode::Success;
+    }
+
+    inline StatusCode FrameHistory::Restore(std::size_t age, EcsInstance& ecs) const
+    {
+        const EcsInstance* frame = Get(age);
+        if (!frame)
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::InvalidArg,
+                FormatString("Frame history holds [%zu] frames, frame [%zu] was requested", size, age));
+            return StatusCode::InvalidArg;
+        }
+        return frame->CloneInto(ecs);
+    }
+
+    inline void FrameHistory::Pop(std::size_t count)
+    {
+        count = std::min(count, size);
+        if (frames.empty() || count == 0)
+            return;
+
+        size -= count;
+        newest = (newest + frames.size() - count % frames.size()) % frames.size();
+    }
+
+    inline const EcsInstance* FrameHistory::Get(std::size_t age) const
+    {
+        if (age >= size)
+            return nullptr;
+        return frames[(newest + frames.size() - age) % frames.size()].get();
+    }
+
+    inline std::size_t FrameHistory::Size() const
+    {
+        return size;
+    }
+
+    inline std::size_t FrameHistory::Capacity() const
+    {
+        return frames.size();
+    }
+
+    inline void FrameHistory::Clear()
+    {
+        size = 0;
+    }
+
+    template<typename CompType>
+    inline char* EcsInstance::ComponentStorageBase(EntityId id)
+    {
+        const ComponentRecord* comp = FindComponent<CompType>();
+        if (!comp)
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::CompNotReg,
+                FormatString("Component of type [%s] is not registered", typeid(CompType).name()));
+            return nullptr;
+        }
+
+        if (comp->tag)
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::CompGetFail,
+                FormatString("Tag [%s] has no storage", typeid(CompType).name()));
+            return nullptr;
+        }
+        if (comp->sparse)
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::CompGetFail,
+                FormatString("Component [%s] has sparse storage, which is not indexed by entity id", typeid(CompType).name()));
+            return nullptr;
+        }
+        if (comp->chunked)
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::CompGetFail,
+                FormatString("Component [%s] is kept in archetype chunks, which are not indexed by entity id", typeid(CompType).name()));
+            return nullptr;
+        }
+
+        return static_cast<char*>(ecs_get(instance, id, comp->id)) - static_cast<std::size_t>(id) * sizeof(CompType);
+    }
+
+    template<typename CompType>
+    inline StatusCode EcsInstance::ComponentRegister(ComponentCtor ctor, ComponentDtor dtor)
+    {
+        return ComponentRegister<CompType>(ComponentStorage::Dense, ctor, dtor);
+    }
+
+    template<typename CompType>
+    inline StatusCode EcsInstance::ComponentRegister(ComponentStorage storage, ComponentCtor ctor, ComponentDtor dtor)
+    {
+        if (FindComponent<CompType>())
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::CompExists, 
+                FormatString("Component [%s] is already registered", typeid(CompType).name()));
+            return StatusCode::CompExists;
+        }
+
+        const std::size_t slot = detail::TypeSlot<CompType>();
+        if (slot >= components.size())
+            components.resize(slot + 1);
+
+        if constexpr (detail::isTag<CompType>)
+        {
+            if (!ctor && !dtor)
+            {
+                components[slot].id = static_cast<ComponentId>(tagBits.size());
+                components[slot].registered = true;
+                components[slot].tag = true;
+                components[slot].trivial = true;
+                tagBits.emplace_back();
+                return StatusCode::Success;
+            }
+        }
+
+        bool managed = false;
+        if constexpr (!std::is_trivially_copyable_v<CompType>)
+        {
+            if (!ctor && !dtor)
+            {
+                ctor = &ComponentConstructThunk<CompType>;
+                dtor = &ComponentDestroyThunk<CompType>;
+                managed = true;
+            }
+        }
+
+        const bool chunked = storage == ComponentStorage::Dense && backend == StorageBackend::Archetypes;
+        if ((storage == ComponentStorage::Sparse || chunked) && alignof(CompType) > alignof(std::max_align_t))
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::InvalidArg,
+                FormatString("Component [%s] needs an alignment of [%zu], sparse and chunked storage only provide [%zu]",
+                    typeid(CompType).name(), alignof(CompType), alignof(std::max_align_t)));
+            return StatusCode::InvalidArg;
+        }
+        if (storage == ComponentStorage::Sparse || chunked)
+        {
+            if constexpr (std::is_move_constructible_v<CompType>)
+                components[slot].relocate = managed ? &ComponentRelocate<CompType> : nullptr;
+
+            components[slot].id = static_cast<ComponentId>(tagBits.size());
+            tagBits.emplace_back();
+            if (chunked)
+            {
+                components[slot].chunked = true;
+                chunkedComponents.resize(tagBits.size());
+                chunkedComponents.back() = ChunkedComponent{ sizeof(CompType), components[slot].relocate, dtor };
+            }
+            else
+            {
+                components[slot].sparse = true;
+                sparseColumns.resize(tagBits.size());
+                sparseColumns.back() = std::make_unique<SparseColumn>(sizeof(CompType), components[slot].relocate, dtor, &memory);
+            }
+        }
+        components[slot].registered = true;
+        components[slot].ctor = ctor;
+        components[slot].dtor = dtor;
+        components[slot].managed = managed;
+        components[slot].size = sizeof(CompType);
+        if (!components[slot].InTagBits())
+            components[slot].id = ComponentRegisterRaw(components[slot]);
+        components[slot].trivial = std::is_trivially_copyable_v<CompType>;
+        if constexpr (std::is_copy_constructible_v<CompType>)
+            components[slot].copy = &ComponentCopy<CompType>;
+        if constexpr (std::is_move_constructible_v<CompType>)
+            components[slot].move = &ComponentMove<CompType>;
+        return StatusCode::Success;
+    }
+
+    template<typename CompType>
+    inline void EcsInstance::ComponentConstructThunk(Ecs* ecs, EntityId id, void* ptr, void* args)
+    {
+        const ComponentInit* init = static_cast<const ComponentInit*>(args);
+        if (init)
+            init->construct(ptr, init->ctx);
+        else if constexpr (std::is_default_constructible_v<CompType>)
+            new (ptr) CompType();
+    }
+
+    template<typename CompType>
+    inline void EcsInstance::ComponentDestroyThunk(Ecs* ecs, EntityId id, void* ptr)
+    {
+        static_cast<CompType*>(ptr)->~CompType();
+    }
+
+    inline void EcsInstance::ComponentCtorThunk(Ecs* ecs, EntityId id, void* ptr, void* args)
+    {
+        const ComponentCtorArgs* call = static_cast<const ComponentCtorArgs*>(args);
+        if (call)
+            call->ctor(ecs, id, ptr, call->args);
+    }
+
+    template<typename CompType>
+    inline void EcsInstance::ComponentCopy(void* ptr, void* ctx)
+    {
+        new (ptr) CompType(*static_cast<const CompType*>(ctx));
+    }
+
+    template<typename CompType>
+    inline void EcsInstance::ComponentRelocate(void* dst, void* src)
+    {
+        new (dst) CompType(std::move(*static_cast<CompType*>(src)));
+        static_cast<CompType*>(src)->~CompType();
+    }
+
+    template<typename CompType>
+    inline void EcsInstance::ComponentMove(void* ptr, void* ctx)
+    {
+        new (ptr) CompType(std::move(*static_cast<CompType*>(ctx)));
+    }
+
+    inline void EcsInstance::ComponentAddManaged(const ComponentRecord& comp, EntityId id, const ComponentInit* init)
+    {
+        if (ComponentHasRaw(comp, id))
+            comp.dtor(instance, id, ComponentGetRaw(comp, id));
+
+        ComponentAddRaw(comp, id, const_cast<ComponentInit*>(init));
+        ChangeMark(comp, id);
+    }
+
+    inline void* EcsInstance::ComponentAddRaw(const ComponentRecord& comp, EntityId id, void* args)
+    {
+        if (comp.sparse)
+            return SparseAdd(comp, id, comp.ctor, args);
+        if (comp.chunked)
+            return ArchetypeAdd(comp, id, comp.ctor, args);
+        if (comp.ctor && !comp.managed)
+        {
+            ComponentCtorArgs call{ comp.ctor, args };
+            return PicoAdd(comp, id, &call);
+        }
+        return PicoAdd(comp, id, args);
+    }
+
+    inline void* EcsInstance::ComponentAddBlank(const ComponentRecord& comp, EntityId id)
+    {
+        // generated constructors get one that does nothing, ComponentCtorThunk does nothing without args
+        static const ComponentInit blank{ [](void* ptr, void* ctx) {}, nullptr };
+        if (comp.sparse)
+            return SparseAdd(comp, id, nullptr, nullptr);
+        if (comp.chunked)
+            return ArchetypeAdd(comp, id, nullptr, nullptr);
+        return PicoAdd(comp, id, comp.managed ? const_cast<ComponentInit*>(&blank) : nullptr);
+    }
+
+    inline ComponentId EcsInstance::ComponentRegisterRaw(const ComponentRecord& comp)
+    {
+        ComponentCtor ctor = comp.ctor && !comp.managed ? &ComponentCtorThunk : comp.ctor;
+        return ecs_register_component(instance, comp.size, ctor, comp.dtor);
+    }
+
+    inline void* EcsInstance::ComponentGetRaw(const ComponentRecord& comp, EntityId id) const
+    {
+        if (comp.sparse)
+            return sparseColumns[comp.id]->storage.Get(id);
+        if (comp.chunked)
+            return ArchetypeGet(comp.id, id);
+        return ecs_get(instance, id, comp.id);
+    }
+
+    inline bool EcsInstance::ComponentHasRaw(const ComponentRecord& comp, EntityId id) const
+    {
+        return comp.InTagBits() ? TagHas(comp.id, id) : ecs_has(instance, id, comp.id);
+    }
+
+    inline void EcsInstance::ComponentRemoveRaw(const ComponentRecord& comp, EntityId id)
+    {
+        if (comp.sparse || comp.chunked)
+        {
+            if (comp.sparse)
+                SparseRemove(comp.id, id);
+            else
+                ArchetypeRemove(comp.id, id);
+            TagSet(comp.id, id, false);
+            return;
+        }
+        PicoRemove(comp, id);
+    }
+
+    inline void* EcsInstance::PicoAdd(const ComponentRecord& comp, EntityId id, void* args)
+    {
+        ObserverColumn* column = comp.id < observerColumns.size() ? observerColumns[comp.id].get() : nullptr;
+        const bool queried = comp.id < componentQueries.size() && !componentQueries[comp.id].empty();
+        const bool added = (column || queried) && !ecs_has(instance, id, comp.id);
+        void* ptr = ecs_add(instance, id, comp.id, args);
+        if (added && column)
+            ObserverRaiseAdded(*column, id);
+        if (added && queried)
+            QueryRecheck(componentQueries[comp.id], id);
+        return ptr;
+    }
+
+    inline void EcsInstance::PicoRemove(const ComponentRecord& comp, EntityId id)
+    {
+        ObserverColumn* column = comp.id < observerColumns.size() ? observerColumns[comp.id].get() : nullptr;
+        const bool queried = comp.id < componentQueries.size() && !componentQueries[comp.id].empty();
+        const bool removed = (column || queried) && ecs_has(instance, id, comp.id);
+        if (removed && column)
+            ObserverRaiseRemoved(*column, id);
+        ecs_remove(instance, id, comp.id);
+        if (removed && queried)
+            QueryRecheck(componentQueries[comp.id], id);
+    }
+
+    inline void EcsInstance::ComponentDestroyAll()
+    {
+        if (!instance)
+            return;
+
+        for (const ComponentRecord& comp : components)
+        {
+            // sparse and chunked components are destroyed by SparseClear and ArchetypeClear
+            if (!comp.registered || !comp.managed || comp.sparse || comp.chunked)
+                continue;
+
+            for (EntityId id = 0; id < entityHighWater; ++id)
+            {
+                if (ecs_is_ready(instance, id) && ecs_has(instance, id, comp.id))
+                    comp.dtor(instance, id, ecs_get(instance, id, comp.id));
+            }
+        }
+    }
+
+    inline StatusCode EcsInstance::SystemRegister(std::string_view name, SystemFunc func, SystemAddedCb add, SystemRemovedCb rem, SystemHandle* handle)
+    {
+        auto record = std::make_unique<SystemRecord>();
+        record->func = func;
+        record->added = add;
+        record->removed = rem;
+        return SystemRegisterRecord(name, std::move(record), handle);
+    }
+
+    inline StatusCode EcsInstance::SystemRegister(std::string_view name, SystemFunc func, const ParallelOptions& parallel, SystemHandle* handle)
+    {
+        auto record = std::make_unique<SystemRecord>();
+        record->func = func;
+        record->parallel = true;
+        record->parallelOptions = parallel;
+        return SystemRegisterRecord(name, std::move(record), handle);
+    }
+
+    template<typename ... Signature, typename Func>
+    inline StatusCode EcsInstance::SystemRegister(std::string_view name, Func&& func, SystemHandle* handle)
+    {
+        return SystemRegisterCallable<Signature...>(name, std::forward<Func>(func), nullptr, handle);
+    }
+
+    template<typename ... Signature, typename Func>
+    inline StatusCode EcsInstance::SystemRegister(std::string_view name, Func&& func, const ParallelOptions& parallel, SystemHandle* handle)
+    {
+        return SystemRegisterCallable<Signature...>(name, std::forward<Func>(func), &parallel, handle);
+    }
+
+    template<typename ... Signature, typename Func>
+    inline StatusCode EcsInstance::SystemRegisterCallable(std::string_view name, Func&& func, const ParallelOptions* parallel, SystemHandle* handle)
+    {
+        if (!(SignatureRegistered(Signature{}) && ...))
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::CompNotReg,
+                FormatString("Signature of system [%s] contains unregistered components", std::string(name).c_str()));
+            return StatusCode::CompNotReg;
+        }
+
+        using Callable = std::decay_t<Func>;
+
+        auto record = std::make_unique<SystemRecord>();
+        record->callable = new Callable(std::forward<Func>(func));
+        record->invoke = &SystemInvoke<Callable, Signature...>;
+        record->release = &SystemRelease<Callable>;
+        if (parallel)
+        {
+            record->parallel = true;
+            record->parallelOptions = *parallel;
+        }
+
+        SystemRecord* recordPtr = record.get();
+        StatusCode code = SystemRegisterRecord(name, std::move(record), handle);
+        if (code != StatusCode::Success)
+            return code;
+
+        (SignatureApply(recordPtr->id, Signature{}), ...);
+        return StatusCode::Success;
+    }
+
+    inline StatusCode EcsInstance::SystemRegisterRecord(std::string_view name, std::unique_ptr<SystemRecord> record, SystemHandle* handle)
+    {
+        if (systems.find(name) != systems.end())
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::SysExists,
+                FormatString("System [%s] is already registered", std::string(name).c_str()));
+            return StatusCode::SysExists;
+        }
+
+        // pico_ecs asserts once its systems are used up
+        if (systemRecords.size() >= PICO_ECS_CPP_MAX_SYSTEMS)
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::SysRegFail,
+                FormatString("System [%s] exceeds the limit of [%i] systems, see ECS_MAX_SYSTEMS", std::string(name).c_str(), PICO_ECS_CPP_MAX_SYSTEMS));
+            return StatusCode::SysRegFail;
+        }
+
+        record->owner = this;
+        record->name = name;
+        record->id = ecs_register_system(instance, SystemTrampoline, SystemAddedTrampoline, SystemRemovedTrampoline, record.get());
+
+        if (record->id >= systemRecords.size())
+            systemRecords.resize(record->id + 1);
+
+        systems[record->name] = record->id;
+        scheduleDirty = true;
+        if (handle) *handle = SystemHandle(record->id);
+        systemRecords[record->id] = std::move(record);
+
+        return StatusCode::Success;
+    }
+
+    inline SystemHandle EcsInstance::SystemGetHandle(std::string_view sysName) const
+    {
+        auto it = systems.find(sysName);
+        if (it == systems.end())
+            return SystemHandle();
+        return SystemHandle(it->second);
+    }
+
+    inline SystemHandle EcsInstance::SystemFind(std::string_view sysName) const
+    {
+        auto it = systems.find(sysName);
+        if (it == systems.end())
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::SysNotReg,
+                FormatString("Name [%s] is not associated with any registered system", std::string(sysName).c_str()));
+            return SystemHandle();
+        }
+        return SystemHandle(it->second);
+    }
+
+    inline bool EcsInstance::SystemIsRegistered(SystemHandle sys) const
+    {
+        if (sys.id < systemRecords.size() && systemRecords[sys.id])
+            return true;
+
+        PICO_ECS_CPP_ERROR(StatusCode::SysNotReg,
+            FormatString("Handle [%u] is not associated with any registered system", static_cast<unsigned>(sys.id)));
+        return false;
+    }
+
+    inline EcsInstance::SystemRecord::~SystemRecord()
+    {
+        if (release) release(callable);
+    }
+
+    inline ReturnCode EcsInstance::SystemRun(SystemRecord& record, EntityId* entities, int entityCount, EcsDt dt)
+    {
+        // commands recorded by systems play back in registration order, then chunk order
+        std::uint64_t& orderKey = detail::CommandOrderKey();
+        const std::uint64_t previousKey = orderKey;
+        const std::uint64_t systemKey = (static_cast<std::uint64_t>(record.id) + 1) << 32;
+        orderKey = systemKey;
+
+        // every run gets its own tick, the system doesn't see its own changes on its next run
+        detail::ChangeScope& changeScope = detail::CurrentChangeScope();
+        const detail::ChangeScope previousScope = changeScope;
+        const std::uint32_t runTick = changeTick.fetch_add(1, std::memory_order_relaxed) + 1;
+        changeScope = detail::ChangeScope{ this, runTick };
+
+        if (!record.tagRequire.empty() || !record.tagExclude.empty())
+        {
+            Span<EntityId> taggedEntities = TagFilter(record, entities, entityCount);
+            entities = taggedEntities.Data();
+            entityCount = static_cast<int>(taggedEntities.Size());
+        }
+
+        if (!record.changed.empty())
+        {
+            Span<EntityId> changedEntities = ChangeFilter(record, entities, entityCount);
+            entities = changedEntities.Data();
+            entityCount = static_cast<int>(changedEntities.Size());
+        }
+
+        if (record.sortKey)
+        {
+            Span<EntityId> sortedEntities = SystemSort(record, entities, entityCount);
+            entities = sortedEntities.Data();
+            entityCount = static_cast<int>(sortedEntities.Size());
+        }
+
+        if (record.rate.mode == SystemRate::Mode::TimeSliced)
+        {
+            // the slice after the last one starts over
+            const int sliceSize = (entityCount + record.rate.frames - 1) / record.rate.frames;
+            const int begin = record.sliceCursor < entityCount ? record.sliceCursor : 0;
+            const int count = std::min(sliceSize, entityCount - begin);
+            record.sliceCursor = begin + count;
+            entities += begin;
+            entityCount = count;
+        }
+
+        if (!record.parallel)
+        {
+            ReturnCode code = SystemInvokeRecord(record, entities, entityCount, dt);
+            if (!removalQueue.empty())
+                RemovalQueueFlush();
+            record.lastRunTick = runTick;
+            changeScope = previousScope;
+            orderKey = previousKey;
+            return code;
+        }
+
+        // keeps the code of the first failed chunk, in chunk order if the merge is deterministic
+        std::mutex codeMutex;
+        ReturnCode code = 0;
+        int codeChunk = std::numeric_limits<int>::max();
+        const bool ordered = record.parallelOptions.deterministicMerge;
+
+        // chunks run concurrently, so their queued destroys and removals wait for all of them
+        const bool defer = threadPool && !deferQueue;
+        if (defer)
+            deferQueue = true;
+
+        ParallelChunks(entityCount, record.parallelOptions, [&](int chunk, int begin, int count)
+            {
+                ReturnCode chunkCode = SystemInvokeRecord(record, entities + begin, count, dt);
+
+                if (chunkCode != 0)
+                {
+                    std::lock_guard<std::mutex> lock(codeMutex);
+                    if (code == 0 || (ordered && chunk < codeChunk))
+                    {
+                        code = chunkCode;
+                        codeChunk = chunk;
+                    }
+                }
+            });
+
+        if (defer)
+        {
+            deferQueue = false;
+            DeferredQueueFlush();
+        }
+        if (!removalQueue.empty())
+            RemovalQueueFlush();
+        record.lastRunTick = runTick;
+        changeScope = previousScope;
+        orderKey = previousKey;
+        return code;
+    }
+
+    inline ReturnCode EcsInstance::SystemInvokeRecord(SystemRecord& record, EntityId* entities, int entityCount, EcsDt dt)
+    {
+        if (record.invoke)
+            return record.invoke(record.callable, *this, entities, entityCount, dt);
+        return record.func(instance, entities, entityCount, dt, this);
+    }
+
+    inline Span<EntityId> EcsInstance::SystemSort(SystemRecord& record, EntityId* entities, int entityCount)
+    {
+        // pico_ecs owns the entity array, so the sorted ids go to the record
+        record.sortKeys.clear();
+        for (int i = 0; i < entityCount; ++i)
+            record.sortKeys.emplace_back(record.sortKey(*this, entities[i]), entities[i]);
+        detail::SortByKey(record.sortKeys, record.sortScratch);
+
+        record.sortedEntities.clear();
+        for (const auto& [key, id] : record.sortKeys)
+            record.sortedEntities.push_back(id);
+        return Span<EntityId>(record.sortedEntities);
+    }
+
+    inline int EcsInstance::ParallelChunkSize(const ParallelOptions& options)
+    {
+        constexpr int entitiesPerCacheLine = static_cast<int>(64 / sizeof(EntityId));
+        const int chunkSize = std::max(options.minChunkSize, 1);
+        return (chunkSize + entitiesPerCacheLine - 1) / entitiesPerCacheLine * entitiesPerCacheLine;
+    }
+
+    template<typename Func>
+    inline void EcsInstance::ParallelChunks(int count, const ParallelOptions& options, Func&& func)
+    {
+        if (count <= 0)
+            return;
+
+        const int chunkSize = ParallelChunkSize(options);
+        const int chunkCount = (count + chunkSize - 1) / chunkSize;
+
+        // commands recorded by a chunk play back in chunk order, after the ones of the caller
+        const std::uint64_t callerKey = detail::CommandOrderKey();
+        const bool keyChunks = (callerKey & 0xFFFFFFFFu) == 0;
+
+        // chunks mark changes with the tick of the caller
+        const detail::ChangeScope callerScope = detail::CurrentChangeScope();
+
+        auto runChunk = [&](int chunk)
+            {
+                std::uint64_t& orderKey = detail::CommandOrderKey();
+                const std::uint64_t previousKey = orderKey;
+                orderKey = keyChunks ? callerKey | static_cast<std::uint64_t>(chunk + 1) : callerKey;
+
+                detail::ChangeScope& changeScope = detail::CurrentChangeScope();
+                const detail::ChangeScope previousScope = changeScope;
+                changeScope = callerScope;
+
+                const int begin = chunk * chunkSize;
+                func(chunk, begin, std::min(chunkSize, count - begin));
+                changeScope = previousScope;
+                orderKey = previousKey;
+            };
+
+        if (!threadPool || chunkCount == 1)
+        {
+            for (int chunk = 0; chunk < chunkCount; ++chunk)
+                runChunk(chunk);
+            return;
+        }
+
+        // every runner takes chunks until none are left, idle workers steal queued runners
+        std::atomic<int> nextChunk{ 0 };
+        auto runner = [&]()
+            {
+                for (int chunk = nextChunk++; chunk < chunkCount; chunk = nextChunk++)
+                    runChunk(chunk);
+            };
+
+        const int runnerCount = std::min(chunkCount, static_cast<int>(threadPool->GetWorkerCount()) + 1);
+        std::atomic<int> pendingRunners{ runnerCount - 1 };
+        for (int i = 1; i < runnerCount; ++i)
+        {
+            threadPool->Submit([&]()
+                {
+                    runner();
+                    --pendingRunners;
+                });
+        }
+
+        runner();
+        threadPool->WaitFor(pendingRunners);
+    }
+
+    template<typename Func>
+    inline void EcsInstance::ParallelFor(EntityId* entities, int entityCount, const ParallelOptions& options, Func&& func)
+    {
+        ParallelChunks(entityCount, options, [&](int chunk, int begin, int count)
+            {
+                func(entities + begin, count);
+            });
+    }
+
+    template<typename T, typename MapFunc, typename MergeFunc>
+    inline T EcsInstance::ParallelReduce(EntityId* entities, int entityCount, const ParallelOptions& options,
+        T init, MapFunc&& map, MergeFunc&& merge)
+    {
+        T result = std::move(init);
+
+        if (options.deterministicMerge)
+        {
+            const int chunkSize = ParallelChunkSize(options);
+            std::vector<std::optional<T>> partials(static_cast<std::size_t>((std::max(entityCount, 0) + chunkSize - 1) / chunkSize));
+
+            ParallelChunks(entityCount, options, [&](int chunk, int begin, int count)
+                {
+                    partials[chunk].emplace(map(entities + begin, count));
+                });
+
+            for (std::optional<T>& partial : partials)
+                result = merge(std::move(result), std::move(*partial));
+            return result;
+        }
+
+        std::mutex resultMutex;
+        ParallelChunks(entityCount, options, [&](int chunk, int begin, int count)
+            {
+                T partial = map(entities + begin, count);
+                std::lock_guard<std::mutex> lock(resultMutex);
+                result = merge(std::move(result), std::move(partial));
+            });
+        return result;
+    }
+
+    inline ReturnCode EcsInstance::SystemTrampoline(Ecs* ecs, EntityId* entities, int entityCount, EcsDt dt, void* udata)
+    {
+        SystemRecord* record = static_cast<SystemRecord*>(udata);
+#if defined(PICO_ECS_CPP_PROFILING)
+        const std::int64_t start = detail::ProfileNow();
+        const ReturnCode code = record->owner->SystemRun(*record, entities, entityCount, dt);
+        record->owner->ProfileSystem(*record, start, entityCount);
+        return code;
+#else
+        return record->owner->SystemRun(*record, entities, entityCount, dt);
+#endif
+    }
+
+    inline void EcsInstance::SystemAddedTrampoline(Ecs* ecs, EntityId id, void* udata)
+    {
+        SystemRecord* record = static_cast<SystemRecord*>(udata);
+        if (id >= record->memberSlots.size())
+            record->memberSlots.resize(id + 1, 0);
+        record->memberSlots[id] = record->members.size();
+        record->members.push_back(id);
+
+        if (record->added)
+            record->added(ecs, id, record->owner);
+    }
+
+    inline void EcsInstance::SystemRemovedTrampoline(Ecs* ecs, EntityId id, void* udata)
+    {
+        SystemRecord* record = static_cast<SystemRecord*>(udata);
+
+        // swaps the last member in, like pico_ecs does
+        const std::size_t slot = record->memberSlots[id];
+        const EntityId last = record->members.back();
+        record->members[slot] = last;
+        record->memberSlots[last] = slot;
+        record->members.pop_back();
+
+        if (record->removed)
+            record->removed(ecs, id, record->owner);
+    }
+
+    template<typename Func, typename ... Signature>
+    inline ReturnCode EcsInstance::SystemInvoke(void* callable, EcsInstance& ecs, EntityId* entities, int entityCount, EcsDt dt)
+    {
+        using ViewType = detail::SignatureView<Signature...>;
+        Func& func = *static_cast<Func*>(callable);
+
+        if constexpr (std::is_invocable_v<Func&, ViewType, EcsDt>)
+        {
+            using Result = std::invoke_result_t<Func&, ViewType, EcsDt>;
+            if constexpr (std::is_void_v<Result>)
+            {
+                func(ViewType(ecs, entities, entityCount), dt);
+                return 0;
+            }
+            else
+            {
+                return static_cast<ReturnCode>(func(ViewType(ecs, entities, entityCount), dt));
+            }
+        }
+        else if constexpr (std::is_invocable_v<Func&, Ecs*, EntityId*, int, EcsDt, void*>)
+        {
+            return static_cast<ReturnCode>(func(ecs.GetInstance(), entities, entityCount, dt, &ecs));
+        }
+        else
+        {
+            static_assert(std::is_invocable_v<Func&, EcsInstance&, EntityId*, int, EcsDt>,
+                "System callable must accept (View<required...>, EcsDt), (EcsInstance&, EntityId*, int, EcsDt) "
+                "or (Ecs*, EntityId*, int, EcsDt, void*)");
+
+            using Result = std::invoke_result_t<Func&, EcsInstance&, EntityId*, int, EcsDt>;
+            if constexpr (std::is_void_v<Result>)
+            {
+                func(ecs, entities, entityCount, dt);
+                return 0;
+            }
+            else
+            {
+                return static_cast<ReturnCode>(func(ecs, entities, entityCount, dt));
+            }
+        }
+    }
+
+    template<typename Func>
+    inline void EcsInstance::SystemRelease(void* callable)
+    {
+        delete static_cast<Func*>(callable);
+    }
+
+    template<typename ... CompTypes>
+    inline bool EcsInstance::SignatureRegistered(Require<CompTypes...>) const
+    {
+        return ((FindComponent<CompTypes>() != nullptr) && ...);
+    }
+
+    template<typename ... CompTypes>
+    inline bool EcsInstance::SignatureRegistered(Exclude<CompTypes...>) const
+    {
+        return ((FindComponent<CompTypes>() != nullptr) && ...);
+    }
+
+    template<typename ... CompTypes>
+    inline void EcsInstance::SignatureApply(SystemId sys, Require<CompTypes...>)
+    {
+        (SystemRequireComponent(sys, *FindComponent<CompTypes>()), ...);
+    }
+
+    template<typename ... CompTypes>
+    inline void EcsInstance::SignatureApply(SystemId sys, Exclude<CompTypes...>)
+    {
+        (SystemExcludeComponent(sys, *FindComponent<CompTypes>()), ...);
+    }
+
+    template<typename ... CompTypes>
+    inline bool EcsInstance::SignatureRegistered(Read<CompTypes...>) const
+    {
+        return ((FindComponent<CompTypes>() != nullptr) && ...);
+    }
+
+    template<typename ... CompTypes>
+    inline bool EcsInstance::SignatureRegistered(Write<CompTypes...>) const
+    {
+        return ((FindComponent<CompTypes>() != nullptr) && ...);
+    }
+
+    template<typename ... CompTypes>
+    inline void EcsInstance::SignatureApply(SystemId sys, Read<CompTypes...>)
+    {
+        systemRecords[sys]->accessDeclared = true;
+        (SystemDeclareAccess(sys, ComponentAccessId(*FindComponent<CompTypes>()), false), ...);
+    }
+
+    template<typename ... CompTypes>
+    inline void EcsInstance::SignatureApply(SystemId sys, Write<CompTypes...>)
+    {
+        systemRecords[sys]->accessDeclared = true;
+        (SystemDeclareAccess(sys, ComponentAccessId(*FindComponent<CompTypes>()), true), ...);
+    }
+
+    template<typename ... CompTypes>
+    inline bool EcsInstance::SignatureRegistered(Changed<CompTypes...>) const
+    {
+        return ((FindComponent<CompTypes>() != nullptr) && ...);
+    }
+
+    template<typename ... CompTypes>
+    inline void EcsInstance::SignatureApply(SystemId sys, Changed<CompTypes...>)
+    {
+        static_assert(!(detail::isTag<std::remove_cv_t<CompTypes>> || ...), "Tags carry no data to change");
+        auto add = [this, sys](const ComponentRecord* comp)
+            {
+                if (comp->sparse || comp->chunked)
+                    PICO_ECS_CPP_ERROR(StatusCode::InvalidArg, "Changes of sparse and chunked components are not tracked");
+                else
+                    ChangeFilterAdd(sys, comp->id);
+            };
+        (add(FindComponent<CompTypes>()), ...);
+    }
+
+    inline void EcsInstance::ChangeTrack(ComponentId comp)
+    {
+        if (comp >= changeColumns.size())
+            changeColumns.resize(comp + 1);
+
+        ChangeColumn& column = changeColumns[comp];
+        if (column.tracked)
+            return;
+
+        column.tracked = true;
+        column.ticks.assign(entityHighWater, ChangeTickCurrent());
+    }
+
+    inline void EcsInstance::ChangeFilterAdd(SystemId sys, ComponentId comp)
+    {
+        SystemRecord& record = *systemRecords[sys];
+        ecs_require_component(instance, sys, comp);
+        record.requiresComponents = true;
+
+        if (std::find(record.changed.begin(), record.changed.end(), comp) == record.changed.end())
+            record.changed.push_back(comp);
+
+        // the filter reads the ticks, but doesn't declare access of systems that declared none
+        if (std::find(record.reads.begin(), record.reads.end(), comp) == record.reads.end())
+            record.reads.push_back(comp);
+        scheduleDirty = true;
+
+        ChangeTrack(comp);
+    }
+
+    inline void EcsInstance::ChangeMark(ComponentId comp, EntityId id)
+    {
+        if (comp >= changeColumns.size())
+            return;
+
+        std::vector<std::uint32_t>& ticks = changeColumns[comp].ticks;
+        if (id < ticks.size())
+            ticks[id] = ChangeTickCurrent();
+    }
+
+    inline void EcsInstance::ChangeMarkAll()
+    {
+        const std::uint32_t tick = ChangeTickCurrent();
+        for (ChangeColumn& column : changeColumns)
+            std::fill(column.ticks.begin(), column.ticks.end(), tick);
+    }
+
+    inline void EcsInstance::ChangeGrow()
+    {
+        for (ChangeColumn& column : changeColumns)
+        {
+            if (column.tracked && column.ticks.size() < entityHighWater)
+                column.ticks.resize(entityHighWater, ChangeTickCurrent());
+        }
+    }
+
+    inline std::uint32_t EcsInstance::ChangeTickCurrent() const
+    {
+        // outside of systems, changes are newer than every run so far
+        const detail::ChangeScope& scope = detail::CurrentChangeScope();
+        if (scope.owner == this)
+            return scope.tick;
+        return changeTick.load(std::memory_order_relaxed) + 1;
+    }
+
+    template<typename CompType>
+    inline Span<std::uint32_t> EcsInstance::ChangeTicks()
+    {
+        const ComponentRecord* comp = FindComponent<CompType>();
+        if (!comp || comp->InTagBits() || comp->id >= changeColumns.size())
+            return Span<std::uint32_t>();
+
+        std::vector<std::uint32_t>& ticks = changeColumns[comp->id].ticks;
+        return Span<std::uint32_t>(ticks.data(), ticks.size());
+    }
+
+    inline Span<EntityId> EcsInstance::ChangeFilter(SystemRecord& record, EntityId* entities, int entityCount)
+    {
+        record.changedEntities.clear();
+        for (int i = 0; i < entityCount; ++i)
+        {
+            const EntityId id = entities[i];
+            for (ComponentId comp : record.changed)
+            {
+                const std::vector<std::uint32_t>& ticks = changeColumns[comp].ticks;
+                if (id < ticks.size() && detail::ChangeIsNewer(ticks[id], record.lastRunTick))
+                {
+                    record.changedEntities.push_back(id);
+                    break;
+                }
+            }
+        }
+        return Span<EntityId>(record.changedEntities);
+    }
+
+    inline bool EcsInstance::TagHas(ComponentId tag, EntityId id) const
+    {
+        const std::vector<std::uint64_t>& bits = tagBits[tag];
+        const std::size_t word = static_cast<std::size_t>(id) / 64;
+        return word < bits.size() && ((bits[word] >> (id % 64)) & 1ull) != 0;
+    }
+
+    inline void EcsInstance::TagSet(ComponentId tag, EntityId id, bool value)
+    {
+        std::vector<std::uint64_t>& bits = tagBits[tag];
+        const std::size_t word = static_cast<std::size_t>(id) / 64;
+        const std::uint64_t mask = 1ull << (id % 64);
+
+        if (value)
+        {
+            if (word >= bits.size())
+                bits.resize(word + 1, 0);
+            if (bits[word] & mask)
+                return;
+            bits[word] |= mask;
+        }
+        else
+        {
+            if (word >= bits.size() || !(bits[word] & mask))
+                return;
+            bits[word] &= ~mask;
+        }
+
+        ObserverColumn* column = tag < tagObserverColumns.size() ? tagObserverColumns[tag].get() : nullptr;
+        if (column)
+        {
+            if (value)
+                ObserverRaiseAdded(*column, id);
+            else
+                ObserverRaiseRemoved(*column, id);
+        }
+        if (tag < tagQueries.size() && !tagQueries[tag].empty())
+            QueryTagChanged(tag, id);
+    }
+
+    template<typename CompType>
+    inline CompType* EcsInstance::TagGet(const ComponentRecord& comp, EntityId id) const
+    {
+        if (!TagHas(comp.id, id))
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::CompGetFail,
+                FormatString("Entity [%i] doesn't have tag [%s]", id, typeid(CompType).name()));
+            return nullptr;
+        }
+        return detail::TagInstance<std::remove_cv_t<CompType>>();
+    }
+
+    inline void EcsInstance::TagRaiseRemoved(EntityId id)
+    {
+        for (std::size_t tag = 0; tag < tagObserverColumns.size(); ++tag)
+        {
+            if (tagObserverColumns[tag] && TagHas(static_cast<ComponentId>(tag), id))
+                ObserverRaiseRemoved(*tagObserverColumns[tag], id);
+        }
+    }
+
+    inline void EcsInstance::TagClearEntity(EntityId id)
+    {
+        for (std::size_t comp = 0; comp < sparseColumns.size(); ++comp)
+        {
+            if (sparseColumns[comp])
+                SparseRemove(static_cast<ComponentId>(comp), id);
+        }
+        ArchetypeRemoveEntity(id);
+
+        const std::size_t word = static_cast<std::size_t>(id) / 64;
+        const std::uint64_t mask = 1ull << (id % 64);
+        for (std::vector<std::uint64_t>& bits : tagBits)
+        {
+            if (word < bits.size())
+                bits[word] &= ~mask;
+        }
+        if (!queries.empty())
+            QueryForget(id);
+    }
+
+    inline Span<EntityId> EcsInstance::TagFilter(SystemRecord& record, EntityId* entities, int entityCount)
+    {
+        auto matches = [this, &record](EntityId id)
+            {
+                for (ComponentId tag : record.tagRequire)
+                {
+                    if (!TagHas(tag, id))
+                        return false;
+                }
+                for (ComponentId tag : record.tagExclude)
+                {
+                    if (TagHas(tag, id))
+                        return false;
+                }
+                return true;
+            };
+
+        record.tagEntities.clear();
+        if (record.requiresComponents)
+        {
+            for (int i = 0; i < entityCount; ++i)
+            {
+                if (matches(entities[i]))
+                    record.tagEntities.push_back(entities[i]);
+            }
+            return Span<EntityId>(record.tagEntities);
+        }
+
+        auto matchesAll = [this, &record, &matches](EntityId id)
+            {
+                if (!ecs_is_ready(instance, id) || !matches(id))
+                    return false;
+                for (ComponentId comp : record.excludes)
+                {
+                    if (ecs_has(instance, id, comp))
+                        return false;
+                }
+                return true;
+            };
+
+        // entities are listed chunk by chunk, so views over them walk the chunks in order
+        if (!record.chunkRequire.empty())
+        {
+            ArchetypeMatch(record);
+            const bool archetypesMatch = record.tagRequire.size() == record.chunkRequire.size()
+                && record.tagExclude.size() == record.chunkExclude.size() && record.excludes.empty();
+            for (std::uint32_t index : record.archetypes)
+            {
+                for (const ArchetypeChunk& chunk : archetypes[index]->chunks)
+                {
+                    const EntityId* ids = reinterpret_cast<const EntityId*>(chunk.data);
+                    if (archetypesMatch)
+                    {
+                        record.tagEntities.insert(record.tagEntities.end(), ids, ids + chunk.count);
+                        continue;
+                    }
+                    for (std::uint32_t row = 0; row < chunk.count; ++row)
+                    {
+                        if (matchesAll(ids[row]))
+                            record.tagEntities.push_back(ids[row]);
+                    }
+                }
+            }
+            return Span<EntityId>(record.tagEntities);
+        }
+
+        if (record.tagRequire.empty())
+        {
+            for (EntityId id = 0; id < entityHighWater; ++id)
+            {
+                if (matchesAll(id))
+                    record.tagEntities.push_back(id);
+            }
+            return Span<EntityId>(record.tagEntities);
+        }
+
+        // only entities with the first required tag are candidates, empty words are skipped
+        const std::vector<std::uint64_t>& candidates = tagBits[record.tagRequire[0]];
+        for (std::size_t word = 0; word < candidates.size(); ++word)
+        {
+            if (!candidates[word])
+                continue;
+
+            for (std::size_t bit = 0; bit < 64; ++bit)
+            {
+                const EntityId id = static_cast<EntityId>(word * 64 + bit);
+                if (((candidates[word] >> bit) & 1ull) && id < entityHighWater && matchesAll(id))
+                    record.tagEntities.push_back(id);
+            }
+        }
+        return Span<EntityId>(record.tagEntities);
+    }
+
+    inline void EcsInstance::SystemRequireComponent(SystemId sys, const ComponentRecord& comp)
+    {
+        SystemRecord* record = systemRecords[sys].get();
+        if (comp.InTagBits())
+        {
+            if (std::find(record->tagRequire.begin(), record->tagRequire.end(), comp.id) != record->tagRequire.end())
+                return;
+
+            record->tagRequire.push_back(comp.id);
+            if (comp.chunked)
+            {
+                record->chunkRequire.push_back(comp.id);
+                record->archetypes.clear();
+                record->archetypesSeen = 0;
+            }
+            return;
+        }
+
+        ecs_require_component(instance, sys, comp.id);
+        record->requiresComponents = true;
+    }
+
+    inline void EcsInstance::SystemExcludeComponent(SystemId sys, const ComponentRecord& comp)
+    {
+        SystemRecord* record = systemRecords[sys].get();
+        if (comp.InTagBits())
+        {
+            if (std::find(record->tagExclude.begin(), record->tagExclude.end(), comp.id) != record->tagExclude.end())
+                return;
+
+            record->tagExclude.push_back(comp.id);
+            if (comp.chunked)
+            {
+                record->chunkExclude.push_back(comp.id);
+                record->archetypes.clear();
+                record->archetypesSeen = 0;
+            }
+            return;
+        }
+
+        ecs_exclude_component(instance, sys, comp.id);
+        record->excludes.push_back(comp.id);
+    }
+
+    inline ComponentId EcsInstance::ComponentAccessId(const ComponentRecord& comp)
+    {
+        constexpr ComponentId tagFlag = static_cast<ComponentId>(1) << (sizeof(ComponentId) * 8 - 1);
+        return comp.InTagBits() ? comp.id | tagFlag : comp.id;
+    }
+
+    inline EcsInstance::SparseColumn::SparseColumn(std::size_t size, void(*relocate)(void* dst, void* src), ComponentDtor dtor, detail::MemoryContext* memory)
+        : storage(size, relocate, memory), dtor(dtor)
+    {
+    }
+
+    inline void* EcsInstance::SparseAdd(const ComponentRecord& comp, EntityId id, ComponentCtor ctor, void* args)
+    {
+        detail::SparseStorage& storage = sparseColumns[comp.id]->storage;
+        void* ptr = storage.Get(id);
+        if (!ptr)
+            ptr = storage.Insert(id);
+
+        std::memset(ptr, 0, comp.size);
+        if (ctor)
+            ctor(instance, id, ptr, args);
+        TagSet(comp.id, id, true);
+        return ptr;
+    }
+
+    inline void EcsInstance::SparseRemove(ComponentId comp, EntityId id)
+    {
+        SparseColumn& column = *sparseColumns[comp];
+        void* ptr = column.storage.Get(id);
+        if (!ptr)
+            return;
+
+        if (column.dtor)
+            column.dtor(instance, id, ptr);
+        column.storage.Erase(id);
+    }
+
+    inline void EcsInstance::SparseClear()
+    {
+        for (std::unique_ptr<SparseColumn>& column : sparseColumns)
+        {
+            if (!column)
+                continue;
+
+            if (column->dtor)
+            {
+                for (EntityId id : column->storage.GetEntities())
+                    column->dtor(instance, id, column->storage.Get(id));
+            }
+            column->storage.Clear();
+        }
+        removalQueue.clear();
+    }
+
+    inline void EcsInstance::RemovalQueueFlush()
+    {
+        // destructors may queue more removals
+        for (std::size_t i = 0; i < removalQueue.size(); ++i)
+        {
+            const auto [comp, id] = removalQueue[i];
+            if (comp == removalQueueAll)
+            {
+                TagClearEntity(id);
+            }
+            else if (TagHas(comp, id))
+            {
+                if (comp < sparseColumns.size() && sparseColumns[comp])
+                    SparseRemove(comp, id);
+                else
+                    ArchetypeRemove(comp, id);
+                TagSet(comp, id, false);
+            }
+        }
+        removalQueue.clear();
+    }
+
+    template<typename CompType>
+    inline const detail::SparseStorage* EcsInstance::ComponentSparseStorage() const
+    {
+        const ComponentRecord* comp = FindComponent<CompType>();
+        return comp && comp->sparse ? &sparseColumns[comp->id]->storage : nullptr;
+    }
+
+    inline std::uint32_t EcsInstance::ArchetypeToggle(std::uint32_t archetype, ComponentId comp)
+    {
+        if (archetypes.empty())
+            archetypes.push_back(std::make_unique<Archetype>());
+
+        Archetype& from = *archetypes[archetype];
+        auto edge = from.edges.find(comp);
+        if (edge != from.edges.end())
+            return edge->second;
+
+        std::vector<ComponentId> comps = from.comps;
+        auto pos = std::lower_bound(comps.begin(), comps.end(), comp);
+        if (pos != comps.end() && *pos == comp)
+            comps.erase(pos);
+        else
+            comps.insert(pos, comp);
+
+        std::uint32_t target = 0;
+        while (target < archetypes.size() && archetypes[target]->comps != comps)
+            ++target;
+
+        if (target == archetypes.size())
+        {
+            auto created = std::make_unique<Archetype>();
+            created->comps = std::move(comps);
+
+            // every column starts aligned like memory from the allocator
+            constexpr std::size_t alignment = alignof(std::max_align_t);
+            auto align = [](std::size_t size) { return (size + alignment - 1) / alignment * alignment; };
+
+            std::size_t rowSize = sizeof(EntityId);
+            for (ComponentId id : created->comps)
+                rowSize += chunkedComponents[id].size;
+            const std::size_t padding = alignment * (created->comps.size() + 1);
+            created->capacity = static_cast<std::uint32_t>(archetypeChunkSize > padding + rowSize ? (archetypeChunkSize - padding) / rowSize : 1);
+
+            std::size_t offset = align(created->capacity * sizeof(EntityId));
+            for (ComponentId id : created->comps)
+            {
+                created->offsets.push_back(offset);
+                offset = align(offset + created->capacity * chunkedComponents[id].size);
+            }
+            created->chunkSize = offset;
+            archetypes.push_back(std::move(created));
+        }
+
+        from.edges[comp] = target;
+        archetypes[target]->edges[comp] = archetype;
+        return target;
+    }
+
+    inline int EcsInstance::ArchetypeColumn(const Archetype& archetype, ComponentId comp)
+    {
+        auto pos = std::lower_bound(archetype.comps.begin(), archetype.comps.end(), comp);
+        if (pos == archetype.comps.end() || *pos != comp)
+            return -1;
+        return static_cast<int>(pos - archetype.comps.begin());
+    }
+
+    inline void* EcsInstance::ArchetypeAdd(const ComponentRecord& comp, EntityId id, ComponentCtor ctor, void* args)
+    {
+        void* ptr = ArchetypeGet(comp.id, id);
+        if (!ptr)
+        {
+            const std::uint32_t archetype = id < entityLocations.size() ? entityLocations[id].archetype : 0;
+            ArchetypeMove(id, ArchetypeToggle(archetype, comp.id));
+            ptr = ArchetypeGet(comp.id, id);
+        }
+
+        std::memset(ptr, 0, comp.size);
+        if (ctor)
+            ctor(instance, id, ptr, args);
+        TagSet(comp.id, id, true);
+        return ptr;
+    }
+
+    inline void* EcsInstance::ArchetypeGet(ComponentId comp, EntityId id) const
+    {
+        if (id >= entityLocations.size() || entityLocations[id].archetype == 0)
+            return nullptr;
+
+        const EntityLocation& location = entityLocations[id];
+        const Archetype& archetype = *archetypes[location.archetype];
+        const int column = ArchetypeColumn(archetype, comp);
+        if (column < 0)
+            return nullptr;
+        return archetype.chunks[location.chunk].data + archetype.offsets[column] + location.row * chunkedComponents[comp].size;
+    }
+
+    inline void EcsInstance::ArchetypeRemove(ComponentId comp, EntityId id)
+    {
+        void* ptr = ArchetypeGet(comp, id);
+        if (!ptr)
+            return;
+
+        if (chunkedComponents[comp].dtor)
+            chunkedComponents[comp].dtor(instance, id, ptr);
+        ArchetypeMove(id, ArchetypeToggle(entityLocations[id].archetype, comp));
+    }
+
+    inline void EcsInstance::ArchetypeRemoveEntity(EntityId id)
+    {
+        if (id >= entityLocations.size() || entityLocations[id].archetype == 0)
+            return;
+
+        const EntityLocation location = entityLocations[id];
+        const Archetype& archetype = *archetypes[location.archetype];
+        char* data = archetype.chunks[location.chunk].data;
+        for (std::size_t i = 0; i < archetype.comps.size(); ++i)
+        {
+            const ChunkedComponent& comp = chunkedComponents[archetype.comps[i]];
+            if (comp.dtor)
+                comp.dtor(instance, id, data + archetype.offsets[i] + location.row * comp.size);
+        }
+        ArchetypeEraseRow(location.archetype, location.chunk, location.row);
+        entityLocations[id] = EntityLocation();
+    }
+
+    inline void EcsInstance::ArchetypeMove(EntityId id, std::uint32_t target)
+    {
+        if (id >= entityLocations.size())
+            entityLocations.resize(std::max<std::size_t>(static_cast<std::size_t>(id) + 1, entityHighWater));
+
+        const EntityLocation from = entityLocations[id];
+        EntityLocation to;
+        if (target != 0)
+        {
+            Archetype& dst = *archetypes[target];
+            if (dst.chunks.empty() || dst.chunks.back().count == dst.capacity)
+                dst.chunks.push_back(ArchetypeChunk{ static_cast<char*>(detail::MemoryAllocate(dst.chunkSize, &memory)), 0 });
+
+            ArchetypeChunk& chunk = dst.chunks.back();
+            to = EntityLocation{ target, static_cast<std::uint32_t>(dst.chunks.size() - 1), chunk.count++ };
+            reinterpret_cast<EntityId*>(chunk.data)[to.row] = id;
+
+            if (from.archetype != 0)
+            {
+                const Archetype& src = *archetypes[from.archetype];
+                char* srcData = src.chunks[from.chunk].data;
+                for (std::size_t i = 0; i < dst.comps.size(); ++i)
+                {
+                    const int column = ArchetypeColumn(src, dst.comps[i]);
+                    if (column < 0)
+                        continue;
+
+                    const ChunkedComponent& comp = chunkedComponents[dst.comps[i]];
+                    ArchetypeRelocate(comp, chunk.data + dst.offsets[i] + to.row * comp.size,
+                        srcData + src.offsets[column] + from.row * comp.size);
+                }
+            }
+        }
+
+        if (from.archetype != 0)
+            ArchetypeEraseRow(from.archetype, from.chunk, from.row);
+        entityLocations[id] = to;
+    }
+
+    inline void EcsInstance::ArchetypeEraseRow(std::uint32_t index, std::uint32_t chunk, std::uint32_t row)
+    {
+        Archetype& archetype = *archetypes[index];
+        ArchetypeChunk& last = archetype.chunks.back();
+        const std::uint32_t lastChunk = static_cast<std::uint32_t>(archetype.chunks.size() - 1);
+        const std::uint32_t lastRow = --last.count;
+        if (chunk != lastChunk || row != lastRow)
+        {
+            char* data = archetype.chunks[chunk].data;
+            const EntityId moved = reinterpret_cast<EntityId*>(last.data)[lastRow];
+            reinterpret_cast<EntityId*>(data)[row] = moved;
+            for (std::size_t i = 0; i < archetype.comps.size(); ++i)
+            {
+                const ChunkedComponent& comp = chunkedComponents[archetype.comps[i]];
+                ArchetypeRelocate(comp, data + archetype.offsets[i] + row * comp.size,
+                    last.data + archetype.offsets[i] + lastRow * comp.size);
+            }
+            entityLocations[moved] = EntityLocation{ index, chunk, row };
+        }
+
+        if (last.count == 0)
+        {
+            detail::MemoryFree(last.data, &memory);
+            archetype.chunks.pop_back();
+        }
+    }
+
+    inline void EcsInstance::ArchetypeClear()
+    {
+        for (std::unique_ptr<Archetype>& archetype : archetypes)
+        {
+            for (ArchetypeChunk& chunk : archetype->chunks)
+            {
+                const EntityId* ids = reinterpret_cast<const EntityId*>(chunk.data);
+                for (std::size_t i = 0; i < archetype->comps.size(); ++i)
+                {
+                    const ChunkedComponent& comp = chunkedComponents[archetype->comps[i]];
+                    if (!comp.dtor)
+                        continue;
+
+                    for (std::uint32_t row = 0; row < chunk.count; ++row)
+                        comp.dtor(instance, ids[row], chunk.data + archetype->offsets[i] + row * comp.size);
+                }
+                detail::MemoryFree(chunk.data, &memory);
+            }
+            archetype->chunks.clear();
+        }
+        entityLocations.clear();
+    }
+
+    inline void EcsInstance::ArchetypeMatch(SystemRecord& record)
+    {
+        for (; record.archetypesSeen < archetypes.size(); ++record.archetypesSeen)
+        {
+            const Archetype& archetype = *archetypes[record.archetypesSeen];
+            bool matches = true;
+            for (ComponentId comp : record.chunkRequire)
+                matches = matches && ArchetypeColumn(archetype, comp) >= 0;
+            for (ComponentId comp : record.chunkExclude)
+                matches = matches && ArchetypeColumn(archetype, comp) < 0;
+
+            if (matches)
+                record.archetypes.push_back(static_cast<std::uint32_t>(record.archetypesSeen));
+        }
+    }
+
+    inline void EcsInstance::ArchetypeRelocate(const ChunkedComponent& comp, char* dst, char* src)
+    {
+        if (comp.relocate)
+            comp.relocate(dst, src);
+        else
+            std::memcpy(dst, src, comp.size);
+    }
+
+    template<typename CompType>
+    inline ComponentId EcsInstance::ComponentChunkedId() const
+    {
+        const ComponentRecord* comp = FindComponent<CompType>();
+        return comp && comp->chunked ? comp->id : noComponent;
+    }
+
+    inline void EcsInstance::ChangeMark(const ComponentRecord& comp, EntityId id)
+    {
+        if (!comp.sparse && !comp.chunked)
+            ChangeMark(comp.id, id);
+    }
+
+    template<typename CompType>
+    inline StatusCode EcsInstance::SystemRequire(SystemHandle sys)
+    {
+        if (!SystemIsRegistered(sys))
+            return StatusCode::SysNotReg;
+
+        const ComponentRecord* comp = FindComponent<CompType>();
+        if (!comp)
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::CompNotReg,
+                FormatString("Component of type [%s] is not registered", typeid(CompType).name()));
+            return StatusCode::CompNotReg;
+        }
+
+        SystemRequireComponent(sys.id, *comp);
+        return StatusCode::Success;
+    }
+
+    template<typename CompType>
+    inline StatusCode EcsInstance::SystemRequire(std::string_view sysName)
+    {
+        SystemHandle sys = SystemFind(sysName);
+        if (!sys.IsValid())
+            return StatusCode::SysNotReg;
+
+        return SystemRequire<CompType>(sys);
+    }
+
+    template<typename CompType>
+    inline StatusCode EcsInstance::SystemExclude(SystemHandle sys)
+    {
+        if (!SystemIsRegistered(sys))
+            return StatusCode::SysNotReg;
+
+        const ComponentRecord* comp = FindComponent<CompType>();
+        if (!comp)
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::CompNotReg,
+                FormatString("Component of type [%s] is not registered", typeid(CompType).name()));
+            return StatusCode::CompNotReg;
+        }
+
+        SystemExcludeComponent(sys.id, *comp);
+        return StatusCode::Success;
+    }
+
+    template<typename CompType>
+    inline StatusCode EcsInstance::SystemExclude(std::string_view sysName)
+    {
+        SystemHandle sys = SystemFind(sysName);
+        if (!sys.IsValid())
+            return StatusCode::SysNotReg;
+
+        return SystemExclude<CompType>(sys);
+    }
+
+    template<typename CompType>
+    inline StatusCode EcsInstance::SystemRead(SystemHandle sys)
+    {
+        if (!SystemIsRegistered(sys))
+            return StatusCode::SysNotReg;
+
+        const ComponentRecord* comp = FindComponent<CompType>();
+        if (!comp)
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::CompNotReg,
+                FormatString("Component of type [%s] is not registered", typeid(CompType).name()));
+            return StatusCode::CompNotReg;
+        }
+
+        SystemDeclareAccess(sys.id, ComponentAccessId(*comp), false);
+        return StatusCode::Success;
+    }
+
+    template<typename CompType>
+    inline StatusCode EcsInstance::SystemRead(std::string_view sysName)
+    {
+        SystemHandle sys = SystemFind(sysName);
+        if (!sys.IsValid())
+            return StatusCode::SysNotReg;
+
+        return SystemRead<CompType>(sys);
+    }
+
+    template<typename CompType>
+    inline StatusCode EcsInstance::SystemWrite(SystemHandle sys)
+    {
+        if (!SystemIsRegistered(sys))
+            return StatusCode::SysNotReg;
+
+        const ComponentRecord* comp = FindComponent<CompType>();
+        if (!comp)
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::CompNotReg,
+                FormatString("Component of type [%s] is not registered", typeid(CompType).name()));
+            return StatusCode::CompNotReg;
+        }
+
+        SystemDeclareAccess(sys.id, ComponentAccessId(*comp), true);
+        return StatusCode::Success;
+    }
+
+    template<typename CompType>
+    inline StatusCode EcsInstance::SystemWrite(std::string_view sysName)
+    {
+        SystemHandle sys = SystemFind(sysName);
+        if (!sys.IsValid())
+            return StatusCode::SysNotReg;
+
+        return SystemWrite<CompType>(sys);
+    }
+
+    template<typename CompType>
+    inline StatusCode EcsInstance::SystemChanged(SystemHandle sys)
+    {
+        if (!SystemIsRegistered(sys))
+            return StatusCode::SysNotReg;
+
+        const ComponentRecord* comp = FindComponent<CompType>();
+        if (!comp)
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::CompNotReg,
+                FormatString("Component of type [%s] is not registered", typeid(CompType).name()));
+            return StatusCode::CompNotReg;
+        }
+
+        if (comp->tag)
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::InvalidArg,
+                FormatString("Tag [%s] carries no data to change", typeid(CompType).name()));
+            return StatusCode::InvalidArg;
+        }
+        if (comp->sparse || comp->chunked)
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::InvalidArg,
+                FormatString("Changes of sparse or chunked component [%s] are not tracked", typeid(CompType).name()));
+            return StatusCode::InvalidArg;
+        }
+
+        ChangeFilterAdd(sys.id, comp->id);
+        return StatusCode::Success;
+    }
+
+    template<typename CompType>
+    inline StatusCode EcsInstance::SystemChanged(std::string_view sysName)
+    {
+        SystemHandle sys = SystemFind(sysName);
+        if (!sys.IsValid())
+            return StatusCode::SysNotReg;
+
+        return SystemChanged<CompType>(sys);
+    }
+
+    inline StatusCode EcsInstance::SystemSortBy(SystemHandle sys, SortKeyFunc key)
+    {
+        if (!SystemIsRegistered(sys))
+            return StatusCode::SysNotReg;
+
+        systemRecords[sys.id]->sortKey = std::move(key);
+        return StatusCode::Success;
+    }
+
+    inline StatusCode EcsInstance::SystemSortBy(std::string_view sysName, SortKeyFunc key)
+    {
+        SystemHandle sys = SystemFind(sysName);
+        if (!sys.IsValid())
+            return StatusCode::SysNotReg;
+
+        return SystemSortBy(sys, std::move(key));
+    }
+
+    inline StatusCode EcsInstance::SystemSetPhase(SystemHandle sys, SystemPhase phase)
+    {
+        if (!SystemIsRegistered(sys))
+            return StatusCode::SysNotReg;
+
+        systemRecords[sys.id]->phase = phase;
+        phasesUsed = true;
+        scheduleDirty = true;
+        return StatusCode::Success;
+    }
+
+    inline StatusCode EcsInstance::SystemSetPhase(std::string_view sysName, SystemPhase phase)
+    {
+        SystemHandle sys = SystemFind(sysName);
+        if (!sys.IsValid())
+            return StatusCode::SysNotReg;
+
+        return SystemSetPhase(sys, phase);
+    }
+
+    inline StatusCode EcsInstance::SystemSetRate(SystemHandle sys, const SystemRate& rate)
+    {
+        if (!SystemIsRegistered(sys))
+            return StatusCode::SysNotReg;
+
+        if (rate.frames < 1 || rate.maxSteps < 1 || (rate.mode == SystemRate::Mode::FixedStep && !(rate.step > 0)))
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::InvalidArg,
+                FormatString("Invalid rate for system [%s], frames and steps must be positive", systemRecords[sys.id]->name.c_str()));
+            return StatusCode::InvalidArg;
+        }
+
+        SystemRecord& record = *systemRecords[sys.id];
+        record.rate = rate;
+        record.rateTime = 0;
+        record.rateFrame = 0;
+        record.sliceTimes.clear();
+        record.sliceCursor = 0;
+        phasesUsed = true;
+        return StatusCode::Success;
+    }
+
+    inline StatusCode EcsInstance::SystemSetRate(std::string_view sysName, const SystemRate& rate)
+    {
+        SystemHandle sys = SystemFind(sysName);
+        if (!sys.IsValid())
+            return StatusCode::SysNotReg;
+
+        return SystemSetRate(sys, rate);
+    }
+
+    inline StatusCode EcsInstance::SystemEnable(SystemHandle sys)
+    {
+        if (!SystemIsRegistered(sys))
+            return StatusCode::SysNotReg;
+
+        ecs_enable_system(instance, sys.id);
+        systemRecords[sys.id]->enabled = true;
+        return StatusCode::Success;
+    }
+
+    inline StatusCode EcsInstance::SystemEnable(std::string_view sysName)
+    {
+        SystemHandle sys = SystemFind(sysName);
+        if (!sys.IsValid())
+            return StatusCode::SysNotReg;
+
+        return SystemEnable(sys);
+    }
+
+    inline StatusCode EcsInstance::SystemDisable(SystemHandle sys)
+    {
+        if (!SystemIsRegistered(sys))
+            return StatusCode::SysNotReg;
+
+        ecs_disable_system(instance, sys.id);
+        systemRecords[sys.id]->enabled = false;
+        return StatusCode::Success;
+    }
+
+    inline StatusCode EcsInstance::SystemDisable(std::string_view sysName)
+    {
+        SystemHandle sys = SystemFind(sysName);
+        if (!sys.IsValid())
+            return StatusCode::SysNotReg;
+
+        return SystemDisable(sys);
+    }
+
+    inline EntityId EcsInstance::EntityCreate()
+    {
+        const EntityId id = ecs_create(instance);
+        entityHighWater = std::max(entityHighWater, id + 1);
+        LiveSet(id, true);
+        if (!changeColumns.empty())
+            ChangeGrow();
+        if (!tagBits.empty())
+            TagClearEntity(id);
+        return id;
+    }
+
+    inline StatusCode EcsInstance::EntityCreateBatch(int count, Span<EntityId> out)
+    {
+        if (count < 0 || static_cast<std::size_t>(count) > out.Size())
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::InvalidArg,
+                FormatString("Cannot create [%i] entities into a span of size [%zu]", count, out.Size()));
+            return StatusCode::InvalidArg;
+        }
+
+        EntityId* ids = out.Data();
+        for (int i = 0; i < count; ++i)
+        {
+            ids[i] = ecs_create(instance);
+            entityHighWater = std::max(entityHighWater, ids[i] + 1);
+            LiveSet(ids[i], true);
+            if (!tagBits.empty())
+                TagClearEntity(ids[i]);
+        }
+        if (!changeColumns.empty())
+            ChangeGrow();
+        return StatusCode::Success;
+    }
+
+    inline bool EcsInstance::EntityIsReady(EntityId id) const
+    {
+        return ecs_is_ready(instance, id);
+    }
+
+    inline StatusCode EcsInstance::Compact(std::vector<EntityId>& translation)
+    {
+        for (const ComponentRecord& comp : components)
+        {
+            if (comp.registered && !comp.trivial && !comp.InTagBits() && !comp.move && !comp.copy)
+            {
+                PICO_ECS_CPP_ERROR(StatusCode::InvalidArg, "Entities can't be compacted, a component can neither be moved nor copied");
+                return StatusCode::InvalidArg;
+            }
+        }
+
+        ObserverFlush();
+
+        const EntityId count = entityHighWater;
+        translation.assign(count, invalidEntity);
+        EntityId liveCount = 0;
+        for (EntityId id = 0; id < count; ++id)
+        {
+            if (ecs_is_ready(instance, id))
+                translation[id] = liveCount++;
+        }
+
+        // components can only be added to live ids, and the unused ones are freed in order below
+        EntityMatchLiveness(count, std::vector<std::uint64_t>((static_cast<std::size_t>(count) + 63) / 64, ~0ull));
+
+        // entities only move to lower ids, so the previous holder of an id has already moved on when it's filled
+        for (EntityId id = 0; id < count; ++id)
+        {
+            if (translation[id] != invalidEntity && translation[id] != id)
+                EntityRenumber(id, translation[id]);
+        }
+
+        // destroyed from the top, pico_ecs hands out the most recently freed id first
+        for (EntityId id = count; id-- > liveCount;)
+        {
+            LiveSet(id, false);
+            ecs_destroy(instance, id);
+        }
+        entityHighWater = liveCount;
+
+        // tags, sparse and chunked components were moved without TagSet
+        for (QueryRecord* query : queries)
+            QueryPopulate(*query);
+
+        // drops the events raised while moving components
+        ObserverClear();
+        return StatusCode::Success;
+    }
+
+    inline StatusCode EcsInstance::EntityDestroy(EntityId id)
+    {
+        if (!tagBits.empty())
+        {
+            TagRaiseRemoved(id);
+            TagClearEntity(id);
+        }
+        else if (!queries.empty())
+        {
+            QueryForget(id);
+        }
+        if (!observerColumns.empty())
+            ObserverRaiseDestroyed(id);
+        LiveSet(id, false);
+        ecs_destroy(instance, id);
+        return StatusCode::Success;
+    }
+
+    template<typename CompType>
+    inline bool EcsInstance::EntityHasComponent(EntityId id)
+    {
+        const ComponentRecord* comp = FindComponent<CompType>();
+        if (!comp)
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::CompNotReg,
+                FormatString("Component of type [%s] is not registered", typeid(CompType).name()));
+            return false;
+        }
+
+        return ComponentHasRaw(*comp, id);
+    }
+
+    template<typename CompType>
+    inline CompType* EcsInstance::EntityGetComponent(EntityId id)
+    {
+        const ComponentRecord* comp = FindComponent<CompType>();
+        if (!comp)
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::CompNotReg,
+                FormatString("Component of type [%s] is not registered", typeid(CompType).name()));
+            return nullptr;
+        }
+
+        if constexpr (detail::isTag<std::remove_cv_t<CompType>>)
+        {
+            if (comp->tag)
+                return TagGet<CompType>(*comp, id);
+        }
+
+        CompType* compPtr = static_cast<CompType*>(ComponentGetRaw(*comp, id));
+        if (!compPtr)
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::CompGetFail,
+                FormatString("Failed to get component of type [%s] from entity [%i]", typeid(CompType).name(), id));
+            return nullptr;
+        }
+        ChangeMark(*comp, id);
+        return compPtr;
+    }
+
+    template<typename CompType>
+    inline const CompType* EcsInstance::EntityReadComponent(EntityId id) const
+    {
+        const ComponentRecord* comp = FindComponent<CompType>();
+        if (!comp)
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::CompNotReg,
+                FormatString("Component of type [%s] is not registered", typeid(CompType).name()));
+            return nullptr;
+        }
+
+        if constexpr (detail::isTag<std::remove_cv_t<CompType>>)
+        {
+            if (comp->tag)
+                return TagGet<const CompType>(*comp, id);
+        }
+
+        const CompType* compPtr = static_cast<const CompType*>(ComponentGetRaw(*comp, id));
+        if (!compPtr)
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::CompGetFail,
+                FormatString("Failed to get component of type [%s] from entity [%i]", typeid(CompType).name(), id));
+            return nullptr;
+        }
+        return compPtr;
+    }
+
+    template<typename CompType>
+    inline StatusCode EcsInstance::EntityMarkChanged(EntityId id)
+    {
+        const ComponentRecord* comp = FindComponent<CompType>();
+        if (!comp)
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::CompNotReg,
+                FormatString("Component of type [%s] is not registered", typeid(CompType).name()));
+            return StatusCode::CompNotReg;
+        }
+
+        if (!comp->tag)
+            ChangeMark(*comp, id);
+        return StatusCode::Success;
+    }
+
+    template<typename CompType>
+    inline CompType* EcsInstance::EntityAddComponent(EntityId id, void* args)
+    {
+        const ComponentRecord* comp = FindComponent<CompType>();
+        if (!comp)
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::CompNotReg,
+                FormatString("Component of type [%s] is not registered", typeid(CompType).name()));
+            return nullptr;
+        }
+
+        if constexpr (detail::isTag<CompType>)
+        {
+            if (comp->tag)
+            {
+                TagSet(comp->id, id, true);
+                return detail::TagInstance<CompType>();
+            }
+        }
+
+        if (comp->managed)
+        {
+            if (args)
+            {
+                if constexpr (std::is_copy_constructible_v<CompType>)
+                {
+                    ComponentInit init{ &ComponentCopy<CompType>, args };
+                    ComponentAddManaged(*comp, id, &init);
+                    return static_cast<CompType*>(ComponentGetRaw(*comp, id));
+                }
+            }
+            else if constexpr (std::is_default_constructible_v<CompType>)
+            {
+                ComponentAddManaged(*comp, id, nullptr);
+                return static_cast<CompType*>(ComponentGetRaw(*comp, id));
+            }
+
+            PICO_ECS_CPP_ERROR(StatusCode::InvalidArg,
+                FormatString("Component of type [%s] can't be constructed from args, use EntityEmplaceComponent", typeid(CompType).name()));
+            return nullptr;
+        }
+
+        void* ptr = ComponentAddRaw(*comp, id, args);
+        if constexpr (std::is_trivially_copyable_v<CompType>)
+        {
+            if (!comp->ctor && args)
+                std::memcpy(ptr, args, sizeof(CompType));
+        }
+        ChangeMark(*comp, id);
+        return static_cast<CompType*>(ptr);
+    }
+
+    template<typename CompType, typename ... Args>
+    inline CompType* EcsInstance::EntityEmplaceComponent(EntityId id, Args&& ... args)
+    {
+        const ComponentRecord* comp = FindComponent<CompType>();
+        if (!comp)
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::CompNotReg,
+                FormatString("Component of type [%s] is not registered", typeid(CompType).name()));
+            return nullptr;
+        }
+
+        if constexpr (detail::isTag<CompType>)
+        {
+            if (comp->tag)
+            {
+                TagSet(comp->id, id, true);
+                return detail::TagInstance<CompType>();
+            }
+        }
+
+        // aggregates can't be constructed with parentheses before C++20
+        auto construct = [&args...](void* ptr)
+            {
+                if constexpr (std::is_constructible_v<CompType, Args&&...>)
+                    new (ptr) CompType(std::forward<Args>(args)...);
+                else
+                    new (ptr) CompType{ std::forward<Args>(args)... };
+            };
+
+        if (comp->managed)
+        {
+            ComponentInit init{ [](void* ptr, void* ctx) { (*static_cast<decltype(construct)*>(ctx))(ptr); }, &construct };
+            ComponentAddManaged(*comp, id, &init);
+            return static_cast<CompType*>(ComponentGetRaw(*comp, id));
+        }
+
+        if (comp->ctor)
+        {
+            alignas(CompType) unsigned char value[sizeof(CompType)];
+            construct(value);
+            CompType* ptr = static_cast<CompType*>(ComponentAddRaw(*comp, id, value));
+            reinterpret_cast<CompType*>(value)->~CompType();
+            ChangeMark(*comp, id);
+            return ptr;
+        }
+
+        void* ptr = ComponentAddRaw(*comp, id, nullptr);
+        construct(ptr);
+        ChangeMark(*comp, id);
+        return static_cast<CompType*>(ptr);
+    }
+
+    template<typename CompType>
+    inline StatusCode EcsInstance::EntityAddComponentBatch(Span<const EntityId> ids, Span<const CompType> values)
+    {
+        const ComponentRecord* comp = FindComponent<CompType>();
+        if (!comp)
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::CompNotReg,
+                FormatString("Component of type [%s] is not registered", typeid(CompType).name()));
+            return StatusCode::CompNotReg;
+        }
+        if (ids.Size() != values.Size())
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::InvalidArg,
+                FormatString("Batch of [%zu] entities got [%zu] values", ids.Size(), values.Size()));
+            return StatusCode::InvalidArg;
+        }
+        if (ids.IsEmpty())
+            return StatusCode::Success;
+
+        return ComponentAddBatch<CompType>(*comp, ids, values);
+    }
+
+    template<typename CompType>
+    inline StatusCode EcsInstance::ComponentAddBatch(const ComponentRecord& comp, Span<const EntityId> ids, Span<const CompType> values)
+    {
+        const ComponentId compId = comp.id;
+        const std::size_t count = ids.Size();
+        const std::size_t stride = values.Size() == 1 ? 0 : 1;
+
+        if constexpr (detail::isTag<CompType>)
+        {
+            if (comp.tag)
+            {
+                for (std::size_t i = 0; i < count; ++i)
+                    TagSet(compId, ids[i], true);
+                return StatusCode::Success;
+            }
+        }
+
+        if constexpr (std::is_trivially_copyable_v<CompType>)
+        {
+            if (!comp.ctor)
+            {
+                // sparse and chunked storage is not indexed by entity id, so every value is copied on its own
+                if (comp.sparse || comp.chunked)
+                {
+                    for (std::size_t i = 0; i < count; ++i)
+                        std::memcpy(ComponentAddRaw(comp, ids[i], nullptr), &values[i * stride], sizeof(CompType));
+                    return StatusCode::Success;
+                }
+
+                for (std::size_t i = 0; i < count; ++i)
+                    PicoAdd(comp, ids[i], nullptr);
+
+                // storage can move while adding, so it is resolved after the adds
+                char* base = ComponentStorageBase<CompType>(ids[0]);
+                for (std::size_t i = 0; i < count; ++i)
+                {
+                    std::memcpy(base + static_cast<std::size_t>(ids[i]) * sizeof(CompType), &values[i * stride], sizeof(CompType));
+                    ChangeMark(compId, ids[i]);
+                }
+                return StatusCode::Success;
+            }
+        }
+
+        if (comp.managed)
+        {
+            for (std::size_t i = 0; i < count; ++i)
+            {
+                ComponentInit init{ &ComponentCopy<CompType>, const_cast<CompType*>(&values[i * stride]) };
+                ComponentAddManaged(comp, ids[i], &init);
+            }
+            return StatusCode::Success;
+        }
+
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            ComponentAddRaw(comp, ids[i], const_cast<CompType*>(&values[i * stride]));
+            ChangeMark(comp, ids[i]);
+        }
+        return StatusCode::Success;
+    }
+
+    inline StatusCode EcsInstance::PrefabInstantiate(const Prefab& prefab, int count, Span<EntityId> out)
+    {
+        if (count < 0 || (!out.IsEmpty() && out.Size() < static_cast<std::size_t>(count)))
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::InvalidArg,
+                FormatString("Cannot instantiate [%i] entities into a span of size [%zu]", count, out.Size()));
+            return StatusCode::InvalidArg;
+        }
+        if (count == 0)
+            return StatusCode::Success;
+
+        for (const Prefab::Entry& entry : prefab.entries)
+        {
+            if (entry.slot >= components.size() || !components[entry.slot].registered)
+            {
+                PICO_ECS_CPP_ERROR(StatusCode::CompNotReg, "Prefab contains unregistered components");
+                return StatusCode::CompNotReg;
+            }
+        }
+
+        std::vector<EntityId> created;
+        if (out.IsEmpty())
+        {
+            created.resize(static_cast<std::size_t>(count));
+            out = Span<EntityId>(created.data(), created.size());
+        }
+
+        Span<EntityId> ids(out.Data(), static_cast<std::size_t>(count));
+        EntityCreateBatch(count, ids);
+        for (const Prefab::Entry& entry : prefab.entries)
+            entry.add(*this, ids, entry.value.get());
+
+        return StatusCode::Success;
+    }
+
+    template<typename CompType>
+    inline StatusCode EcsInstance::PrefabAdd(EcsInstance& ecs, Span<const EntityId> ids, const void* value)
+    {
+        return ecs.ComponentAddBatch<CompType>(*ecs.FindComponent<CompType>(), ids,
+            Span<const CompType>(static_cast<const CompType*>(value), 1));
+    }
+
+    template<typename CompType>
+    inline StatusCode EcsInstance::EntityRemoveComponent(EntityId id)
+    {
+        const ComponentRecord* comp = FindComponent<CompType>();
+        if (!comp)
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::CompNotReg,
+                FormatString("Component of type [%s] is not registered", typeid(CompType).name()));
+            return StatusCode::CompNotReg;
+        }
+
+        if (comp->tag)
+        {
+            TagSet(comp->id, id, false);
+            return StatusCode::Success;
+        }
+
+        ComponentRemoveRaw(*comp, id);
+
+        return StatusCode::Success;
+    }
+
+    inline StatusCode EcsInstance::EntityQueueDestroy(EntityId id)
     {
-        return ecs_is_ready(instance, id);
+        if (deferQueue || threadPool)
+        {
+            std::lock_guard<std::mutex> lock(deferredMutex);
+            deferredQueue.emplace_back(nullptr, id);
+            return StatusCode::Success;
+        }
+
+        // tag bits are cleared once the id is reused, sparse and chunked components once the running system returns
+        if (!tagObserverColumns.empty())
+            TagRaiseRemoved(id);
+        if (!observerColumns.empty())
+            ObserverRaiseDestroyed(id);
+        if (!queries.empty())
+            QueryForget(id);
+        if (!sparseColumns.empty() || !chunkedComponents.empty())
+            removalQueue.emplace_back(removalQueueAll, id);
+        liveQueued.push_back(id);
+        ecs_queue_destroy(instance, id);
+        return StatusCode::Success;
     }
 
-    inline StatusCode EcsInstance::EntityDestroy(EntityId id)
+    template<typename CompType>
+    inline StatusCode EcsInstance::EntityQueueRemoveComponent(EntityId id)
     {
-        ecs_destroy(instance, id);
+        const ComponentRecord* comp = FindComponent<CompType>();
+        if (!comp)
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::CompNotReg,
+                FormatString("Component of type [%s] is not registered", typeid(CompType).name()));
+            return StatusCode::CompNotReg;
+        }
+
+        if (deferQueue || threadPool)
+        {
+            std::lock_guard<std::mutex> lock(deferredMutex);
+            deferredQueue.emplace_back(comp, id);
+            return StatusCode::Success;
+        }
+
+        // tags own no storage, so removing them can't disturb the running system
+        if (comp->tag)
+        {
+            TagSet(comp->id, id, false);
+            return StatusCode::Success;
+        }
+        if (comp->sparse || comp->chunked)
+        {
+            removalQueue.emplace_back(comp->id, id);
+            return StatusCode::Success;
+        }
+
+        ObserverColumn* column = comp->id < observerColumns.size() ? observerColumns[comp->id].get() : nullptr;
+        if (column && ecs_has(instance, id, comp->id))
+            ObserverRaiseRemoved(*column, id);
+        if (comp->id < componentQueries.size() && !componentQueries[comp->id].empty())
+            queryQueued.emplace_back(comp->id, id);
+        ecs_queue_remove(instance, id, comp->id);
         return StatusCode::Success;
     }
 
+    template<typename ... CompTypes>
+    inline View<CompTypes...>::View(EcsInstance& ecs, EntityId* entities, int entityCount)
+        : entities(entities), entityCount(entityCount)
+    {
+        if (entityCount <= 0)
+        {
+            this->entityCount = 0;
+            return;
+        }
+
+        sparse = { ecs.ComponentSparseStorage<CompTypes>()... };
+        chunked = { ecs.ComponentChunkedId<CompTypes>()... };
+        bases = { ecs.ComponentSparseStorage<CompTypes>() || ecs.ComponentChunkedId<CompTypes>() != EcsInstance::noComponent
+            ? nullptr : ecs.ComponentStorageBase<CompTypes>(entities[0])... };
+
+        bool anyChunked = false;
+        for (std::size_t i = 0; i < bases.size(); ++i)
+        {
+            anyChunked = anyChunked || chunked[i] != EcsInstance::noComponent;
+            if (!bases[i] && !sparse[i] && chunked[i] == EcsInstance::noComponent)
+            {
+                this->entityCount = 0;
+                return;
+            }
+        }
+
+        if (anyChunked)
+        {
+            LocateRuns(ecs);
+            if (this->entityCount == 0)
+                return;
+        }
+
+        ticks = { (std::is_const_v<CompTypes> ? Span<std::uint32_t>() : ecs.ChangeTicks<CompTypes>())... };
+        tick = ecs.ChangeTickCurrent();
+    }
+
+    template<typename ... CompTypes>
+    inline typename View<CompTypes...>::Iterator View<CompTypes...>::begin() const
+    {
+        return Iterator(this, 0);
+    }
+
+    template<typename ... CompTypes>
+    inline typename View<CompTypes...>::Iterator View<CompTypes...>::end() const
+    {
+        return Iterator(this, entityCount);
+    }
+
+    template<typename ... CompTypes>
+    inline int View<CompTypes...>::Size() const
+    {
+        return entityCount;
+    }
+
+    template<typename ... CompTypes>
+    template<typename Func>
+    inline void View<CompTypes...>::Each(Func&& func) const
+    {
+        for (Iterator it = begin(), last = end(); it != last; ++it)
+        {
+            std::apply([&](CompTypes&... comps) { func(it.GetEntity(), comps...); }, *it);
+        }
+    }
+
+    template<typename ... CompTypes>
+    inline View<CompTypes...>::Iterator::Iterator(const View* view, int index)
+        : view(view), index(index)
+    {
+        if (index == 0 && !view->runs.empty())
+            columns = view->runs[0].columns;
+    }
+
+    template<typename ... CompTypes>
+    inline typename View<CompTypes...>::Iterator::reference View<CompTypes...>::Iterator::operator*() const
+    {
+        return Get(std::index_sequence_for<CompTypes...>{});
+    }
+
+    template<typename ... CompTypes>
+    template<std::size_t ... Indices>
+    inline typename View<CompTypes...>::Iterator::reference View<CompTypes...>::Iterator::Get(std::index_sequence<Indices...>) const
+    {
+        const std::size_t id = static_cast<std::size_t>(view->entities[index]);
+        (view->template MarkChanged<Indices>(id), ...);
+        return reference(*reinterpret_cast<CompTypes*>(view->template GetSlot<Indices>(id, columns))...);
+    }
+
+    template<typename ... CompTypes>
+    template<std::size_t Index>
+    inline char* View<CompTypes...>::GetSlot(std::size_t id, const std::array<char*, sizeof...(CompTypes)>& columns) const
+    {
+        using CompType = std::tuple_element_t<Index, std::tuple<CompTypes...>>;
+        if (chunked[Index] != EcsInstance::noComponent)
+            return columns[Index];
+        if (sparse[Index])
+            return static_cast<char*>(sparse[Index]->Get(static_cast<EntityId>(id)));
+        return bases[Index] + id * sizeof(CompType);
+    }
+
+    template<typename ... CompTypes>
+    inline void View<CompTypes...>::LocateRuns(const EcsInstance& ecs)
+    {
+        constexpr std::array<std::size_t, sizeof...(CompTypes)> sizes = { sizeof(CompTypes)... };
+        for (std::size_t i = 0; i < chunked.size(); ++i)
+            strides[i] = chunked[i] != EcsInstance::noComponent ? sizes[i] : 0;
+
+        int index = 0;
+        while (index < entityCount)
+        {
+            const EntityId id = entities[index];
+            if (id >= ecs.entityLocations.size() || ecs.entityLocations[id].archetype == 0)
+            {
+                entityCount = 0;
+                return;
+            }
+
+            const EcsInstance::EntityLocation& location = ecs.entityLocations[id];
+            const EcsInstance::Archetype& archetype = *ecs.archetypes[location.archetype];
+            const EcsInstance::ArchetypeChunk& chunk = archetype.chunks[location.chunk];
+
+            Run run;
+            for (std::size_t i = 0; i < chunked.size(); ++i)
+            {
+                if (chunked[i] == EcsInstance::noComponent)
+                    continue;
+
+                const int column = EcsInstance::ArchetypeColumn(archetype, chunked[i]);
+                if (column < 0)
+                {
+                    entityCount = 0;
+                    return;
+                }
+                run.columns[i] = chunk.data + archetype.offsets[column] + location.row * sizes[i];
+            }
+
+            // systems list the entities of a chunk in row order
+            const EntityId* rows = reinterpret_cast<const EntityId*>(chunk.data);
+            std::uint32_t row = location.row + 1;
+            ++index;
+            while (index < entityCount && row < chunk.count && rows[row] == entities[index])
+            {
+                ++index;
+                ++row;
+            }
+            run.end = index;
+            runs.push_back(run);
+        }
+    }
+
+    template<typename ... CompTypes>
+    template<std::size_t Index>
+    inline void View<CompTypes...>::MarkChanged(std::size_t id) const
+    {
+        using CompType = std::tuple_element_t<Index, std::tuple<CompTypes...>>;
+        if constexpr (!std::is_const_v<CompType>)
+        {
+            if (id < ticks[Index].Size())
+                ticks[Index][id] = tick;
+        }
+    }
+
+    template<typename ... CompTypes>
+    inline typename View<CompTypes...>::Iterator& View<CompTypes...>::Iterator::operator++()
+    {
+        ++index;
+        if (view->runs.empty())
+            return *this;
+
+        if (index == view->runs[run].end)
+        {
+            if (++run < view->runs.size())
+                columns = view->runs[run].columns;
+        }
+        else
+        {
+            for (std::size_t i = 0; i < columns.size(); ++i)
+                columns[i] += view->strides[i];
+        }
+        return *this;
+    }
+
+    template<typename ... CompTypes>
+    inline typename View<CompTypes...>::Iterator View<CompTypes...>::Iterator::operator++(int)
+    {
+        Iterator copy = *this;
+        ++*this;
+        return copy;
+    }
+
+    template<typename ... CompTypes>
+    inline bool View<CompTypes...>::Iterator::operator==(const Iterator& other) const
+    {
+        return index == other.index;
+    }
+
+    template<typename ... CompTypes>
+    inline bool View<CompTypes...>::Iterator::operator!=(const Iterator& other) const
+    {
+        return index != other.index;
+    }
+
+    template<typename ... CompTypes>
+    inline EntityId View<CompTypes...>::Iterator::GetEntity() const
+    {
+        return view->entities[index];
+    }
+
+    inline CommandBuffer::CommandBuffer(std::uint32_t index)
+        : index(index)
+    {
+    }
+
+    inline CommandBuffer::~CommandBuffer()
+    {
+        Clear();
+    }
+
+    inline DeferredEntity CommandBuffer::EntityCreate()
+    {
+        Command command;
+        command.type = CommandType::Create;
+        command.entity = createCount;
+        Push(command);
+
+        if (createCount >= created.size())
+            created.resize(createCount + 1);
+        return DeferredEntity{ index, createCount++ };
+    }
+
+    inline void CommandBuffer::EntityDestroy(EntityId id)
+    {
+        Command command;
+        command.type = CommandType::Destroy;
+        command.entity = id;
+        Push(command);
+    }
+
     template<typename CompType>
-    inline bool EcsInstance::EntityHasComponent(EntityId id)
+    inline void CommandBuffer::EntityAddComponent(EntityId id, CompType value)
     {
-        return ecs_has(instance, id, components.at(typeid(CompType)));
+        Command command;
+        command.entity = id;
+        command.payload = new (Allocate(sizeof(CompType), alignof(CompType))) CompType(std::move(value));
+        command.apply = &ApplyAdd<CompType>;
+        if constexpr (!std::is_trivially_destructible_v<CompType>)
+            command.release = &ReleasePayload<CompType>;
+        Push(command);
     }
 
     template<typename CompType>
-    inline CompType* EcsInstance::EntityGetComponent(EntityId id)
+    inline void CommandBuffer::EntityAddComponent(DeferredEntity entity, CompType value)
     {
-        CompType* compPtr = static_cast<CompType*>(ecs_get(instance, id, components.at(typeid(CompType))));
-        if (!compPtr)
+        EntityAddComponent<CompType>(static_cast<EntityId>(entity.index), std::move(value));
+        commands.back().deferred = true;
+    }
+
+    template<typename CompType>
+    inline void CommandBuffer::EntityRemoveComponent(EntityId id)
+    {
+        Command command;
+        command.entity = id;
+        command.apply = &ApplyRemove<CompType>;
+        Push(command);
+    }
+
+    inline bool CommandBuffer::IsEmpty() const
+    {
+        return commands.empty();
+    }
+
+    inline void CommandBuffer::Push(Command command)
+    {
+        command.order = detail::CommandOrderKey();
+        command.sequence = sequence++;
+        commands.push_back(command);
+    }
+
+    inline void* CommandBuffer::Allocate(std::size_t size, std::size_t alignment)
+    {
+        while (true)
         {
-            PICO_ECS_CPP_ERROR(StatusCode::CompGetFail,
-                FormatString("Failed to get component of type [%s] from entity [%i]", typeid(CompType).name(), id));
-            return nullptr;
+            if (blockIndex < blocks.size())
+            {
+                const std::uintptr_t base = reinterpret_cast<std::uintptr_t>(blocks[blockIndex].get());
+                const std::uintptr_t aligned = (base + blockOffset + alignment - 1) & ~(static_cast<std::uintptr_t>(alignment) - 1);
+                const std::size_t end = static_cast<std::size_t>(aligned - base) + size;
+                if (end <= blockSizes[blockIndex])
+                {
+                    blockOffset = end;
+                    return reinterpret_cast<void*>(aligned);
+                }
+
+                ++blockIndex;
+                blockOffset = 0;
+                continue;
+            }
+
+            const std::size_t blockSize = std::max(arenaBlockSize, size + alignment);
+            blocks.push_back(std::unique_ptr<unsigned char[]>(new unsigned char[blockSize]));
+            blockSizes.push_back(blockSize);
         }
-        return compPtr;
     }
 
-    template<typename CompType>
-    inline CompType* EcsInstance::EntityAddComponent(EntityId id, void* args)
+    inline void CommandBuffer::Clear()
     {
-        if (components.find(typeid(CompType)) == components.end())
+        for (Command& command : commands)
         {
-            PICO_ECS_CPP_ERROR(StatusCode::CompNotReg,
-                FormatString("Component of type [%s] is not registered", typeid(CompType).name()));
-            return nullptr;
+            if (command.release)
+                command.release(command.payload);
         }
 
-        return static_cast<CompType*>(
-            ecs_add(instance, id, components.at(typeid(CompType)), std::move(args)));
+        commands.clear();
+        createCount = 0;
+        sequence = 0;
+        blockIndex = 0;
+        blockOffset = 0;
     }
 
     template<typename CompType>
-    inline StatusCode EcsInstance::EntityRemoveComponent(EntityId id)
+    inline void CommandBuffer::ApplyAdd(EcsInstance& ecs, EntityId id, void* payload)
+    {
+        // the payload is released right after playback, so it can be moved from
+        ecs.EntityEmplaceComponent<CompType>(id, std::move(*static_cast<CompType*>(payload)));
+    }
+
+    template<typename CompType>
+    inline void CommandBuffer::ApplyRemove(EcsInstance& ecs, EntityId id, void* payload)
+    {
+        ecs.EntityRemoveComponent<CompType>(id);
+    }
+
+    template<typename CompType>
+    inline void CommandBuffer::ReleasePayload(void* payload)
+    {
+        static_cast<CompType*>(payload)->~CompType();
+    }
+
+    template<typename CompType>
+    inline Prefab& Prefab::Set(CompType value)
+    {
+        const std::size_t slot = detail::TypeSlot<CompType>();
+        auto it = std::find_if(entries.begin(), entries.end(), [slot](const Entry& entry) { return entry.slot == slot; });
+        if (it == entries.end())
+            it = entries.insert(entries.end(), Entry());
+
+        it->slot = slot;
+        it->value = std::make_shared<CompType>(std::move(value));
+        it->add = &EcsInstance::PrefabAdd<CompType>;
+        return *this;
+    }
+
+    inline std::size_t Prefab::Size() const
+    {
+        return entries.size();
+    }
+
+#if defined(PICO_ECS_CPP_PROFILING)
+
+    inline void detail::ProfileWindow::Add(double ms)
+    {
+        samples[next] = ms;
+        next = (next + 1) % capacity;
+        count = std::min(count + 1, capacity);
+        last = ms;
+    }
+
+    inline ProfileStats detail::ProfileWindow::GetStats() const
     {
-        if (components.find(typeid(CompType)) == components.end())
+        ProfileStats stats;
+        if (count == 0)
+            return stats;
+
+        std::array<double, capacity> sorted = samples;
+        std::sort(sorted.begin(), sorted.begin() + count);
+
+        double sum = 0.0;
+        for (std::size_t i = 0; i < count; ++i)
+            sum += sorted[i];
+
+        // nearest rank
+        const std::size_t rank = (count * 99 + 99) / 100;
+
+        stats.lastMs = last;
+        stats.minMs = sorted[0];
+        stats.meanMs = sum / static_cast<double>(count);
+        stats.p99Ms = sorted[rank - 1];
+        stats.sampleCount = static_cast<int>(count);
+        return stats;
+    }
+
+    inline void detail::ProfileWindow::Clear()
+    {
+        count = 0;
+        next = 0;
+        last = 0.0;
+    }
+
+    inline std::vector<SystemProfile> EcsInstance::ProfileGetSystems() const
+    {
+        std::vector<SystemProfile> profiles;
+        for (const std::unique_ptr<SystemRecord>& record : systemRecords)
         {
-            PICO_ECS_CPP_ERROR(StatusCode::CompNotReg,
-                FormatString("Component of type [%s] is not registered", typeid(CompType).name()));
-            return StatusCode::CompNotReg;
+            if (!record)
+                continue;
+
+            SystemProfile profile;
+            profile.name = record->name;
+            profile.handle = SystemHandle(record->id);
+            profile.entityCount = record->profileEntityCount;
+            profile.time = record->profileTime.GetStats();
+            profile.queueTime = record->profileQueueTime.GetStats();
+            profiles.push_back(profile);
+        }
+        return profiles;
+    }
+
+    inline ProfileStats EcsInstance::ProfileGetUpdate() const
+    {
+        return profileUpdate.GetStats();
+    }
+
+    inline ProfileStats EcsInstance::ProfileGetFlush() const
+    {
+        return profileFlush.GetStats();
+    }
+
+    inline StatusCode EcsInstance::ProfileWriteTrace(std::string_view path) const
+    {
+        std::ofstream file{ std::string(path) };
+        if (!file)
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::FileFail, FormatString("Failed to open [%s] for writing", std::string(path).c_str()));
+            return StatusCode::FileFail;
         }
 
-        ecs_remove(instance, id, components.at(typeid(CompType)));
+        std::lock_guard<std::mutex> lock(profileMutex);
+
+        // once the buffer wraps around, the oldest event is the next one to be overwritten
+        const std::size_t count = profileEvents.size();
+        const std::size_t first = count == profileMaxEvents ? profileNextEvent : 0;
+
+        file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        for (std::size_t i = 0; i < count; ++i)
+        {
+            const TraceEvent& event = profileEvents[(first + i) % count];
+
+            std::string name;
+            for (char c : event.name)
+            {
+                if (c == '"' || c == '\\') name += '\\';
+                name += c;
+            }
+
+            // timestamps are in microseconds
+            file << FormatString("{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"entities\":%d}}",
+                name.c_str(), event.category, event.thread,
+                static_cast<double>(event.start) / 1e3, static_cast<double>(event.duration) / 1e3, event.entityCount);
+            file << (i + 1 < count ? ",\n" : "\n");
+        }
+        file << "]}\n";
 
+        if (!file)
+        {
+            PICO_ECS_CPP_ERROR(StatusCode::FileFail, FormatString("Failed to write [%s]", std::string(path).c_str()));
+            return StatusCode::FileFail;
+        }
         return StatusCode::Success;
     }
 
-    inline StatusCode EcsInstance::EntityQueueDestroy(EntityId id)
+    inline void EcsInstance::ProfileClear()
     {
-        ecs_queue_destroy(instance, id);
-        return StatusCode::Success;
+        for (std::unique_ptr<SystemRecord>& record : systemRecords)
+        {
+            if (!record)
+                continue;
+
+            record->profileTime.Clear();
+            record->profileQueueTime.Clear();
+            record->profileEntityCount = 0;
+        }
+        profileUpdate.Clear();
+        profileFlush.Clear();
+
+        std::lock_guard<std::mutex> lock(profileMutex);
+        profileEvents.clear();
+        profileNextEvent = 0;
     }
 
-    template<typename CompType>
-    inline StatusCode EcsInstance::EntityQueueRemoveComponent(EntityId id)
+    inline void EcsInstance::ProfileSystem(SystemRecord& record, std::int64_t start, int entityCount)
+    {
+        const std::int64_t end = detail::ProfileNow();
+        record.profileRan = true;
+        record.profileRunNs = end - start;
+        record.profileEntityCount = entityCount;
+        record.profileTime.Add(static_cast<double>(end - start) / 1e6);
+        ProfileTrace(record.name, "system", start, end, entityCount);
+    }
+
+    inline void EcsInstance::ProfileTrace(std::string_view name, const char* category, std::int64_t start, std::int64_t end, int entityCount)
+    {
+        TraceEvent event;
+        event.name = name;
+        event.category = category;
+        event.start = start;
+        event.duration = end - start;
+        event.thread = threadPool ? threadPool->GetCurrentIndex() : 0;
+        event.entityCount = entityCount;
+
+        std::lock_guard<std::mutex> lock(profileMutex);
+        if (profileEvents.size() < profileMaxEvents)
+            profileEvents.push_back(event);
+        else
+            profileEvents[profileNextEvent] = event;
+        profileNextEvent = (profileNextEvent + 1) % profileMaxEvents;
+    }
+
+#endif
+}
+
+// platform -----------------------------------------------
+
+#if defined(PICO_ECS_CPP_IMPLEMENTATION)
+
+#if defined(_WIN32)
+    #if !defined(WIN32_LEAN_AND_MEAN)
+        #define WIN32_LEAN_AND_MEAN
+    #endif
+    #if !defined(NOMINMAX)
+        #define NOMINMAX
+    #endif
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+namespace pico_ecs_cpp
+{
+    detail::MappedFile::~MappedFile()
+    {
+#if defined(_WIN32)
+        if (data) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        if (file) CloseHandle(file);
+#else
+        if (data) munmap(const_cast<char*>(data), size);
+#endif
+    }
+
+    bool detail::MappedFile::Open(const std::string& path)
     {
-        if (components.find(typeid(CompType)) == components.end())
+#if defined(_WIN32)
+        const HANDLE opened = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (opened == INVALID_HANDLE_VALUE)
+            return false;
+        file = opened;
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart <= 0)
+            return false;
+
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping)
+            return false;
+
+        const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (!view)
+            return false;
+
+        data = static_cast<const char*>(view);
+        size = static_cast<std::size_t>(fileSize.QuadPart);
+        return true;
+#else
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size <= 0)
         {
-            PICO_ECS_CPP_ERROR(StatusCode::CompNotReg,
-                FormatString("Component of type [%s] is not registered", typeid(CompType).name()));
-            return StatusCode::CompNotReg;
+            close(fd);
+            return false;
         }
 
-        ecs_queue_remove(instance, id, components.at(typeid(CompType)));
-        
-        return StatusCode::Success;
+        void* view = mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (view == MAP_FAILED)
+            return false;
+
+        data = static_cast<const char*>(view);
+        size = static_cast<std::size_t>(info.st_size);
+        return true;
+#endif
     }
-}
\ No newline at end of file
+}
+
+#endif